@@ -0,0 +1,740 @@
+#include "ChunkStore.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+#include "Metrics.h"
+#include "SaveArchive.h"
+
+namespace {
+    constexpr char packMagic[4] = { 'S', 'S', 'M', 'C' };
+    constexpr char manifestMagic[4] = { 'S', 'S', 'M', 'M' };
+    constexpr std::uint32_t storeVersion = 1;
+
+    struct StoreFileHeader {
+        char magic[4];
+        std::uint32_t version;
+    };
+    static_assert(sizeof(StoreFileHeader) == 8);
+
+    // A chunk in the pack, storedSize equal to rawSize means the chunk did not compress and is kept as is
+    struct ChunkRecordHeader {
+        ChunkHash hash;
+        std::uint32_t rawSize;
+        std::uint32_t storedSize;
+    };
+    static_assert(sizeof(ChunkRecordHeader) == 24);
+
+    enum ManifestRecordType : std::uint8_t {
+        ManifestAdd = 1,
+        ManifestRemove = 2,
+        ManifestPin = 3,
+        ManifestUnpin = 4,
+    };
+
+    // Followed by the name, then chunkCount hashes for ManifestAdd
+    struct ManifestRecordHeader {
+        std::uint8_t type;
+        std::uint8_t reserved;
+        std::uint16_t nameLength;
+        std::uint32_t chunkCount;
+        std::uint64_t rawSize;
+        std::int64_t writeTime;
+        std::uint32_t crc;          // Of the stored file
+        std::uint32_t recordCrc;    // Of the whole record with this field as 0
+    };
+    static_assert(sizeof(ManifestRecordHeader) == 32);
+
+    // Files are read in blocks this large, at least one whole chunk past the cut is always in memory
+    constexpr size_t ingestBufferSize = 1024 * 1024;
+
+    constexpr int compressionLevel = 1;
+
+    // Gear table, one fixed random value per byte value
+    constexpr std::uint64_t SplitMix64(std::uint64_t& state) {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    constexpr std::array<std::uint64_t, 256> MakeGearTable() {
+        std::array<std::uint64_t, 256> table = {};
+        std::uint64_t state = 0x5353'4D43'6765'6172ull;
+        for (std::uint64_t& value : table) value = SplitMix64(state);
+        return table;
+    }
+    constexpr std::array<std::uint64_t, 256> gearTable = MakeGearTable();
+
+    // The hash shifts left, so its top bits hold the most recent bytes
+    constexpr std::uint64_t TopBits(int count) {
+        return ~0ull << (64 - count);
+    }
+    constexpr int averageChunkBits = std::countr_zero(averageChunkSize);
+    constexpr std::uint64_t strictMask = TopBits(averageChunkBits + 2);
+    constexpr std::uint64_t looseMask = TopBits(averageChunkBits - 2);
+
+    constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ull;
+    constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr std::uint64_t prime3 = 0x165667B19E3779F9ull;
+
+    std::uint64_t ReadWord(const unsigned char* data) {
+        std::uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        return word;
+    }
+
+    std::uint64_t Avalanche(std::uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        hash *= prime3;
+        return hash ^ (hash >> 32);
+    }
+
+    std::uint32_t RecordCrc(ManifestRecordHeader header, const std::string& name, const std::vector<ChunkHash>* hashes) {
+        header.recordCrc = 0;
+        uLong crc = crc32(0, reinterpret_cast<const Bytef*>(&header), sizeof(header));
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(name.data()), static_cast<uInt>(name.size()));
+        if (hashes && !hashes->empty()) {
+            crc = crc32(crc, reinterpret_cast<const Bytef*>(hashes->data()), static_cast<uInt>(hashes->size() * sizeof(ChunkHash)));
+        }
+        return static_cast<std::uint32_t>(crc);
+    }
+
+    bool WriteStoreHeader(const std::string& path, const char (&magic)[4]) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        StoreFileHeader header = {};
+        std::memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = storeVersion;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        return file.good();
+    }
+
+    // Returns false if the file exists but is not a store file of this version
+    bool CheckStoreHeader(std::ifstream& file, const char (&magic)[4]) {
+        StoreFileHeader header = {};
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+        return std::memcmp(header.magic, magic, sizeof(header.magic)) == 0 && header.version == storeVersion;
+    }
+
+    std::string SaveNameOf(const std::string& fileName) {
+        return std::filesystem::path(fileName).stem().string();
+    }
+}
+
+size_t FindChunkEnd(const unsigned char* data, size_t size) {
+    if (size <= minChunkSize) return size;
+
+    size_t end = std::min(size, maxChunkSize);
+    size_t normal = std::min(end, averageChunkSize);
+    std::uint64_t hash = 0;
+    size_t i = minChunkSize;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gearTable[data[i]];
+        if (!(hash & strictMask)) return i + 1;
+    }
+    for (; i < end; i++) {
+        hash = (hash << 1) + gearTable[data[i]];
+        if (!(hash & looseMask)) return i + 1;
+    }
+    return end;
+}
+
+// Four independent lanes over 32 byte blocks, so the multiplies of one block overlap instead of waiting on each other
+ChunkHash HashChunk(const unsigned char* data, size_t size) {
+    std::uint64_t lanes[4] = { prime1 + prime2, prime2, 0, 0 - prime1 };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            lanes[lane] += ReadWord(data + i + lane * 8) * prime2;
+            lanes[lane] = std::rotl(lanes[lane], 31) * prime1;
+        }
+    }
+
+    // The tail is zero padded, its length goes into the final mix
+    unsigned char tail[32] = {};
+    std::memcpy(tail, data + i, size - i);
+    for (int lane = 0; lane < 4; lane++) {
+        lanes[lane] += ReadWord(tail + lane * 8) * prime2;
+        lanes[lane] = std::rotl(lanes[lane], 31) * prime1;
+    }
+
+    std::uint64_t low = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+    std::uint64_t high = std::rotl(lanes[3], 3) ^ std::rotl(lanes[2], 23) ^ (lanes[1] * prime3) ^ (lanes[0] + prime1);
+    return { Avalanche(low + size), Avalanche(high ^ (size * prime3)) };
+}
+
+bool ChunkStore::Open(const std::string& dir) {
+    bool compact = false;
+    {
+        std::lock_guard ingestLock(ingestMutex);
+        std::lock_guard lock(mutex);
+        storeDir = dir;
+        packPath = (std::filesystem::path(dir) / "chunks.pack").string();
+        manifestPath = (std::filesystem::path(dir) / "manifest.log").string();
+        chunks.clear();
+        recipes.clear();
+        saveBytes.clear();
+        pinned.clear();
+        packSize = logicalBytes = liveBytes = deadBytes = 0;
+
+        std::error_code error;
+        std::filesystem::create_directories(dir, error);
+        if (!LoadPack() || !LoadManifest()) return false;
+        spdlog::info("Chunk store holds {} files, {:.1f} MB in a {:.1f} MB pack", recipes.size(),
+            logicalBytes / (1024.0 * 1024.0), packSize / (1024.0 * 1024.0));
+
+        // Dropped saves leave their chunks in the pack until it is rewritten
+        compact = deadBytes > std::max<std::uint64_t>(liveBytes / 4, 16 * 1024 * 1024);
+    }
+    if (compact) Compact();
+    return true;
+}
+
+bool ChunkStore::LoadPack() {
+    std::error_code error;
+    if (!std::filesystem::exists(packPath, error)) {
+        if (!WriteStoreHeader(packPath, packMagic)) return false;
+        packSize = sizeof(StoreFileHeader);
+        return true;
+    }
+
+    std::ifstream file(packPath, std::ios::binary);
+    if (!CheckStoreHeader(file, packMagic)) {
+        spdlog::warn("{} is not a chunk pack this version can read", packPath);
+        return false;
+    }
+    std::uint64_t fileSize = std::filesystem::file_size(packPath, error);
+    std::uint64_t offset = sizeof(StoreFileHeader);
+
+    ChunkRecordHeader header = {};
+    while (file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        std::uint64_t dataOffset = offset + sizeof(header);
+        if (header.rawSize == 0 || header.rawSize > maxChunkSize || header.storedSize == 0 || header.storedSize > header.rawSize) break;
+        if (header.storedSize > fileSize - dataOffset) break;
+
+        // Every chunk starts out unused, the manifest then adds the references
+        if (chunks.try_emplace(header.hash, ChunkLocation{ dataOffset, header.rawSize, header.storedSize, 0 }).second) {
+            deadBytes += header.storedSize;
+        }
+        offset = dataOffset + header.storedSize;
+        file.seekg(static_cast<std::streamoff>(offset));
+    }
+    file.close();
+
+    if (offset != fileSize) {
+        spdlog::warn("Cutting a partly written chunk off {}", packPath);
+        std::filesystem::resize_file(packPath, offset, error);
+        if (error) return false;
+    }
+    packSize = offset;
+    return true;
+}
+
+bool ChunkStore::LoadManifest() {
+    std::error_code error;
+    if (!std::filesystem::exists(manifestPath, error)) return WriteStoreHeader(manifestPath, manifestMagic);
+
+    std::ifstream file(manifestPath, std::ios::binary);
+    if (!CheckStoreHeader(file, manifestMagic)) {
+        spdlog::warn("{} is not a chunk store manifest this version can read", manifestPath);
+        return false;
+    }
+    std::uint64_t fileSize = std::filesystem::file_size(manifestPath, error);
+    std::uint64_t offset = sizeof(StoreFileHeader);
+
+    ManifestRecordHeader header = {};
+    std::string name;
+    std::vector<ChunkHash> hashes;
+    while (file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        std::uint64_t recordSize = sizeof(header) + header.nameLength + std::uint64_t(header.chunkCount) * sizeof(ChunkHash);
+        if (recordSize > fileSize - offset) break;
+
+        name.resize(header.nameLength);
+        hashes.resize(header.type == ManifestAdd ? header.chunkCount : 0);
+        if (!file.read(name.data(), name.size())) break;
+        if (!file.read(reinterpret_cast<char*>(hashes.data()), hashes.size() * sizeof(ChunkHash))) break;
+        if (RecordCrc(header, name, &hashes) != header.recordCrc) break;
+        offset += recordSize;
+
+        switch (header.type) {
+        case ManifestAdd: {
+            bool complete = std::all_of(hashes.begin(), hashes.end(), [this](const ChunkHash& hash) {
+                return chunks.contains(hash);
+            });
+            if (!complete) {
+                spdlog::warn("Chunk store lost part of {}, it can no longer be rehydrated", name);
+                DropRecipe(name);
+                break;
+            }
+            AddRecipe(name, Recipe{ header.rawSize, header.writeTime, header.crc, hashes });
+            break;
+        }
+        case ManifestRemove:
+            DropRecipe(name);
+            break;
+        case ManifestPin:
+            pinned.insert(name);
+            break;
+        case ManifestUnpin:
+            pinned.erase(name);
+            break;
+        }
+    }
+    file.close();
+
+    if (offset != fileSize) {
+        spdlog::warn("Cutting a partly written record off {}", manifestPath);
+        std::filesystem::resize_file(manifestPath, offset, error);
+        if (error) return false;
+    }
+    return true;
+}
+
+void ChunkStore::WriteManifestRecord(std::ostream& file, std::uint8_t type, const std::string& name, const Recipe* recipe) {
+    ManifestRecordHeader header = {};
+    header.type = type;
+    header.nameLength = static_cast<std::uint16_t>(name.size());
+    if (recipe) {
+        header.chunkCount = static_cast<std::uint32_t>(recipe->chunks.size());
+        header.rawSize = recipe->rawSize;
+        header.writeTime = recipe->writeTime;
+        header.crc = recipe->crc;
+    }
+    header.recordCrc = RecordCrc(header, name, recipe ? &recipe->chunks : nullptr);
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(name.data(), name.size());
+    if (recipe) file.write(reinterpret_cast<const char*>(recipe->chunks.data()), recipe->chunks.size() * sizeof(ChunkHash));
+}
+
+bool ChunkStore::AppendManifestRecord(std::uint8_t type, const std::string& name, const Recipe* recipe, bool flush) {
+    {
+        std::ofstream file(manifestPath, std::ios::binary | std::ios::app);
+        WriteManifestRecord(file, type, name, recipe);
+        if (!file.good()) return false;
+    }
+    return !flush || FlushToDisk(manifestPath);
+}
+
+void ChunkStore::AddRecipe(const std::string& fileName, Recipe recipe) {
+    DropRecipe(fileName);
+    for (const ChunkHash& hash : recipe.chunks) {
+        ChunkLocation& location = chunks.at(hash);
+        if (location.refs++ == 0) {
+            deadBytes -= location.storedSize;
+            liveBytes += location.storedSize;
+        }
+    }
+    saveBytes[SaveNameOf(fileName)] += recipe.rawSize;
+    logicalBytes += recipe.rawSize;
+    recipes.insert_or_assign(fileName, std::move(recipe));
+}
+
+void ChunkStore::DropRecipe(const std::string& fileName) {
+    auto found = recipes.find(fileName);
+    if (found == recipes.end()) return;
+
+    for (const ChunkHash& hash : found->second.chunks) {
+        ChunkLocation& location = chunks.at(hash);
+        if (--location.refs == 0) {
+            liveBytes -= location.storedSize;
+            deadBytes += location.storedSize;
+        }
+    }
+    logicalBytes -= found->second.rawSize;
+    std::string saveName = SaveNameOf(fileName);
+    saveBytes[saveName] -= found->second.rawSize;
+    recipes.erase(found);
+    if (!recipes.contains(saveName + ".ess") && !recipes.contains(saveName + ".skse")) saveBytes.erase(saveName);
+}
+
+bool ChunkStore::Ingest(const std::string& filePath, ChunkStoreStats* stats) {
+    std::lock_guard ingestLock(ingestMutex);
+    std::error_code error;
+    std::filesystem::path sourcePath(filePath);
+    std::string fileName = sourcePath.filename().string();
+    std::uint64_t fileSize = std::filesystem::file_size(sourcePath, error);
+    if (error) return false;
+    auto writeTime = std::filesystem::last_write_time(sourcePath, error);
+    if (error) return false;
+    {
+        // A file whose removal failed after it was stored is not taken in twice
+        std::lock_guard lock(mutex);
+        auto found = recipes.find(fileName);
+        if (found != recipes.end() && found->second.rawSize == fileSize) return true;
+    }
+
+    std::ifstream input(filePath, std::ios::binary);
+    if (!input) return false;
+    std::ofstream pack(packPath, std::ios::binary | std::ios::app);
+    if (!pack) return false;
+
+    Recipe recipe = { 0, static_cast<std::int64_t>(writeTime.time_since_epoch().count()), 0, {} };
+    uLong crc = crc32(0, nullptr, 0);
+    std::uint64_t startSize = packSize;
+    std::uint64_t appendOffset = packSize;
+    std::vector<ChunkHash> added;
+    ChunkStoreStats fileStats;
+
+    std::vector<unsigned char> buffer(ingestBufferSize + maxChunkSize);
+    std::vector<unsigned char> compressed(compressBound(maxChunkSize));
+    size_t filled = 0;
+    bool ok = true;
+    bool end = false;
+    while (ok && (!end || filled > 0)) {
+        if (!end) {
+            input.read(reinterpret_cast<char*>(buffer.data() + filled), buffer.size() - filled);
+            if (input.bad()) {
+                ok = false;
+                break;
+            }
+            size_t read = static_cast<size_t>(input.gcount());
+            crc = crc32(crc, buffer.data() + filled, static_cast<uInt>(read));
+            filled += read;
+            end = input.eof();
+        }
+
+        // Cuts are only made while a whole chunk is in memory, the rest waits for the next read
+        size_t position = 0;
+        while (filled - position > 0 && (end || filled - position >= maxChunkSize)) {
+            const unsigned char* chunk = buffer.data() + position;
+            size_t chunkSize = FindChunkEnd(chunk, filled - position);
+            ChunkHash hash = HashChunk(chunk, chunkSize);
+            recipe.chunks.push_back(hash);
+            recipe.rawSize += chunkSize;
+            position += chunkSize;
+            fileStats.chunks++;
+
+            {
+                std::lock_guard lock(mutex);
+                if (chunks.contains(hash)) continue;
+            }
+
+            uLongf storedSize = static_cast<uLongf>(compressed.size());
+            const unsigned char* stored = compressed.data();
+            if (compress2(compressed.data(), &storedSize, chunk, static_cast<uLong>(chunkSize), compressionLevel) != Z_OK || storedSize >= chunkSize) {
+                storedSize = static_cast<uLongf>(chunkSize);
+                stored = chunk;
+            }
+
+            ChunkRecordHeader header = { hash, static_cast<std::uint32_t>(chunkSize), static_cast<std::uint32_t>(storedSize) };
+            pack.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            pack.write(reinterpret_cast<const char*>(stored), storedSize);
+            if (!pack.good()) {
+                ok = false;
+                break;
+            }
+            {
+                std::lock_guard lock(mutex);
+                chunks.try_emplace(hash, ChunkLocation{ appendOffset + sizeof(header), header.rawSize, header.storedSize, 0 });
+                deadBytes += header.storedSize; // Until the recipe is added
+            }
+            added.push_back(hash);
+            appendOffset += sizeof(header) + storedSize;
+            fileStats.newChunks++;
+            fileStats.storedBytes += storedSize;
+        }
+        std::memmove(buffer.data(), buffer.data() + position, filled - position);
+        filled -= position;
+    }
+    pack.close();
+
+    recipe.crc = static_cast<std::uint32_t>(crc);
+    fileStats.rawBytes = recipe.rawSize;
+    ok = ok && !pack.fail() && (added.empty() || FlushToDisk(packPath));
+
+    std::lock_guard lock(mutex);
+    packSize = appendOffset;
+    if (ok) ok = AppendManifestRecord(ManifestAdd, fileName, &recipe, true);
+    if (!ok) {
+        // Nothing refers to the new chunks yet, so the pack can go back to where it was
+        for (const ChunkHash& hash : added) {
+            deadBytes -= chunks.at(hash).storedSize;
+            chunks.erase(hash);
+        }
+        std::filesystem::resize_file(packPath, startSize, error);
+        packSize = startSize;
+        return false;
+    }
+    AddRecipe(fileName, std::move(recipe));
+
+    if (stats) {
+        stats->rawBytes += fileStats.rawBytes;
+        stats->chunks += fileStats.chunks;
+        stats->newChunks += fileStats.newChunks;
+        stats->storedBytes += fileStats.storedBytes;
+    }
+    return true;
+}
+
+bool ChunkStore::ReadChunks(const Recipe& recipe, std::uint64_t limit, const std::function<bool(const unsigned char*, size_t)>& sink) const {
+    std::vector<ChunkLocation> locations;
+    {
+        std::lock_guard lock(mutex);
+        for (const ChunkHash& hash : recipe.chunks) {
+            auto found = chunks.find(hash);
+            if (found == chunks.end()) return false;
+            locations.push_back(found->second);
+        }
+    }
+
+    std::ifstream pack(packPath, std::ios::binary);
+    if (!pack) return false;
+    std::vector<unsigned char> stored(maxChunkSize);
+    std::vector<unsigned char> raw(maxChunkSize);
+    std::uint64_t produced = 0;
+    for (const ChunkLocation& location : locations) {
+        if (produced >= limit) break;
+        pack.seekg(static_cast<std::streamoff>(location.offset));
+        if (!pack.read(reinterpret_cast<char*>(stored.data()), location.storedSize)) return false;
+
+        const unsigned char* data = stored.data();
+        if (location.storedSize < location.rawSize) {
+            uLongf rawSize = static_cast<uLongf>(raw.size());
+            if (uncompress(raw.data(), &rawSize, stored.data(), location.storedSize) != Z_OK || rawSize != location.rawSize) return false;
+            data = raw.data();
+        }
+        if (!sink(data, location.rawSize)) return false;
+        produced += location.rawSize;
+    }
+    return true;
+}
+
+bool ChunkStore::Rehydrate(const std::string& fileName, const std::string& outputPath) const {
+    Recipe recipe;
+    {
+        std::lock_guard lock(mutex);
+        auto found = recipes.find(fileName);
+        if (found == recipes.end()) return false;
+        recipe = found->second;
+    }
+
+    std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+    if (!output) return false;
+    uLong crc = crc32(0, nullptr, 0);
+    std::uint64_t rawSize = 0;
+    bool ok = ReadChunks(recipe, UINT64_MAX, [&](const unsigned char* data, size_t size) {
+        crc = crc32(crc, data, static_cast<uInt>(size));
+        rawSize += size;
+        output.write(reinterpret_cast<const char*>(data), size);
+        return output.good();
+    });
+    output.close();
+
+    std::error_code error;
+    if (!ok || output.fail() || rawSize != recipe.rawSize || crc != recipe.crc) {
+        spdlog::warn("Stored {} is damaged", fileName);
+        std::filesystem::remove(outputPath, error);
+        return false;
+    }
+    std::filesystem::last_write_time(outputPath, std::filesystem::file_time_type(std::filesystem::file_time_type::duration(recipe.writeTime)), error);
+    return true;
+}
+
+std::vector<std::byte> ChunkStore::ReadPrefix(const std::string& fileName, size_t maxBytes) const {
+    std::vector<std::byte> prefix;
+    Recipe recipe;
+    {
+        std::lock_guard lock(mutex);
+        auto found = recipes.find(fileName);
+        if (found == recipes.end()) return prefix;
+        recipe = found->second;
+    }
+
+    bool ok = ReadChunks(recipe, maxBytes, [&](const unsigned char* data, size_t size) {
+        size = std::min(size, maxBytes - prefix.size());
+        prefix.insert(prefix.end(), reinterpret_cast<const std::byte*>(data), reinterpret_cast<const std::byte*>(data) + size);
+        return true;
+    });
+    if (!ok) prefix.clear();
+    return prefix;
+}
+
+void ChunkStore::RemoveSave(const std::string& saveName) {
+    std::lock_guard lock(mutex);
+    for (const char* extension : { ".ess", ".skse" }) {
+        std::string fileName = saveName + extension;
+        if (!recipes.contains(fileName)) continue;
+
+        // Not flushed, a remove that is lost only brings the save back to be deleted again
+        AppendManifestRecord(ManifestRemove, fileName, nullptr, false);
+        DropRecipe(fileName);
+    }
+    if (pinned.erase(saveName)) AppendManifestRecord(ManifestUnpin, saveName, nullptr, false);
+}
+
+bool ChunkStore::HoldsFile(const std::string& fileName) const {
+    std::lock_guard lock(mutex);
+    return recipes.contains(fileName);
+}
+
+bool ChunkStore::HoldsSave(std::string_view saveName) const {
+    std::lock_guard lock(mutex);
+    return saveBytes.contains(saveName);
+}
+
+void ChunkStore::Pin(const std::string& saveName) {
+    std::lock_guard lock(mutex);
+    if (pinned.insert(saveName).second) AppendManifestRecord(ManifestPin, saveName, nullptr, true);
+}
+
+bool ChunkStore::IsPinned(std::string_view saveName) const {
+    std::lock_guard lock(mutex);
+    return pinned.contains(saveName);
+}
+
+void ChunkStore::ForEachSave(const std::function<void(const std::string&, std::uint64_t)>& function) const {
+    std::lock_guard lock(mutex);
+    for (const auto& savePair : saveBytes) {
+        function(savePair.first, savePair.second);
+    }
+}
+
+void ChunkStore::ForEachFile(const std::function<void(const std::string&, std::uint64_t)>& function) const {
+    std::lock_guard lock(mutex);
+    for (const auto& recipePair : recipes) {
+        function(recipePair.first, recipePair.second.rawSize);
+    }
+}
+
+bool ChunkStore::Compact() {
+    std::lock_guard ingestLock(ingestMutex);
+    std::lock_guard lock(mutex);
+    std::string packTemp = packPath + ".tmp";
+    std::string manifestTemp = manifestPath + ".tmp";
+
+    // Chunks in use are copied as they are stored, in pack order so the old pack is read front to back
+    std::vector<std::pair<ChunkHash, ChunkLocation>> live;
+    for (const auto& chunkPair : chunks) {
+        if (chunkPair.second.refs) live.push_back(chunkPair);
+    }
+    std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) {
+        return a.second.offset < b.second.offset;
+    });
+
+    std::uint64_t newSize = sizeof(StoreFileHeader);
+    if (!WriteStoreHeader(packTemp, packMagic)) return false;
+    {
+        std::ifstream oldPack(packPath, std::ios::binary);
+        std::ofstream newPack(packTemp, std::ios::binary | std::ios::app);
+        std::vector<char> data(maxChunkSize);
+        for (auto& chunkPair : live) {
+            ChunkLocation& location = chunkPair.second;
+            oldPack.seekg(static_cast<std::streamoff>(location.offset));
+            if (!oldPack.read(data.data(), location.storedSize)) return false;
+
+            ChunkRecordHeader header = { chunkPair.first, location.rawSize, location.storedSize };
+            newPack.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            newPack.write(data.data(), location.storedSize);
+            location.offset = newSize + sizeof(header);
+            newSize += sizeof(header) + location.storedSize;
+        }
+        if (!newPack.good()) return false;
+    }
+
+    // The manifest is swapped first: if the swap stops halfway, the old pack still holds every chunk it refers to
+    bool ok = WriteStoreHeader(manifestTemp, manifestMagic);
+    {
+        std::ofstream manifest(manifestTemp, std::ios::binary | std::ios::app);
+        for (const auto& recipePair : recipes) {
+            WriteManifestRecord(manifest, ManifestAdd, recipePair.first, &recipePair.second);
+        }
+        for (const std::string& saveName : pinned) {
+            WriteManifestRecord(manifest, ManifestPin, saveName, nullptr);
+        }
+        ok = ok && manifest.good();
+    }
+    ok = ok && FlushToDisk(manifestTemp) && FlushToDisk(packTemp);
+
+    std::error_code error;
+    if (ok) std::filesystem::rename(manifestTemp, manifestPath, error);
+    if (ok && !error) std::filesystem::rename(packTemp, packPath, error);
+    if (!ok || error) {
+        spdlog::warn("Could not compact the chunk store in {}", storeDir);
+        std::filesystem::remove(packTemp, error);
+        std::filesystem::remove(manifestTemp, error);
+        return false;
+    }
+
+    spdlog::info("Compacted the chunk store from {:.1f} MB to {:.1f} MB", packSize / (1024.0 * 1024.0), newSize / (1024.0 * 1024.0));
+    chunks.clear();
+    for (auto& chunkPair : live) {
+        chunks.emplace(chunkPair.first, chunkPair.second);
+    }
+    packSize = newSize;
+    deadBytes = 0;
+    return true;
+}
+
+std::uint64_t ChunkStore::GetLogicalBytes() const {
+    std::lock_guard lock(mutex);
+    return logicalBytes;
+}
+
+std::uint64_t ChunkStore::GetPackBytes() const {
+    std::lock_guard lock(mutex);
+    return packSize;
+}
+
+size_t ChunkStore::GetFileCount() const {
+    std::lock_guard lock(mutex);
+    return recipes.size();
+}
+
+std::string GetChunkStoreDir(const std::string& saveDir) {
+    return (std::filesystem::path(saveDir) / "SaveManagerStore").string();
+}
+
+class ChunkStoreRemover : public SaveRemover {
+private:
+    ChunkStore& store;
+    std::unique_ptr<SaveRemover> remover;
+
+public:
+    ChunkStoreRemover(ChunkStore& store, std::unique_ptr<SaveRemover> remover)
+        : store(store), remover(std::move(remover)) {}
+
+    void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+        results.assign(paths.size(), RemoveResult::Missing);
+
+        // Only files that made it into the store are passed on for removal
+        std::vector<std::string> storedPaths;
+        std::vector<size_t> storedIndices;
+        Metrics& metrics = GetMetrics();
+        std::error_code error;
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (!std::filesystem::exists(paths[i], error)) continue;
+
+            ChunkStoreStats stats;
+            if (!store.Ingest(paths[i], &stats)) {
+                results[i] = RemoveResult::Retry;
+                continue;
+            }
+            metrics.Add(MetricCounter::FilesStored);
+            metrics.Add(MetricCounter::StoreBytesIn, stats.rawBytes);
+            metrics.Add(MetricCounter::StoreBytesOut, stats.storedBytes);
+            storedPaths.push_back(paths[i]);
+            storedIndices.push_back(i);
+        }
+        if (storedPaths.empty()) return;
+
+        std::vector<RemoveResult> removed;
+        remover->Remove(storedPaths, removed);
+        for (size_t i = 0; i < storedIndices.size(); i++) {
+            results[storedIndices[i]] = removed[i];
+        }
+    }
+};
+
+std::unique_ptr<SaveRemover> CreateChunkStoreRemover(ChunkStore& store, std::unique_ptr<SaveRemover> remover) {
+    return std::make_unique<ChunkStoreRemover>(store, std::move(remover));
+}
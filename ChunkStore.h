@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "SaveNameArena.h"
+#include "SaveRemover.h"
+
+// Content defined chunking: a cut is made where a rolling gear hash of the last bytes matches a mask,
+// so an insert or delete early in a save only changes the chunks around it
+// The mask is harder to match before the average size and easier after it, keeping chunk sizes close to the average
+inline constexpr size_t minChunkSize = 2 * 1024;
+inline constexpr size_t averageChunkSize = 8 * 1024;
+inline constexpr size_t maxChunkSize = 64 * 1024;
+
+// Length of the chunk at the start of data, size if the rest is a single chunk
+size_t FindChunkEnd(const unsigned char* data, size_t size);
+
+struct ChunkHash {
+    std::uint64_t low;
+    std::uint64_t high;
+
+    bool operator==(const ChunkHash&) const = default;
+};
+
+struct ChunkHashHasher {
+    size_t operator()(const ChunkHash& hash) const {
+        return static_cast<size_t>(hash.low);
+    }
+};
+
+// 128-bit hash of a chunk, the file CRC is checked again on rehydration so a collision cannot go unnoticed
+ChunkHash HashChunk(const unsigned char* data, size_t size);
+
+// Bytes going in and out of one or more ingests
+struct ChunkStoreStats {
+    std::uint64_t rawBytes = 0;     // Of the files taken in
+    std::uint64_t chunks = 0;
+    std::uint64_t newChunks = 0;    // Not already held by the store
+    std::uint64_t storedBytes = 0;  // Written to the pack, after compression
+};
+
+// Deduplicating store for saves that are kept but old, chunks shared by any two files are stored once
+// Chunks are appended to one pack file and compressed, files are kept as recipes of chunk hashes in an append-only manifest
+// Both files can lose a partly written tail in a crash, it is cut off the next time the store is opened
+class ChunkStore {
+private:
+    struct ChunkLocation {
+        std::uint64_t offset;   // Of the chunk data in the pack
+        std::uint32_t rawSize;
+        std::uint32_t storedSize;
+        std::uint32_t refs;     // Recipes using the chunk, unused chunks are dropped when the pack is compacted
+    };
+
+    struct Recipe {
+        std::uint64_t rawSize;
+        std::int64_t writeTime;
+        std::uint32_t crc;
+        std::vector<ChunkHash> chunks;
+    };
+
+    std::string storeDir;
+    std::string packPath;
+    std::string manifestPath;
+
+    // Guards everything below, held only for lookups and updates, never while reading or compressing a file
+    mutable std::mutex mutex;
+    std::unordered_map<ChunkHash, ChunkLocation, ChunkHashHasher> chunks;
+    std::unordered_map<std::string, Recipe> recipes;     // By file name, e.g. "Save12_....ess"
+    std::unordered_map<std::string, std::uint64_t, SaveNameHash, std::equal_to<>> saveBytes; // Raw bytes of each save's stored files, by save name
+    std::unordered_set<std::string, SaveNameHash, std::equal_to<>> pinned;
+    std::uint64_t packSize = 0;
+    std::uint64_t logicalBytes = 0; // Raw bytes of every file held
+    std::uint64_t liveBytes = 0;  // Stored bytes of chunks in use
+    std::uint64_t deadBytes = 0;
+
+    // Only one file is ingested at a time, chunks are appended to the pack in that order
+    std::mutex ingestMutex;
+
+    bool LoadPack();
+    bool LoadManifest();
+    static void WriteManifestRecord(std::ostream& file, std::uint8_t type, const std::string& name, const Recipe* recipe);
+    bool AppendManifestRecord(std::uint8_t type, const std::string& name, const Recipe* recipe, bool flush);
+    void AddRecipe(const std::string& fileName, Recipe recipe);
+    void DropRecipe(const std::string& fileName);
+    bool ReadChunks(const Recipe& recipe, std::uint64_t limit, const std::function<bool(const unsigned char*, size_t)>& sink) const;
+
+public:
+    // Opens the store in the given folder, creating it if needed, and compacts it when most of the pack is unused
+    bool Open(const std::string& storeDir);
+
+    // Takes in a copy of the file, which the caller may remove once this returns true
+    // A file already held under the same name and size is not taken in again
+    bool Ingest(const std::string& filePath, ChunkStoreStats* stats = nullptr);
+
+    // Writes a held file back out, checking it against the CRC of the original
+    bool Rehydrate(const std::string& fileName, const std::string& outputPath) const;
+
+    // The first bytes of a held file, used to read save headers without rehydrating the whole save
+    std::vector<std::byte> ReadPrefix(const std::string& fileName, size_t maxBytes) const;
+
+    // Drops the .ess and .skse of a save
+    void RemoveSave(const std::string& saveName);
+
+    bool HoldsFile(const std::string& fileName) const;
+    bool HoldsSave(std::string_view saveName) const;
+
+    // Pinned saves were brought back out on purpose and are not taken in again
+    void Pin(const std::string& saveName);
+    bool IsPinned(std::string_view saveName) const;
+
+    // Calls function(saveName, rawBytes) for every save with at least one file held
+    void ForEachSave(const std::function<void(const std::string&, std::uint64_t)>& function) const;
+
+    // Calls function(fileName, rawSize) for every file held
+    void ForEachFile(const std::function<void(const std::string&, std::uint64_t)>& function) const;
+
+    // Rewrites the pack and manifest with only what is still in use
+    bool Compact();
+
+    std::uint64_t GetLogicalBytes() const;
+    std::uint64_t GetPackBytes() const;
+    size_t GetFileCount() const;
+};
+
+// The store is kept in a folder inside the save folder, the game does not look in it
+std::string GetChunkStoreDir(const std::string& saveDir);
+
+// Stores each file in the chunk store, then removes it with the given remover
+// Files that cannot be stored are kept and reported for a retry
+std::unique_ptr<SaveRemover> CreateChunkStoreRemover(ChunkStore& store, std::unique_ptr<SaveRemover> remover);
@@ -0,0 +1,495 @@
+#include "ColdStorage.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+#include "Crc32c.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "SaveArchive.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char manifestMagic[4] = { 'S', 'S', 'M', 'F' };
+    constexpr std::uint32_t manifestVersion = 2;
+
+    struct ColdManifestHeader {
+        char magic[4];
+        std::uint32_t version;
+    };
+    static_assert(sizeof(ColdManifestHeader) == 8);
+
+    enum ColdManifestRecordType : std::uint8_t {
+        ColdManifestAdd = 1,
+        ColdManifestRemove = 2,
+    };
+
+    // Followed by the file name
+    struct ColdManifestRecord {
+        std::uint64_t size;
+        std::uint32_t crc;          // Of the file, 0 for ColdManifestRemove
+        std::uint32_t recordCrc;    // CRC32C of the record and its name, a torn record at the end is cut off
+        std::uint16_t nameLength;
+        std::uint8_t type;
+        std::uint8_t reserved[5];
+    };
+    static_assert(sizeof(ColdManifestRecord) == 24);
+
+    // Rewritten once dead records outnumber live ones by this much
+    constexpr size_t manifestSlack = 64;
+
+    std::uint32_t RecordCrc(ColdManifestRecord record, const std::string& fileName) {
+        record.recordCrc = 0;
+        return Crc32c(fileName.data(), fileName.size(), Crc32c(&record, sizeof(record)));
+    }
+
+    void WriteManifestRecord(std::ostream& file, std::uint8_t type, const std::string& fileName, std::uint64_t size, std::uint32_t crc) {
+        ColdManifestRecord record = {};
+        record.size = size;
+        record.crc = crc;
+        record.nameLength = static_cast<std::uint16_t>(fileName.size());
+        record.type = type;
+        record.recordCrc = RecordCrc(record, fileName);
+        file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        file.write(fileName.data(), fileName.size());
+    }
+
+    std::string ColdFolderPointerPath(const std::string& saveDir) {
+        return (std::filesystem::path(saveDir) / "SaveManagerCold.txt").string();
+    }
+
+    std::string SaveNameOf(const std::string& fileName) {
+        return std::filesystem::path(fileName).stem().string();
+    }
+
+    bool ChecksumFile(const std::string& path, std::uint64_t& size, std::uint32_t& crc) {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error) return false;
+        crc = 0;
+        if (size == 0) return true;
+
+        MappedFile file;
+        if (!file.Open(path)) return false;
+        std::span<const std::byte> bytes = file.GetBytes();
+        crc = Crc32c(bytes.data(), bytes.size());
+        return true;
+    }
+}
+
+#ifdef _WIN32
+
+bool CopyFileFast(const std::string& fromPath, const std::string& toPath) {
+    std::wstring fromW = std::filesystem::path(fromPath).wstring();
+    std::wstring toW = std::filesystem::path(toPath).wstring();
+
+    // Unbuffered copies go around the system cache, which a one-off copy of a large save would only evict other files from
+    if (!CopyFileExW(fromW.c_str(), toW.c_str(), nullptr, nullptr, nullptr, COPY_FILE_NO_BUFFERING)) return false;
+
+    HANDLE file = CreateFileW(toW.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    bool flushed = FlushFileBuffers(file);
+    CloseHandle(file);
+    return flushed;
+}
+
+#else
+
+bool CopyFileFast(const std::string& fromPath, const std::string& toPath) {
+    int from = open(fromPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (from < 0) return false;
+    struct stat status = {};
+    if (fstat(from, &status) != 0) {
+        close(from);
+        return false;
+    }
+    int to = open(toPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (to < 0) {
+        close(from);
+        return false;
+    }
+
+    bool ok = true;
+    off_t remaining = status.st_size;
+#ifdef __linux__
+    // Falls back to reading and writing on kernels or file systems that cannot copy between these two files
+    bool kernelCopy = true;
+#else
+    bool kernelCopy = false;
+#endif
+    std::vector<char> buffer;
+    while (remaining > 0) {
+        ssize_t copied;
+#ifdef __linux__
+        if (kernelCopy) {
+            copied = copy_file_range(from, nullptr, to, nullptr, static_cast<size_t>(remaining), 0);
+            if (copied < 0 && remaining == status.st_size && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                kernelCopy = false;
+                continue;
+            }
+        }
+#endif
+        if (!kernelCopy) {
+            if (buffer.empty()) buffer.resize(1024 * 1024);
+            copied = read(from, buffer.data(), buffer.size());
+            for (ssize_t written = 0; copied > 0 && written < copied;) {
+                ssize_t result = write(to, buffer.data() + written, static_cast<size_t>(copied - written));
+                if (result < 0 && errno == EINTR) continue;
+                if (result <= 0) {
+                    copied = -1;
+                    break;
+                }
+                written += result;
+            }
+        }
+        if (copied < 0 && errno == EINTR) continue;
+        if (copied <= 0) {
+            ok = false;
+            break;
+        }
+        remaining -= copied;
+    }
+
+    // The copy keeps the save's write time, which stands in for an unreadable save time
+    timespec times[2] = { status.st_atim, status.st_mtim };
+    ok = ok && futimens(to, times) == 0 && fsync(to) == 0;
+    close(from);
+    return close(to) == 0 && ok;
+}
+
+#endif
+
+bool ColdStorage::Open(const std::string& dir) {
+    std::lock_guard lock(mutex);
+    coldDir = dir;
+    manifestPath = (std::filesystem::path(dir) / "SaveManager.cold").string();
+    files.clear();
+    saveBytes.clear();
+    manifestRecords = 0;
+
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    if (!std::filesystem::is_directory(dir, error)) return false;
+    if (!std::filesystem::exists(manifestPath, error)) return RewriteManifest();
+
+    size_t missing = 0;
+    if (!LoadManifest(missing)) {
+        spdlog::warn("{} is not a cold storage manifest this version can read", manifestPath);
+        return false;
+    }
+    if (missing) spdlog::warn("{} files listed in {} are no longer there", missing, manifestPath);
+    if (missing || manifestRecords > files.size() * 2 + manifestSlack) RewriteManifest();
+    spdlog::info("Cold storage in {} holds {} files", dir, files.size());
+    return true;
+}
+
+bool ColdStorage::LoadManifest(size_t& missing) {
+    std::ifstream file(manifestPath, std::ios::binary);
+    ColdManifestHeader header = {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, manifestMagic, sizeof(manifestMagic)) != 0 || header.version != manifestVersion) return false;
+
+    std::error_code error;
+    std::uint64_t fileSize = std::filesystem::file_size(manifestPath, error);
+    if (error) return false;
+    std::uint64_t offset = sizeof(header);
+
+    ColdManifestRecord record = {};
+    std::string fileName;
+    while (file.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+        if (sizeof(record) + record.nameLength > fileSize - offset) break;
+        fileName.resize(record.nameLength);
+        if (!file.read(fileName.data(), fileName.size())) break;
+        if (RecordCrc(record, fileName) != record.recordCrc) break;
+        offset += sizeof(record) + record.nameLength;
+        manifestRecords++;
+
+        if (record.type == ColdManifestAdd) {
+            AddFile(fileName, { record.size, record.crc });
+        }
+        else if (record.type == ColdManifestRemove) {
+            auto found = files.find(fileName);
+            if (found == files.end()) continue;
+            std::string saveName = SaveNameOf(fileName);
+            if ((saveBytes[saveName] -= found->second.size) == 0) saveBytes.erase(saveName);
+            files.erase(found);
+        }
+    }
+    file.close();
+
+    if (offset != fileSize) {
+        spdlog::warn("Cutting a partly written record off {}", manifestPath);
+        std::filesystem::resize_file(manifestPath, offset, error);
+        if (error) return false;
+    }
+    manifestSize = offset;
+
+    // Files that were removed from the cold folder by hand are dropped
+    for (auto it = files.begin(); it != files.end();) {
+        if (std::filesystem::exists(std::filesystem::path(coldDir) / it->first, error)) {
+            ++it;
+            continue;
+        }
+        std::string saveName = SaveNameOf(it->first);
+        if ((saveBytes[saveName] -= it->second.size) == 0) saveBytes.erase(saveName);
+        it = files.erase(it);
+        missing++;
+    }
+    return true;
+}
+
+bool ColdStorage::AppendManifestRecord(std::uint8_t type, const std::string& fileName, ColdFile file, bool flush) {
+    if (fileName.size() > UINT16_MAX) return false;
+    bool ok;
+    {
+        std::ofstream stream(manifestPath, std::ios::binary | std::ios::app);
+        WriteManifestRecord(stream, type, fileName, file.size, file.crc);
+        ok = stream.good();
+    }
+    ok = ok && (!flush || FlushToDisk(manifestPath));
+
+    // A record that did not make it whole is cut off again, so the next one is not appended behind it
+    std::error_code error;
+    if (!ok) {
+        std::filesystem::resize_file(manifestPath, manifestSize, error);
+        return false;
+    }
+    manifestSize += sizeof(ColdManifestRecord) + fileName.size();
+    manifestRecords++;
+    return true;
+}
+
+bool ColdStorage::RewriteManifest() {
+    std::string tempPath = manifestPath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        ColdManifestHeader header = {};
+        std::memcpy(header.magic, manifestMagic, sizeof(manifestMagic));
+        header.version = manifestVersion;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& filePair : files) {
+            if (filePair.first.size() > UINT16_MAX) continue;
+            WriteManifestRecord(file, ColdManifestAdd, filePair.first, filePair.second.size, filePair.second.crc);
+        }
+        if (!file) return false;
+    }
+    // Flushed before the rename, or a crash could leave the manifest pointing at data that never reached the disk
+    if (!FlushToDisk(tempPath)) return false;
+
+    std::error_code error;
+    std::uint64_t size = std::filesystem::file_size(tempPath, error);
+    std::filesystem::rename(tempPath, manifestPath, error);
+    if (error) return false;
+    manifestSize = size;
+    manifestRecords = files.size();
+    return true;
+}
+
+void ColdStorage::AddFile(const std::string& fileName, ColdFile file) {
+    auto found = files.find(fileName);
+    if (found != files.end()) saveBytes[SaveNameOf(fileName)] -= found->second.size;
+    saveBytes[SaveNameOf(fileName)] += file.size;
+    files[fileName] = file;
+}
+
+MigrateResult ColdStorage::Migrate(const std::string& filePath, std::uint64_t* movedBytes) {
+    std::string fileName = std::filesystem::path(filePath).filename().string();
+    std::string coldPath = GetFilePath(fileName);
+    std::error_code error;
+    std::uint64_t size = std::filesystem::file_size(filePath, error);
+    if (error) return MigrateResult::Failed;
+
+    // Left behind by a session that ended between the copy and the removal of the source
+    {
+        std::lock_guard lock(mutex);
+        auto found = files.find(fileName);
+        if (found != files.end() && found->second.size == size && std::filesystem::exists(coldPath, error)) return MigrateResult::Copied;
+    }
+
+    // A rename is all it takes when the cold folder is on the same volume
+    MigrateResult result = MigrateResult::Renamed;
+    std::uint64_t movedSize = 0;
+    std::uint32_t crc = 0;
+    std::filesystem::rename(filePath, coldPath, error);
+    if (!error) {
+        if (!ChecksumFile(coldPath, movedSize, crc)) {
+            std::filesystem::rename(coldPath, filePath, error);
+            return MigrateResult::Failed;
+        }
+    }
+    else {
+        // Copied under another name first, so a half written copy is never mistaken for the save
+        result = MigrateResult::Copied;
+        std::string partPath = coldPath + ".part";
+        std::uint64_t sourceSize = 0;
+        std::uint32_t sourceCrc = 0;
+        bool copied = CopyFileFast(filePath, partPath) && ChecksumFile(partPath, movedSize, crc) &&
+            ChecksumFile(filePath, sourceSize, sourceCrc) && movedSize == sourceSize && crc == sourceCrc;
+        if (copied) std::filesystem::rename(partPath, coldPath, error);
+        if (!copied || error) {
+            spdlog::warn("Could not copy {} to {}, it is left in the save folder", filePath, coldDir);
+            std::filesystem::remove(partPath, error);
+            return MigrateResult::Failed;
+        }
+    }
+
+    // The source is only let go of once the manifest knows where the save went
+    std::lock_guard lock(mutex);
+    if (!AppendManifestRecord(ColdManifestAdd, fileName, { movedSize, crc }, true)) {
+        spdlog::warn("Could not write {}, {} is left in the save folder", manifestPath, filePath);
+        if (result == MigrateResult::Renamed) std::filesystem::rename(coldPath, filePath, error);
+        else std::filesystem::remove(coldPath, error);
+        return MigrateResult::Failed;
+    }
+    AddFile(fileName, { movedSize, crc });
+    if (movedBytes) *movedBytes = movedSize;
+    return result;
+}
+
+bool ColdStorage::Restore(const std::string& fileName, const std::string& outputPath) const {
+    ColdFile file;
+    {
+        std::lock_guard lock(mutex);
+        auto found = files.find(fileName);
+        if (found == files.end()) return false;
+        file = found->second;
+    }
+
+    std::uint64_t size = 0;
+    std::uint32_t crc = 0;
+    std::error_code error;
+    std::string tempPath = outputPath + ".tmp";
+    if (!CopyFileFast(GetFilePath(fileName), tempPath) || !ChecksumFile(tempPath, size, crc) || size != file.size || crc != file.crc) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    std::filesystem::rename(tempPath, outputPath, error);
+    if (error) std::filesystem::remove(tempPath, error);
+    return !error;
+}
+
+std::vector<std::string> ColdStorage::RemoveSave(const std::string& saveName) {
+    std::lock_guard lock(mutex);
+    // Not flushed, a removal lost in a crash only leaves a listed file that Open finds missing
+    std::vector<std::string> paths;
+    for (const char* extension : { ".ess", ".skse" }) {
+        std::string fileName = saveName + extension;
+        if (!files.erase(fileName)) continue;
+        AppendManifestRecord(ColdManifestRemove, fileName, { 0, 0 }, false);
+        paths.push_back((std::filesystem::path(coldDir) / fileName).string());
+    }
+    saveBytes.erase(saveName);
+    return paths;
+}
+
+bool ColdStorage::HoldsFile(const std::string& fileName) const {
+    std::lock_guard lock(mutex);
+    return files.contains(fileName);
+}
+
+bool ColdStorage::HoldsSave(std::string_view saveName) const {
+    std::lock_guard lock(mutex);
+    return saveBytes.contains(saveName);
+}
+
+std::string ColdStorage::GetFilePath(const std::string& fileName) const {
+    return (std::filesystem::path(coldDir) / fileName).string();
+}
+
+void ColdStorage::ForEachSave(const std::function<void(const std::string&, std::uint64_t)>& function) const {
+    std::lock_guard lock(mutex);
+    for (const auto& savePair : saveBytes) {
+        function(savePair.first, savePair.second);
+    }
+}
+
+void ColdStorage::ForEachFile(const std::function<void(const std::string&, std::uint64_t)>& function) const {
+    std::lock_guard lock(mutex);
+    for (const auto& filePair : files) {
+        function(filePair.first, filePair.second.size);
+    }
+}
+
+size_t ColdStorage::GetFileCount() const {
+    std::lock_guard lock(mutex);
+    return files.size();
+}
+
+std::string ReadColdFolderPointer(const std::string& saveDir) {
+    std::ifstream file(ColdFolderPointerPath(saveDir));
+    std::string coldDir;
+    std::getline(file, coldDir);
+    while (!coldDir.empty() && (coldDir.back() == '\r' || coldDir.back() == ' ')) coldDir.pop_back();
+    return coldDir;
+}
+
+bool WriteColdFolderPointer(const std::string& saveDir, const std::string& coldDir) {
+    std::string path = ColdFolderPointerPath(saveDir);
+    std::error_code error;
+    if (coldDir.empty()) return std::filesystem::remove(path, error) || !error;
+
+    std::ofstream file(path, std::ios::trunc);
+    file << coldDir << '\n';
+    return file.good();
+}
+
+class ColdStorageRemover : public SaveRemover {
+private:
+    ColdStorage& storage;
+    std::unique_ptr<SaveRemover> remover;
+
+public:
+    ColdStorageRemover(ColdStorage& storage, std::unique_ptr<SaveRemover> remover)
+        : storage(storage), remover(std::move(remover)) {}
+
+    void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+        results.assign(paths.size(), RemoveResult::Missing);
+
+        // Renamed files are already gone, only the sources of copies are passed on for removal
+        std::vector<std::string> copiedPaths;
+        std::vector<size_t> copiedIndices;
+        Metrics& metrics = GetMetrics();
+        std::error_code error;
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (!std::filesystem::exists(paths[i], error)) continue;
+
+            std::uint64_t movedBytes = 0;
+            MigrateResult result = storage.Migrate(paths[i], &movedBytes);
+            if (result == MigrateResult::Failed) {
+                results[i] = RemoveResult::Retry;
+                continue;
+            }
+            metrics.Add(MetricCounter::FilesMigrated);
+            metrics.Add(MetricCounter::MigrateBytes, movedBytes);
+            if (result == MigrateResult::Renamed) {
+                results[i] = RemoveResult::Removed;
+                continue;
+            }
+            copiedPaths.push_back(paths[i]);
+            copiedIndices.push_back(i);
+        }
+        if (copiedPaths.empty()) return;
+
+        std::vector<RemoveResult> removed;
+        remover->Remove(copiedPaths, removed);
+        for (size_t i = 0; i < copiedIndices.size(); i++) {
+            results[copiedIndices[i]] = removed[i];
+        }
+    }
+};
+
+std::unique_ptr<SaveRemover> CreateColdStorageRemover(ColdStorage& storage, std::unique_ptr<SaveRemover> remover) {
+    return std::make_unique<ColdStorageRemover>(storage, std::move(remover));
+}
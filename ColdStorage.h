@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "SaveNameArena.h"
+#include "SaveRemover.h"
+
+// Copies a file the cheapest way the platform offers: copy_file_range on Linux, which stays in the kernel
+// and lets the file system share or offload the copy, and an unbuffered copy through CopyFileEx on Windows
+// The destination is flushed to disk before this returns true
+bool CopyFileFast(const std::string& fromPath, const std::string& toPath);
+
+enum class MigrateResult {
+    Renamed,    // Moved within the same volume, the source is already gone
+    Copied,     // Copied and checked against the source, which is left for the caller to remove
+    Failed,
+};
+
+// Kept saves that were moved out of the save folder into a folder on another, slower disk
+// Moved files are listed in an append-only manifest in that folder, the save folder scan never looks at the folder itself
+class ColdStorage {
+private:
+    struct ColdFile {
+        std::uint64_t size;
+        std::uint32_t crc;  // CRC32C, checked again when a file is brought back
+    };
+
+    std::string coldDir;
+    std::string manifestPath;
+
+    // Guards everything below, never held while a file is copied or checked
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, ColdFile> files;    // By file name, e.g. "Save12_....ess"
+    std::unordered_map<std::string, std::uint64_t, SaveNameHash, std::equal_to<>> saveBytes; // Bytes of each save's files, by save name
+    std::uint64_t manifestSize = 0;
+    size_t manifestRecords = 0;
+
+    // Each move and removal appends one record, the manifest is only rewritten when Open finds it mostly dead
+    // Called with the lock held
+    bool LoadManifest(size_t& missing);
+    bool AppendManifestRecord(std::uint8_t type, const std::string& fileName, ColdFile file, bool flush);
+    bool RewriteManifest();
+    void AddFile(const std::string& fileName, ColdFile file);
+
+public:
+    // Opens the cold folder, creating it if needed, and reads its manifest
+    bool Open(const std::string& coldDir);
+
+    // Moves the file into the cold folder, a file already held under the same name and size is not copied again
+    // movedBytes is set to the size of the file once it is held
+    MigrateResult Migrate(const std::string& filePath, std::uint64_t* movedBytes = nullptr);
+
+    // Copies a held file back out, checking it against the CRC taken when it was moved
+    // The copy is made under a temporary name, outputPath only ever names a whole file
+    bool Restore(const std::string& fileName, const std::string& outputPath) const;
+
+    // Drops the .ess and .skse of a save from the manifest, returns the paths of its files for the caller to remove
+    std::vector<std::string> RemoveSave(const std::string& saveName);
+
+    bool HoldsFile(const std::string& fileName) const;
+    bool HoldsSave(std::string_view saveName) const;
+
+    std::string GetFilePath(const std::string& fileName) const;
+
+    // Calls function(saveName, bytes) for every save with at least one file held
+    void ForEachSave(const std::function<void(const std::string&, std::uint64_t)>& function) const;
+
+    // Calls function(fileName, size) for every file held
+    void ForEachFile(const std::function<void(const std::string&, std::uint64_t)>& function) const;
+
+    size_t GetFileCount() const;
+};
+
+// The save folder remembers which cold folder holds its saves, so they can be brought back once sColdSaveFolder changes
+// Empty if no cold folder was ever used, writing an empty folder forgets it
+std::string ReadColdFolderPointer(const std::string& saveDir);
+bool WriteColdFolderPointer(const std::string& saveDir, const std::string& coldDir);
+
+// Moves each file into cold storage, then removes whatever a copy left behind with the given remover
+// Files that cannot be moved are kept and reported for a retry
+std::unique_ptr<SaveRemover> CreateColdStorageRemover(ColdStorage& storage, std::unique_ptr<SaveRemover> remover);
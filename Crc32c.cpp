@@ -0,0 +1,70 @@
+#include "Crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SSM_CRC32C_SSE42
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+    constexpr std::uint32_t castagnoli = 0x82F63B78; // Reflected polynomial
+
+    constexpr std::array<std::uint32_t, 256> MakeTable() {
+        std::array<std::uint32_t, 256> table = {};
+        for (std::uint32_t i = 0; i < 256; i++) {
+            std::uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (crc & 1 ? castagnoli : 0);
+            table[i] = crc;
+        }
+        return table;
+    }
+
+    constexpr std::array<std::uint32_t, 256> crcTable = MakeTable();
+
+    std::uint32_t Crc32cTable(const unsigned char* data, size_t size, std::uint32_t crc) {
+        for (size_t i = 0; i < size; i++) crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return crc;
+    }
+
+#ifdef SSM_CRC32C_SSE42
+#ifndef _MSC_VER
+    __attribute__((target("sse4.2")))
+#endif
+    std::uint32_t Crc32cSse42(const unsigned char* data, size_t size, std::uint32_t crc) {
+        std::uint64_t crc64 = crc;
+        for (; size >= 8; data += 8, size -= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, data, sizeof(word));
+            crc64 = _mm_crc32_u64(crc64, word);
+        }
+        crc = static_cast<std::uint32_t>(crc64);
+        for (; size; data++, size--) crc = _mm_crc32_u8(crc, *data);
+        return crc;
+    }
+
+    bool HasSse42() {
+#ifdef _MSC_VER
+        int info[4] = {};
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    }
+#endif
+}
+
+std::uint32_t Crc32c(const void* data, size_t size, std::uint32_t crc) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+#ifdef SSM_CRC32C_SSE42
+    static const bool sse42 = HasSse42();
+    if (sse42) return ~Crc32cSse42(bytes, size, crc);
+#endif
+    return ~Crc32cTable(bytes, size, crc);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C (Castagnoli) of the data, continued from crc so a file can be checksummed in pieces
+// Uses the SSE 4.2 crc32 instruction when the CPU has it, a table otherwise
+std::uint32_t Crc32c(const void* data, size_t size, std::uint32_t crc = 0);
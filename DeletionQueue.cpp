@@ -0,0 +1,283 @@
+#include "DeletionQueue.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
+
+#include "Metrics.h"
+#include "WorkerPool.h"
+
+DeletionQueue::DeletionQueue(std::unique_ptr<SaveRemover> remover, size_t workerCount, size_t maxBatchSize)
+    : remover(std::move(remover)), maxBatchSize(std::max<size_t>(maxBatchSize, 1))
+{
+    workerCount = std::max<size_t>(workerCount, 1);
+    for (size_t i = 0; i < workerCount; i++) {
+        workers.emplace_back(&DeletionQueue::RunWorker, this);
+    }
+}
+
+DeletionQueue::~DeletionQueue() {
+    StopBy(Clock::time_point::max());
+}
+
+size_t DeletionQueue::StopBy(Clock::time_point deadline) {
+    {
+        std::lock_guard lock(mutex);
+        if (!stopping) stopDeadline = deadline;
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+
+    std::lock_guard lock(mutex);
+    return droppedCount;
+}
+
+void DeletionQueue::SetBudget(double filesPerSecond, double bytesPerSecond) {
+    std::lock_guard lock(mutex);
+    budget = IoBudget(filesPerSecond, bytesPerSecond);
+    if (budget.IsLimited()) {
+        spdlog::info("Deletion budget: {} files/s, {:.1f} MB/s (0 is unlimited)", filesPerSecond, bytesPerSecond / (1024 * 1024));
+    }
+}
+
+void DeletionQueue::SetDeferCheck(std::function<bool()> shouldDefer) {
+    std::lock_guard lock(mutex);
+    this->shouldDefer = std::move(shouldDefer);
+}
+
+void DeletionQueue::SetMinFileAge(Clock::duration minFileAge) {
+    std::lock_guard lock(mutex);
+    this->minFileAge = minFileAge;
+}
+
+void DeletionQueue::Enqueue(std::vector<std::string> paths) {
+    {
+        std::lock_guard lock(mutex);
+        for (std::string& path : paths) {
+            ready.push_back({ std::move(path), 0, 0, Clock::time_point() });
+        }
+    }
+    wakeup.notify_one();
+}
+
+void DeletionQueue::WaitIdle() {
+    std::unique_lock lock(mutex);
+    idle.wait(lock, [this] { return ready.empty() && retrying.empty() && inFlight == 0; });
+}
+
+size_t DeletionQueue::GetRemovedCount() {
+    std::lock_guard lock(mutex);
+    return removedCount;
+}
+
+size_t DeletionQueue::GetFailedCount() {
+    std::lock_guard lock(mutex);
+    return failedCount;
+}
+
+std::vector<DeletionQueue::PendingFile> DeletionQueue::TakeBatch(std::unique_lock<std::mutex>& lock, std::int64_t& reservedBytes) {
+    reservedBytes = 0;
+    while (true) {
+        // Move retries whose wait is over back into the ready queue
+        Clock::time_point now = Clock::now();
+        if (stopping && now >= stopDeadline) {
+            size_t left = ready.size() + retrying.size();
+            if (left) spdlog::info("Stopped with {} files still queued", left);
+            droppedCount += left;
+            ready.clear();
+            retrying.clear();
+            if (inFlight == 0) idle.notify_all();
+            return {};
+        }
+
+        Clock::time_point nextRetry = Clock::time_point::max();
+        for (auto it = retrying.begin(); it != retrying.end(); ) {
+            if (it->notBefore <= now || stopping) {
+                ready.push_back(std::move(*it));
+                it = retrying.erase(it);
+            }
+            else {
+                nextRetry = std::min(nextRetry, it->notBefore);
+                ++it;
+            }
+        }
+
+        if (!ready.empty()) {
+            if (!busy) {
+                busy = true;
+                busyStart = now;
+            }
+
+            // Whatever is left when shutting down is removed right away, the game no longer needs the disk
+            if (!stopping && shouldDefer && shouldDefer()) {
+                if (!deferring) {
+                    spdlog::info("Deferring deletions while the game is saving or loading, {} files waiting", ready.size());
+                    deferring = true;
+                    deferStart = now;
+                }
+                wakeup.wait_for(lock, deferCheckInterval);
+                continue;
+            }
+            if (deferring) {
+                spdlog::info("Resuming deletions, {} files waiting", ready.size());
+                deferring = false;
+                deferredTime += now - deferStart;
+            }
+
+            size_t batchSize = std::min(ready.size(), maxBatchSize);
+            if (!stopping && budget.IsLimited()) {
+                Clock::time_point readyAt = budget.ReadyAt(now);
+                if (readyAt > now) {
+                    if (!throttled) spdlog::info("Deletion budget reached, spreading out {} waiting files", ready.size());
+                    throttled = true;
+                    wakeup.wait_until(lock, std::min(readyAt, nextRetry));
+                    continue;
+                }
+                batchSize = std::min(batchSize, budget.AvailableOps(averageFileBytes, now));
+                reservedBytes = static_cast<std::int64_t>(batchSize * averageFileBytes);
+                budget.Spend(static_cast<std::int64_t>(batchSize), reservedBytes, now);
+            }
+
+            std::vector<PendingFile> batch(std::make_move_iterator(ready.begin()), std::make_move_iterator(ready.begin() + batchSize));
+            ready.erase(ready.begin(), ready.begin() + batchSize);
+            inFlight += batch.size();
+            return batch;
+        }
+        if (stopping && retrying.empty()) return {};
+
+        if (nextRetry == Clock::time_point::max()) {
+            wakeup.wait(lock);
+        }
+        else {
+            wakeup.wait_until(lock, nextRetry);
+        }
+    }
+}
+
+void DeletionQueue::RunWorker() {
+    LowerCurrentThreadPriority();
+
+    std::vector<std::string> paths;
+    std::vector<RemoveResult> results;
+    Metrics& metrics = GetMetrics();
+
+    std::unique_lock lock(mutex);
+    while (true) {
+        std::int64_t reservedBytes = 0;
+        std::vector<PendingFile> batch = TakeBatch(lock, reservedBytes);
+        if (batch.empty()) break;
+
+        // Age is not checked when shutting down, the game is no longer writing saves
+        Clock::duration minAge = stopping ? Clock::duration::zero() : minFileAge;
+        lock.unlock();
+        std::vector<PendingFile> tooNew;
+        size_t measuredCount = 0;
+        std::uint64_t bytes = HoldBackNewFiles(batch, tooNew, minAge, measuredCount);
+        paths.clear();
+        for (const PendingFile& file : batch) {
+            paths.push_back(file.path);
+        }
+        if (!paths.empty()) {
+            PhaseTimer timer(MetricPhase::Delete);
+            remover->Remove(paths, results);
+        }
+        lock.lock();
+
+        // Settles the reservation against what was really removed, files that are held back or tried again
+        // get their op back here and are charged again when they go
+        if (reservedBytes) {
+            std::uint64_t removedBytes = 0;
+            std::int64_t unusedOps = static_cast<std::int64_t>(tooNew.size());
+            for (size_t i = 0; i < batch.size(); i++) {
+                if (results[i] == RemoveResult::Removed) removedBytes += batch[i].size;
+                if (results[i] != RemoveResult::Removed && results[i] != RemoveResult::Missing) unusedOps++;
+            }
+            budget.Spend(-unusedOps, static_cast<std::int64_t>(removedBytes) - reservedBytes, Clock::now());
+        }
+        if (measuredCount) averageFileBytes = averageFileBytes * 0.75 + (static_cast<double>(bytes) / measuredCount) * 0.25;
+        inFlight -= tooNew.size();
+        for (PendingFile& file : tooNew) {
+            retrying.push_back(std::move(file));
+        }
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            PendingFile& file = batch[i];
+            switch (results[i]) {
+            case RemoveResult::Removed:
+                removedCount++;
+                metrics.Add(MetricCounter::FilesRemoved);
+                metrics.Add(MetricCounter::BytesFreed, file.size);
+                break;
+            case RemoveResult::Missing:
+                break;
+            case RemoveResult::Retry:
+                // Files still being written by the game are tried again later, unless shutting down
+                if (++file.attempts < maxAttempts && !stopping) {
+                    metrics.Add(MetricCounter::RemoveRetries);
+                    file.notBefore = Clock::now() + retryDelay * (1 << (file.attempts - 1));
+                    retrying.push_back(std::move(file));
+                    break;
+                }
+                [[fallthrough]];
+            case RemoveResult::Failed:
+                failedCount++;
+                metrics.Add(MetricCounter::RemoveFailures);
+                spdlog::warn("Could not remove {}", file.path);
+                break;
+            }
+        }
+        inFlight -= batch.size();
+        if (ready.empty() && retrying.empty() && inFlight == 0) {
+            LogCaughtUp();
+            idle.notify_all();
+        }
+        if (!retrying.empty()) wakeup.notify_all(); // Sleeping workers may need an earlier wake up
+    }
+}
+
+std::uint64_t DeletionQueue::HoldBackNewFiles(std::vector<PendingFile>& batch, std::vector<PendingFile>& tooNew, Clock::duration minAge, size_t& measuredCount) {
+    std::uint64_t bytes = 0;
+    auto fileNow = std::filesystem::file_time_type::clock::now();
+    for (auto it = batch.begin(); it != batch.end(); ) {
+        // Files that cannot be read are left for the remover to report
+        std::error_code error;
+        std::uint64_t size = std::filesystem::file_size(it->path, error);
+        if (error) {
+            ++it;
+            continue;
+        }
+        it->size = size;
+        bytes += size;
+        measuredCount++;
+
+        auto writeTime = std::filesystem::last_write_time(it->path, error);
+        auto age = std::chrono::duration_cast<Clock::duration>(fileNow - writeTime);
+        if (!error && age < minAge) {
+            // Not counted as an attempt, the game may simply still be writing it
+            GetMetrics().Add(MetricCounter::FilesHeldBack);
+            spdlog::info("Holding back {}, it was written {:.1f}s ago", it->path, std::chrono::duration<double>(age).count());
+            it->notBefore = Clock::now() + (minAge - age);
+            tooNew.push_back(std::move(*it));
+            it = batch.erase(it);
+            continue;
+        }
+        ++it;
+    }
+    return bytes;
+}
+
+void DeletionQueue::LogCaughtUp() {
+    if (throttled || deferredTime > Clock::duration::zero()) {
+        spdlog::info("Deletions caught up: {} files removed in {:.1f}s, {:.1f}s of it deferred",
+            removedCount - removedAtBusyStart,
+            std::chrono::duration<double>(Clock::now() - busyStart).count(), std::chrono::duration<double>(deferredTime).count());
+    }
+    busy = false;
+    throttled = false;
+    deferredTime = Clock::duration::zero();
+    removedAtBusyStart = removedCount;
+}
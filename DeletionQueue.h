@@ -0,0 +1,110 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IoBudget.h"
+#include "SaveRemover.h"
+
+// Removes files on background workers so that the thinning loop never waits on the disk
+// Queued paths are handed to the remover in batches, files that are still in use are retried later
+// Batches are paced by an IoBudget and held back while the game needs the disk for itself
+class DeletionQueue {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingFile {
+        std::string path;
+        std::uint64_t size = 0; // Measured just before removal
+        int attempts = 0;
+        Clock::time_point notBefore;
+    };
+
+    std::unique_ptr<SaveRemover> remover;
+    size_t maxBatchSize;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable idle;
+    std::deque<PendingFile> ready;
+    std::vector<PendingFile> retrying;
+    size_t inFlight = 0;
+    bool stopping = false;
+    Clock::time_point stopDeadline = Clock::time_point::max(); // Work still queued at this point is dropped
+    size_t droppedCount = 0;
+
+    size_t removedCount = 0;
+    size_t failedCount = 0;
+
+    IoBudget budget;
+    double averageFileBytes = 8.0 * 1024 * 1024; // Batches reserve bytes from this until the files are measured
+    std::function<bool()> shouldDefer;
+    Clock::duration minFileAge = Clock::duration::zero();
+
+    // Only changes of state are logged, with a summary once the queue catches up
+    bool busy = false;
+    bool deferring = false;
+    bool throttled = false;
+    Clock::time_point busyStart;
+    Clock::time_point deferStart;
+    Clock::duration deferredTime = Clock::duration::zero();
+    size_t removedAtBusyStart = 0;
+
+    std::vector<std::thread> workers;
+
+    void RunWorker();
+
+    // Sends files the game wrote too recently back to wait, returns the bytes of every file that exists
+    // Runs without the lock
+    std::uint64_t HoldBackNewFiles(std::vector<PendingFile>& batch, std::vector<PendingFile>& tooNew, Clock::duration minAge, size_t& measuredCount);
+
+    // Logs how the last busy period went, called with the lock held once nothing is left
+    void LogCaughtUp();
+
+    // Takes the next batch of files to remove, waiting until one is available and fits the budget
+    // Returns an empty batch once the queue is stopping and has drained, or its stop deadline has passed
+    std::vector<PendingFile> TakeBatch(std::unique_lock<std::mutex>& lock, std::int64_t& reservedBytes);
+
+public:
+    static constexpr int maxAttempts = 5;
+    static constexpr std::chrono::seconds retryDelay = std::chrono::seconds(2); // Doubled on each attempt
+    static constexpr std::chrono::milliseconds deferCheckInterval = std::chrono::milliseconds(500);
+
+    DeletionQueue(std::unique_ptr<SaveRemover> remover, size_t workerCount = 1, size_t maxBatchSize = 64);
+
+    // Finishes removing everything that was queued before returning
+    ~DeletionQueue();
+
+    // Stops the workers, removing what is queued until deadline and dropping the rest
+    // A batch already handed to the remover is always finished, returns how many files were dropped
+    size_t StopBy(Clock::time_point deadline);
+
+    DeletionQueue(const DeletionQueue&) = delete;
+    DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+    // Limits removals to filesPerSecond and bytesPerSecond, 0 leaves either unlimited
+    void SetBudget(double filesPerSecond, double bytesPerSecond);
+
+    // Nothing is removed while shouldDefer returns true, it is called from the worker threads
+    void SetDeferCheck(std::function<bool()> shouldDefer);
+
+    // Files written more recently than this are left until they are old enough
+    void SetMinFileAge(Clock::duration minFileAge);
+
+    void Enqueue(std::vector<std::string> paths);
+
+    // Blocks until every queued file has been removed or given up on
+    void WaitIdle();
+
+    size_t GetRemovedCount();
+    size_t GetFailedCount();
+};
@@ -0,0 +1,143 @@
+#include "DirectoryWatcher.h"
+
+#include <atomic>
+#include <filesystem>
+#include <string_view>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+// Change notifications do not carry file names, so any change in the folder triggers the callback
+class Win32DirectoryWatcher : public DirectoryWatcher {
+private:
+    HANDLE changeHandle = INVALID_HANDLE_VALUE;
+    HANDLE stopEvent = nullptr;
+    std::thread thread;
+
+public:
+    ~Win32DirectoryWatcher() override {
+        Stop();
+    }
+
+    bool Start(const std::string& directory, Callback onChange) override {
+        Stop();
+
+        std::wstring directoryW = std::filesystem::path(directory).wstring();
+        if (directoryW.empty()) return false;
+
+        changeHandle = FindFirstChangeNotificationW(directoryW.c_str(), FALSE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE);
+        if (changeHandle == INVALID_HANDLE_VALUE) return false;
+        stopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+        thread = std::thread([this, onChange = std::move(onChange)]() {
+            HANDLE handles[2] = { stopEvent, changeHandle };
+            while (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+                onChange();
+                if (!FindNextChangeNotification(changeHandle)) break;
+            }
+        });
+        return true;
+    }
+
+    void Stop() override {
+        if (thread.joinable()) {
+            SetEvent(stopEvent);
+            thread.join();
+        }
+        if (changeHandle != INVALID_HANDLE_VALUE) {
+            FindCloseChangeNotification(changeHandle);
+            changeHandle = INVALID_HANDLE_VALUE;
+        }
+        if (stopEvent) {
+            CloseHandle(stopEvent);
+            stopEvent = nullptr;
+        }
+    }
+};
+
+std::unique_ptr<DirectoryWatcher> CreateDirectoryWatcher() {
+    return std::make_unique<Win32DirectoryWatcher>();
+}
+
+#else
+
+// Only reports changes to .ess files, the .skse mirror is written right after its .ess
+class InotifyDirectoryWatcher : public DirectoryWatcher {
+private:
+    int inotifyFd = -1;
+    int stopFd = -1;
+    std::thread thread;
+
+    static bool IsSaveFile(std::string_view name) {
+        return name.size() > 4 && name.substr(name.size() - 4) == ".ess";
+    }
+
+public:
+    ~InotifyDirectoryWatcher() override {
+        Stop();
+    }
+
+    bool Start(const std::string& directory, Callback onChange) override {
+        Stop();
+
+        inotifyFd = inotify_init1(IN_CLOEXEC);
+        if (inotifyFd < 0) return false;
+        if (inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0) {
+            close(inotifyFd);
+            inotifyFd = -1;
+            return false;
+        }
+        stopFd = eventfd(0, EFD_CLOEXEC);
+
+        thread = std::thread([this, onChange = std::move(onChange)]() {
+            alignas(inotify_event) char buffer[16 * 1024];
+            pollfd fds[2] = { { stopFd, POLLIN, 0 }, { inotifyFd, POLLIN, 0 } };
+            while (poll(fds, 2, -1) > 0 && !(fds[0].revents & POLLIN)) {
+                ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+                if (length <= 0) break;
+
+                bool saveChanged = false;
+                for (char* ptr = buffer; ptr < buffer + length; ) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+                    if (event->len > 0 && IsSaveFile(event->name)) saveChanged = true;
+                    if (event->mask & IN_Q_OVERFLOW) saveChanged = true;
+                    ptr += sizeof(inotify_event) + event->len;
+                }
+                if (saveChanged) onChange();
+            }
+        });
+        return true;
+    }
+
+    void Stop() override {
+        if (thread.joinable()) {
+            uint64_t one = 1;
+            write(stopFd, &one, sizeof(one));
+            thread.join();
+        }
+        if (inotifyFd >= 0) {
+            close(inotifyFd);
+            inotifyFd = -1;
+        }
+        if (stopFd >= 0) {
+            close(stopFd);
+            stopFd = -1;
+        }
+    }
+};
+
+std::unique_ptr<DirectoryWatcher> CreateDirectoryWatcher() {
+    return std::make_unique<InotifyDirectoryWatcher>();
+}
+
+#endif
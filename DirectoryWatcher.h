@@ -0,0 +1,21 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+// Watches a single directory for created, deleted or renamed save files
+// Backends run their own thread and call onChange from it
+class DirectoryWatcher {
+public:
+    using Callback = std::function<void()>;
+
+    virtual ~DirectoryWatcher() = default;
+
+    // Returns false if the directory could not be watched
+    virtual bool Start(const std::string& directory, Callback onChange) = 0;
+    virtual void Stop() = 0;
+};
+
+// Creates the watcher for the current platform
+std::unique_ptr<DirectoryWatcher> CreateDirectoryWatcher();
@@ -0,0 +1,128 @@
+#include "EssHeader.h"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+
+namespace {
+    constexpr std::string_view essMagic = "TESV_SAVEGAME";
+
+    // Seconds between 1601-01-01 (FILETIME epoch) and 1970-01-01
+    constexpr std::int64_t fileTimeEpochOffset = 11644473600;
+
+    // Little endian reader that fails once it runs past the end of the data
+    class HeaderReader {
+    private:
+        std::span<const std::byte> data;
+        std::size_t offset = 0;
+        bool failed = false;
+
+    public:
+        HeaderReader(std::span<const std::byte> data) : data(data) {}
+
+        template <typename T>
+        T Read() {
+            T value = {};
+            if (failed || data.size() - offset < sizeof(T)) {
+                failed = true;
+                return value;
+            }
+            std::memcpy(&value, data.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return value;
+        }
+
+        // Strings are a uint16 length followed by that many bytes
+        std::string ReadString() {
+            std::uint16_t length = Read<std::uint16_t>();
+            if (failed || data.size() - offset < length) {
+                failed = true;
+                return {};
+            }
+            std::string value(reinterpret_cast<const char*>(data.data() + offset), length);
+            offset += length;
+            return value;
+        }
+
+        std::string_view ReadMagic() {
+            if (data.size() < essMagic.size()) {
+                failed = true;
+                return {};
+            }
+            offset = essMagic.size();
+            return std::string_view(reinterpret_cast<const char*>(data.data()), essMagic.size());
+        }
+
+        std::size_t GetOffset() const {
+            return offset;
+        }
+
+        bool Failed() const {
+            return failed;
+        }
+    };
+}
+
+std::int64_t EssHeader::GetSaveTime() const {
+    std::int64_t seconds = static_cast<std::int64_t>(fileTime / 10000000) - fileTimeEpochOffset;
+    return seconds > 0 ? seconds : 0;
+}
+
+std::optional<std::int64_t> EssHeader::GetGameTime() const {
+    std::int64_t parts[3] = {};
+    const char* ptr = gameDate.data();
+    const char* end = ptr + gameDate.size();
+    for (int i = 0; i < 3; i++) {
+        auto [parsedEnd, ec] = std::from_chars(ptr, end, parts[i]);
+        if (ec != std::errc() || parts[i] < 0) return std::nullopt;
+        ptr = parsedEnd;
+        if (i < 2) {
+            if (ptr == end || *ptr != '.') return std::nullopt;
+            ptr++;
+        }
+    }
+    if (ptr != end) return std::nullopt;
+    return ((parts[0] * 24 + parts[1]) * 60 + parts[2]) * 60;
+}
+
+std::optional<EssHeader> ParseEssHeader(std::span<const std::byte> data) {
+    HeaderReader reader(data);
+    if (reader.ReadMagic() != essMagic) return std::nullopt;
+
+    std::uint32_t headerSize = reader.Read<std::uint32_t>();
+    if (reader.Failed() || headerSize > essHeaderReadLimit) return std::nullopt;
+    std::size_t headerEnd = reader.GetOffset() + headerSize;
+
+    EssHeader header;
+    header.version = reader.Read<std::uint32_t>();
+    header.saveNumber = reader.Read<std::uint32_t>();
+    header.playerName = reader.ReadString();
+    header.playerLevel = reader.Read<std::uint32_t>();
+    header.playerLocation = reader.ReadString();
+    header.gameDate = reader.ReadString();
+    header.playerRace = reader.ReadString();
+    header.playerSex = reader.Read<std::uint16_t>();
+    reader.Read<float>(); // Current experience
+    reader.Read<float>(); // Experience needed to level up
+    header.fileTime = reader.Read<std::uint64_t>();
+    header.shotWidth = reader.Read<std::uint32_t>();
+    header.shotHeight = reader.Read<std::uint32_t>();
+    if (header.version >= 12) {
+        header.compressionType = reader.Read<std::uint16_t>();
+    }
+
+    // The fields must fit inside the size the header claims for itself
+    if (reader.Failed() || reader.GetOffset() > headerEnd) return std::nullopt;
+    header.headerEnd = headerEnd;
+    return header;
+}
+
+std::optional<EssHeader> ReadEssHeader(const std::string& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) return std::nullopt;
+
+    std::byte buffer[essHeaderReadLimit];
+    file.read(reinterpret_cast<char*>(buffer), sizeof(buffer));
+    return ParseEssHeader(std::span<const std::byte>(buffer, static_cast<std::size_t>(file.gcount())));
+}
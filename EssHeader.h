@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+
+// The fixed prefix of a Skyrim SE .ess file, up to and including the screenshot size
+// Layout: "TESV_SAVEGAME", uint32 header size, then the header fields in this order
+struct EssHeader {
+    std::uint32_t version = 0;
+    std::uint32_t saveNumber = 0;
+    std::string playerName;
+    std::uint32_t playerLevel = 0;
+    std::string playerLocation;
+    std::string gameDate;      // In-game time played as "days.hours.minutes"
+    std::string playerRace;
+    std::uint16_t playerSex = 0;
+    std::uint64_t fileTime = 0; // Windows FILETIME of when the save was written
+    std::uint32_t shotWidth = 0;
+    std::uint32_t shotHeight = 0;
+    std::uint16_t compressionType = 0; // 0 none, 1 zlib, 2 lz4 (version 12 and up)
+
+    // Offset of the screenshot data from the start of the file
+    std::size_t headerEnd = 0;
+
+    // Seconds since the epoch, 0 if the FILETIME is before the epoch
+    std::int64_t GetSaveTime() const;
+
+    // Seconds of in-game time played, nullopt if gameDate is not in the expected format
+    std::optional<std::int64_t> GetGameTime() const;
+};
+
+// Largest number of bytes read from the start of a save to find its header
+inline constexpr std::size_t essHeaderReadLimit = 4096;
+
+// Returns nullopt if the data is not a complete save header
+std::optional<EssHeader> ParseEssHeader(std::span<const std::byte> data);
+
+// Reads at most essHeaderReadLimit bytes from the start of the file
+std::optional<EssHeader> ReadEssHeader(const std::string& filePath);
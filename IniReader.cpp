@@ -0,0 +1,140 @@
+#include "IniReader.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <utility>
+
+namespace {
+    using SectionValues = std::unordered_map<std::string, std::string>;
+
+    // Every section of one file as it was when it was parsed
+    struct ParsedIni {
+        std::int64_t writeTime = 0;
+        std::uint64_t size = 0;
+        std::unordered_map<std::string, std::shared_ptr<const SectionValues>> sections;
+    };
+
+    std::mutex cacheMutex;
+    std::unordered_map<std::string, std::shared_ptr<const ParsedIni>> cache;
+
+    std::string Trim(const std::string& text) {
+        size_t begin = text.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) return std::string();
+        size_t end = text.find_last_not_of(" \t\r");
+        return text.substr(begin, end - begin + 1);
+    }
+
+    std::string ToLower(std::string text) {
+        for (char& c : text) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return text;
+    }
+
+    // Matches GetPrivateProfileString: names are case insensitive, the value is the rest of the line
+    // with matching quotes around it removed, and the first of two equal keys wins
+    std::shared_ptr<const ParsedIni> Parse(const std::string& path, std::int64_t writeTime, std::uint64_t size) {
+        std::unordered_map<std::string, SectionValues> sections;
+        SectionValues* section = nullptr;
+
+        std::ifstream file(path, std::ios::binary);
+        std::string line;
+        bool firstLine = true;
+        while (std::getline(file, line)) {
+            if (firstLine && line.compare(0, 3, "\xEF\xBB\xBF") == 0) line.erase(0, 3);
+            firstLine = false;
+
+            line = Trim(line);
+            if (line.empty() || line[0] == ';' || line[0] == '#') continue;
+
+            if (line.front() == '[') {
+                size_t close = line.find(']');
+                section = close != std::string::npos ? &sections[ToLower(Trim(line.substr(1, close - 1)))] : nullptr;
+                continue;
+            }
+
+            size_t equals = line.find('=');
+            if (!section || equals == std::string::npos) continue;
+            std::string value = Trim(line.substr(equals + 1));
+            if (value.size() >= 2 && (value.front() == '"' || value.front() == '\'') && value.back() == value.front()) {
+                value = value.substr(1, value.size() - 2);
+            }
+            section->try_emplace(ToLower(Trim(line.substr(0, equals))), std::move(value));
+        }
+
+        auto parsed = std::make_shared<ParsedIni>();
+        parsed->writeTime = writeTime;
+        parsed->size = size;
+        for (auto& sectionPair : sections) {
+            parsed->sections.emplace(sectionPair.first, std::make_shared<const SectionValues>(std::move(sectionPair.second)));
+        }
+        return parsed;
+    }
+
+    // Parses the file if it is not cached or has changed since, a stat is all a cached read costs
+    std::shared_ptr<const ParsedIni> GetParsedIni(const std::string& path) {
+        std::error_code error;
+        std::int64_t writeTime = IniReader::GetWriteTime(path);
+        std::uint64_t size = std::filesystem::file_size(path, error);
+        if (error) size = 0;
+
+        std::lock_guard lock(cacheMutex);
+        std::shared_ptr<const ParsedIni>& cached = cache[path];
+        if (!cached || cached->writeTime != writeTime || cached->size != size) {
+            cached = Parse(path, writeTime, size);
+        }
+        return cached;
+    }
+}
+
+IniReader::IniReader(const std::string& path, const std::string& iniSection) {
+    std::shared_ptr<const ParsedIni> parsed = GetParsedIni(path);
+    auto found = parsed->sections.find(ToLower(iniSection));
+    if (found != parsed->sections.end()) values = found->second;
+}
+
+std::int64_t IniReader::GetWriteTime(const std::string& path) {
+    std::error_code error;
+    auto writeTime = std::filesystem::last_write_time(path, error);
+    if (error) return 0;
+    return writeTime.time_since_epoch().count();
+}
+
+bool IniReader::ReadValue(const std::string& key, std::string& value) const {
+    if (!values) return false;
+    auto found = values->find(ToLower(key));
+    if (found == values->end()) return false;
+    value = found->second;
+    return true;
+}
+
+int IniReader::ReadInt(const std::string& key, int default_) const {
+    std::string value;
+    if (!ReadValue(key, value)) return default_;
+    return static_cast<int>(std::strtol(value.c_str(), nullptr, 10));
+}
+
+bool IniReader::ReadBool(const std::string& key, const std::string& default_) const {
+    std::string value;
+    if (!ReadValue(key, value)) value = default_;
+    return value == "1" || value == "true" || value == "True" || value == "TRUE";
+}
+
+float IniReader::ReadFloat(const std::string& key, float default_) const {
+    std::string value;
+    if (!ReadValue(key, value)) return default_;
+
+    try {
+        return std::stof(value);
+    }
+    catch (const std::exception&) {
+        return default_;
+    }
+}
+
+std::string IniReader::ReadStr(const std::string& key, const std::string& default_) const {
+    std::string value;
+    if (!ReadValue(key, value)) return default_;
+    return value;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// Reads values from one section of an ini file
+// The file is parsed once into a table shared by every reader of it, and parsed again only once it has changed on disk
+class IniReader {
+private:
+    // Values of the section by lower case key
+    std::shared_ptr<const std::unordered_map<std::string, std::string>> values;
+
+    // Returns false if the key is not in the section
+    bool ReadValue(const std::string& key, std::string& value) const;
+
+public:
+    IniReader(const std::string& path, const std::string& iniSection);
+
+    int ReadInt(const std::string& key, int default_) const;
+    bool ReadBool(const std::string& key, const std::string& default_) const;
+    float ReadFloat(const std::string& key, float default_) const;
+    std::string ReadStr(const std::string& key, const std::string& default_) const;
+
+    // Last write time of the file in file clock ticks, 0 if it does not exist
+    // Compared between polls to tell when the file was edited
+    static std::int64_t GetWriteTime(const std::string& path);
+};
@@ -0,0 +1,44 @@
+#include "IoBudget.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+IoBudget::IoBudget(double opsPerSecond, double bytesPerSecond)
+    : opsPerSecond(opsPerSecond), bytesPerSecond(bytesPerSecond),
+      opTokens(std::max(opsPerSecond, 1.0)), byteTokens(std::max(bytesPerSecond, 0.0)), lastRefill(Clock::now()) {}
+
+void IoBudget::Refill(Clock::time_point now) {
+    if (now <= lastRefill) return;
+
+    double seconds = std::chrono::duration<double>(now - lastRefill).count();
+    lastRefill = now;
+    // Rates below one per second still need room for a whole operation
+    if (opsPerSecond > 0) opTokens = std::min(std::max(opsPerSecond, 1.0), opTokens + seconds * opsPerSecond);
+    if (bytesPerSecond > 0) byteTokens = std::min(bytesPerSecond, byteTokens + seconds * bytesPerSecond);
+}
+
+IoBudget::Clock::time_point IoBudget::ReadyAt(Clock::time_point now) {
+    Refill(now);
+
+    // Waits for at least one whole operation and for any byte debt to be paid off
+    double waitSeconds = 0;
+    if (opsPerSecond > 0 && opTokens < 1) waitSeconds = std::max(waitSeconds, (1 - opTokens) / opsPerSecond);
+    if (bytesPerSecond > 0 && byteTokens < 0) waitSeconds = std::max(waitSeconds, -byteTokens / bytesPerSecond);
+    return now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(waitSeconds));
+}
+
+size_t IoBudget::AvailableOps(double bytesPerOp, Clock::time_point now) {
+    Refill(now);
+    double ops = std::numeric_limits<double>::max();
+    if (opsPerSecond > 0) ops = opTokens;
+    if (bytesPerSecond > 0 && bytesPerOp > 0) ops = std::min(ops, byteTokens / bytesPerOp);
+    if (ops >= static_cast<double>(std::numeric_limits<size_t>::max())) return std::numeric_limits<size_t>::max();
+    return std::max<size_t>(1, static_cast<size_t>(std::floor(std::max(ops, 0.0))));
+}
+
+void IoBudget::Spend(std::int64_t ops, std::int64_t bytes, Clock::time_point now) {
+    Refill(now);
+    if (opsPerSecond > 0) opTokens = std::min(std::max(opsPerSecond, 1.0), opTokens - static_cast<double>(ops));
+    if (bytesPerSecond > 0) byteTokens = std::min(bytesPerSecond, byteTokens - static_cast<double>(bytes));
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Token bucket over files and bytes, each refilled continuously and holding about one second of budget
+// Spending may push a bucket below zero, so a single large save is never split up or blocked for good
+// Not thread safe, the owner keeps it under its own lock
+class IoBudget {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double opsPerSecond;
+    double bytesPerSecond;
+    double opTokens;
+    double byteTokens;
+    Clock::time_point lastRefill;
+
+    void Refill(Clock::time_point now);
+
+public:
+    // A rate of 0 or less leaves that side unlimited
+    IoBudget(double opsPerSecond = 0, double bytesPerSecond = 0);
+
+    bool IsLimited() const {
+        return opsPerSecond > 0 || bytesPerSecond > 0;
+    }
+
+    // When both buckets are out of debt, now if they already are
+    Clock::time_point ReadyAt(Clock::time_point now);
+
+    // How many operations of about bytesPerOp fit in the budget right now, never less than 1 so progress is always made
+    size_t AvailableOps(double bytesPerOp, Clock::time_point now);
+
+    // Negative ops or bytes give back budget that was reserved up front, never beyond a full bucket
+    void Spend(std::int64_t ops, std::int64_t bytes, Clock::time_point now);
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+// Read-only view of a whole file, mapped into memory instead of read
+class MappedFile {
+private:
+    const std::byte* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+    ~MappedFile() {
+        Close();
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false if the file is missing, empty or cannot be mapped
+    bool Open(const std::string& path);
+    void Close();
+
+    std::span<const std::byte> GetBytes() const {
+        return { data, size };
+    }
+};
@@ -0,0 +1,128 @@
+#include "Metrics.h"
+
+#include <iterator>
+
+#include <spdlog/spdlog.h>
+
+namespace {
+    constexpr const char* counterNames[metricCounterCount] = {
+        "files_scanned", "saves_added", "saves_removed_externally", "parse_bad_number", "parse_bad_chain_id",
+        "parse_bad_timestamp", "header_reads", "header_failures", "saves_deleted", "files_removed", "bytes_freed",
+        "files_held_back", "remove_retries", "remove_failures", "files_archived", "archive_bytes_in", "archive_bytes_out",
+        "files_stored", "store_bytes_in", "store_bytes_out", "saves_verified", "saves_damaged",
+        "files_migrated", "migrate_bytes",
+    };
+    constexpr const char* phaseNames[metricPhaseCount] = {
+        "enumerate", "parse", "build", "thin", "delete",
+    };
+
+    std::string FormatSample(const PollSample& sample) {
+        std::string line = fmt::format("poll={} time={}", sample.poll, sample.unixTime);
+        for (size_t i = 0; i < metricPhaseCount; i++) {
+            fmt::format_to(std::back_inserter(line), " {}_us={}", phaseNames[i], sample.phaseMicroseconds[i]);
+        }
+        for (size_t i = 0; i < metricCounterCount; i++) {
+            fmt::format_to(std::back_inserter(line), " {}={}", counterNames[i], sample.counters[i]);
+        }
+        return line;
+    }
+}
+
+Metrics& GetMetrics() {
+    static Metrics metrics;
+    return metrics;
+}
+
+void Metrics::WriteSample(const PollSample& sample) {
+    Slot& slot = ring[sample.poll % ringCapacity];
+    slot.sequence.store(sample.poll * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    size_t field = 0;
+    slot.values[field++].store(sample.poll, std::memory_order_relaxed);
+    slot.values[field++].store(static_cast<std::uint64_t>(sample.unixTime), std::memory_order_relaxed);
+    for (std::uint64_t value : sample.phaseMicroseconds) slot.values[field++].store(value, std::memory_order_relaxed);
+    for (std::uint64_t value : sample.counters) slot.values[field++].store(value, std::memory_order_relaxed);
+
+    slot.sequence.store(sample.poll * 2 + 2, std::memory_order_release);
+    written.store(sample.poll + 1, std::memory_order_release);
+}
+
+bool Metrics::ReadSample(std::uint64_t poll, PollSample& sample) const {
+    const Slot& slot = ring[poll % ringCapacity];
+    std::uint64_t expected = poll * 2 + 2;
+    if (slot.sequence.load(std::memory_order_acquire) != expected) return false;
+
+    size_t field = 0;
+    sample.poll = slot.values[field++].load(std::memory_order_relaxed);
+    sample.unixTime = static_cast<std::int64_t>(slot.values[field++].load(std::memory_order_relaxed));
+    for (std::uint64_t& value : sample.phaseMicroseconds) value = slot.values[field++].load(std::memory_order_relaxed);
+    for (std::uint64_t& value : sample.counters) value = slot.values[field++].load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == expected;
+}
+
+void Metrics::EndPoll() {
+    if (!IsEnabled()) return;
+
+    PollSample sample;
+    sample.poll = written.load(std::memory_order_relaxed);
+    sample.unixTime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    for (size_t i = 0; i < metricPhaseCount; i++) {
+        std::uint64_t total = phaseNanoseconds[i].load(std::memory_order_relaxed);
+        sample.phaseMicroseconds[i] = (total - phaseAtLastPoll[i]) / 1000;
+        phaseAtLastPoll[i] = total;
+    }
+    for (size_t i = 0; i < metricCounterCount; i++) {
+        std::uint64_t total = counters[i].load(std::memory_order_relaxed);
+        sample.counters[i] = total - countersAtLastPoll[i];
+        countersAtLastPoll[i] = total;
+    }
+    WriteSample(sample);
+}
+
+void Metrics::Flush(spdlog::logger& logger, bool force) {
+    std::uint64_t end = written.load(std::memory_order_acquire);
+    if (end == flushed) return;
+    if (!force && Clock::now() - lastFlush < flushInterval && end - flushed < ringCapacity / 2) return;
+
+    // Samples the ring already lapped are gone, which is only possible if flushing stalled
+    if (end - flushed > ringCapacity) {
+        logger.warn("{} metric samples were dropped", end - flushed - ringCapacity);
+        flushed = end - ringCapacity;
+    }
+    for (; flushed < end; flushed++) {
+        PollSample sample;
+        if (ReadSample(flushed, sample)) logger.info("{}", FormatSample(sample));
+    }
+    logger.flush();
+    lastFlush = Clock::now();
+}
+
+std::vector<std::string> Metrics::FormatSnapshot() const {
+    std::vector<std::string> lines;
+    if (!IsEnabled()) {
+        lines.push_back("SaveManager metrics are disabled, set bEnableMetrics = true in SaveManager.ini");
+        return lines;
+    }
+
+    std::string totals = "totals:";
+    for (size_t i = 0; i < metricCounterCount; i++) {
+        fmt::format_to(std::back_inserter(totals), " {}={}", counterNames[i], counters[i].load(std::memory_order_relaxed));
+    }
+    lines.push_back(std::move(totals));
+
+    std::string times = "time_ms:";
+    for (size_t i = 0; i < metricPhaseCount; i++) {
+        fmt::format_to(std::back_inserter(times), " {}={:.1f}", phaseNames[i], phaseNanoseconds[i].load(std::memory_order_relaxed) / 1e6);
+    }
+    lines.push_back(std::move(times));
+
+    std::uint64_t end = written.load(std::memory_order_acquire);
+    PollSample sample;
+    if (end > 0 && ReadSample(end - 1, sample)) {
+        lines.push_back("last " + FormatSample(sample));
+    }
+    return lines;
+}
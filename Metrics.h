@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace spdlog {
+    class logger;
+}
+
+// Running totals, counted by whichever thread does the work
+enum class MetricCounter : size_t {
+    FilesScanned,
+    SavesAdded,
+    SavesRemovedExternally,
+    ParseBadNumber,
+    ParseBadChainId,
+    ParseBadTimestamp,
+    HeaderReads,
+    HeaderFailures,
+    SavesDeleted,    // Let go of by a chain and queued for deletion
+    FilesRemoved,
+    BytesFreed,
+    FilesHeldBack,   // Written too recently to remove yet
+    RemoveRetries,
+    RemoveFailures,
+    FilesArchived,
+    ArchiveBytesIn,  // Before compression
+    ArchiveBytesOut, // Written to the archives
+    FilesStored,     // Moved into the chunk store
+    StoreBytesIn,
+    StoreBytesOut,   // New chunks written to the pack, after deduplication and compression
+    SavesVerified,
+    SavesDamaged,    // Newest saves of a chain that failed verification, their chain's deletions are held
+    FilesMigrated,   // Moved into cold storage
+    MigrateBytes,
+    Count
+};
+
+// Time spent in each part of the manager loop, build includes the thinning done while building
+enum class MetricPhase : size_t {
+    Enumerate,
+    Parse,
+    Build,
+    Thin,
+    Delete,          // Spent by the deletion workers, which run alongside the loop
+    Count
+};
+
+constexpr size_t metricCounterCount = static_cast<size_t>(MetricCounter::Count);
+constexpr size_t metricPhaseCount = static_cast<size_t>(MetricPhase::Count);
+
+// What changed during one pass of the manager loop
+struct PollSample {
+    std::uint64_t poll = 0;
+    std::int64_t unixTime = 0;
+    std::array<std::uint64_t, metricPhaseCount> phaseMicroseconds = {};
+    std::array<std::uint64_t, metricCounterCount> counters = {};
+};
+
+// Counters and timings for the manager loop, recorded only while enabled
+// Each pass of the loop ends with a sample in a lock-free ring that is flushed to a log file now and then
+// When disabled, recording costs one relaxed load and no clock reads
+class Metrics {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t ringCapacity = 256;
+    static constexpr size_t sampleFields = 2 + metricPhaseCount + metricCounterCount;
+
+    // Readers check the sequence before and after copying, an odd or changed sequence means the slot was being written
+    struct Slot {
+        std::atomic<std::uint64_t> sequence = 0;
+        std::array<std::atomic<std::uint64_t>, sampleFields> values = {};
+    };
+
+    std::atomic<bool> enabled = false;
+    std::array<std::atomic<std::uint64_t>, metricCounterCount> counters = {};
+    std::array<std::atomic<std::uint64_t>, metricPhaseCount> phaseNanoseconds = {};
+
+    std::array<Slot, ringCapacity> ring;
+    std::atomic<std::uint64_t> written = 0;
+
+    // Only touched by the thread that ends polls and flushes
+    std::array<std::uint64_t, metricCounterCount> countersAtLastPoll = {};
+    std::array<std::uint64_t, metricPhaseCount> phaseAtLastPoll = {};
+    std::uint64_t flushed = 0;
+    Clock::time_point lastFlush = Clock::now();
+
+    void WriteSample(const PollSample& sample);
+
+public:
+    static constexpr std::chrono::seconds flushInterval = std::chrono::seconds(60);
+
+    void SetEnabled(bool enable) {
+        enabled.store(enable, std::memory_order_relaxed);
+    }
+    bool IsEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    void Add(MetricCounter counter, std::uint64_t amount = 1) {
+        if (IsEnabled()) counters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+    void AddTime(MetricPhase phase, Clock::duration time) {
+        if (IsEnabled()) {
+            auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+            phaseNanoseconds[static_cast<size_t>(phase)].fetch_add(static_cast<std::uint64_t>(nanoseconds), std::memory_order_relaxed);
+        }
+    }
+
+    // Records everything since the previous poll as one sample
+    void EndPoll();
+
+    // Returns false if the sample was overwritten or is being written, safe from any thread
+    bool ReadSample(std::uint64_t poll, PollSample& sample) const;
+
+    // Writes samples that were not written yet, at most once per flushInterval unless forced
+    void Flush(spdlog::logger& logger, bool force = false);
+
+    // Totals since startup and the latest sample, one line each, for the console
+    std::vector<std::string> FormatSnapshot() const;
+};
+
+Metrics& GetMetrics();
+
+// Adds the time until the end of the scope to a phase, never reads the clock while metrics are disabled
+class PhaseTimer {
+private:
+    MetricPhase phase;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit PhaseTimer(MetricPhase phase) : phase(phase), active(GetMetrics().IsEnabled()) {
+        if (active) start = std::chrono::steady_clock::now();
+    }
+    ~PhaseTimer() {
+        if (active) GetMetrics().AddTime(phase, std::chrono::steady_clock::now() - start);
+    }
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
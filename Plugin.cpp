@@ -0,0 +1,290 @@
+// SKSE entry point for SkyrimSaveManager, the retention logic itself lives in SaveManager.h
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <Windows.h>
+#include <spdlog/sinks/basic_file_sink.h>
+#include <filesystem>
+#include <shlobj.h>
+#include <shellapi.h>
+
+#include "DirectoryWatcher.h"
+#include "IniReader.h"
+#include "Metrics.h"
+#include "SaveManager.h"
+#include "SaveTrigger.h"
+#include "UserVars.h"
+#include "WorkerPool.h"
+
+std::string GetIniPath() {
+    char dllPathBuffer[MAX_PATH];
+    HMODULE hMod = nullptr;
+
+    if (GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCSTR)GetIniPath, &hMod)) {
+        GetModuleFileNameA(hMod, dllPathBuffer, MAX_PATH);
+        std::string dllPath(dllPathBuffer);
+        return dllPath.substr(0, dllPath.find_last_of("/\\")) + "\\SaveManager.ini";
+    } else {
+        return std::string("C:\\");
+    }
+}
+
+std::string GetDocPath() {
+    PWSTR path = nullptr;
+    std::string docPath = "C:\\";
+    if (SUCCEEDED(SHGetKnownFolderPath(FOLDERID_Documents, 0, NULL, &path))) {
+        // Same code page as the save names and std::filesystem::path, every path built from this stays in one encoding
+        int size_needed = WideCharToMultiByte(CP_ACP, 0, path, -1, NULL, 0, NULL, NULL);
+        if (size_needed > 0) {
+            char* buffer = new char[size_needed];
+            WideCharToMultiByte(CP_ACP, 0, path, -1, buffer, size_needed, NULL, NULL);
+            std::string strPath(buffer);
+            delete[] buffer;
+            docPath = strPath;
+        }
+        docPath += "\\My Games\\Skyrim Special Edition\\";
+
+        CoTaskMemFree(path);
+    }
+    return docPath;
+}
+
+// This needs to be something that no sane indiviual would
+// use as their local save path
+#define undefinedPathStr "Undefined Local Path: Fk y0"
+
+std::string GetLocalSavePath(std::string docPath) {
+    std::string localSavePath(undefinedPathStr);
+    if (std::filesystem::exists(docPath + "SkyrimCustom.ini")) {
+        IniReader reader(docPath + "SkyrimCustom.ini", "General");
+        localSavePath = reader.ReadStr("SLocalSavePath", undefinedPathStr);
+    }
+    if (localSavePath == undefinedPathStr && std::filesystem::exists(docPath + "Skyrim.ini")) {
+        IniReader reader(docPath + "Skyrim.ini", "General");
+        localSavePath = reader.ReadStr("SLocalSavePath", undefinedPathStr);
+    }
+    if (localSavePath == undefinedPathStr) {
+        localSavePath = "Saves/";
+    }
+    
+    return localSavePath;
+}
+
+// The game reads SLocalSavePath once at startup, so the folder is resolved once as well
+std::string GetSavePath() {
+    static const std::string savePath = []() {
+        std::string docPath = GetDocPath();
+        return docPath + GetLocalSavePath(docPath);
+    }();
+    return savePath;
+}
+
+// Woken by SKSE save messages and the save folder watcher
+SaveTrigger saveTrigger;
+
+// SKSE sends kSaveGame as the save starts, the game is still writing it for a few seconds after
+constexpr auto saveGraceTime = std::chrono::seconds(5);
+std::atomic<std::chrono::steady_clock::rep> lastSaveTime = 0;
+std::atomic<bool> loadingScreenOpen = false;
+
+class LoadingMenuWatcher : public RE::BSTEventSink<RE::MenuOpenCloseEvent> {
+public:
+    RE::BSEventNotifyControl ProcessEvent(const RE::MenuOpenCloseEvent* event, RE::BSTEventSource<RE::MenuOpenCloseEvent>*) override {
+        if (event && event->menuName == RE::LoadingMenu::MENU_NAME) {
+            loadingScreenOpen = event->opening;
+        }
+        return RE::BSEventNotifyControl::kContinue;
+    }
+};
+LoadingMenuWatcher loadingMenuWatcher;
+
+// Deletions wait while the game is saving or streaming in a new area
+bool ShouldDeferDeletions() {
+    if (loadingScreenOpen) return true;
+
+    auto sinceSave = std::chrono::steady_clock::now() - std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(lastSaveTime.load()));
+    return sinceSave < saveGraceTime;
+}
+
+// Console command that prints the current metrics, registered over an unused vanilla command
+bool PrintMetrics(const RE::SCRIPT_PARAMETER*, RE::SCRIPT_FUNCTION::ScriptData*, RE::TESObjectREFR*, RE::TESObjectREFR*, RE::Script*, RE::ScriptLocals*, double&, std::uint32_t&) {
+    RE::ConsoleLog* console = RE::ConsoleLog::GetSingleton();
+    if (!console) return true;
+    for (const std::string& line : GetMetrics().FormatSnapshot()) {
+        console->Print("%s", line.c_str());
+    }
+    return true;
+}
+
+void RegisterMetricsCommand() {
+    RE::SCRIPT_FUNCTION* command = RE::SCRIPT_FUNCTION::LocateConsoleCommand("BetaComment");
+    if (!command) {
+        spdlog::warn("Could not register the SaveManagerStats console command");
+        return;
+    }
+    command->functionName = "SaveManagerStats";
+    command->shortName = "ssmstats";
+    command->helpString = "Print SkyrimSaveManager timings and counters";
+    command->referenceFunction = false;
+    command->SetParameters();
+    command->executeFunction = PrintMetrics;
+}
+
+// Metrics get their own log so the main log stays readable
+std::shared_ptr<spdlog::logger> CreateMetricsLogger() {
+    std::optional<std::filesystem::path> logDirectory = SKSE::log::log_directory();
+    if (!logDirectory) return nullptr;
+
+    auto fileSink = std::make_shared<spdlog::sinks::basic_file_sink_mt>((*logDirectory / "SkyrimSaveManager.metrics.log").string(), true);
+    auto logger = std::make_shared<spdlog::logger>("SkyrimSaveManagerMetrics", std::move(fileSink));
+    logger->set_pattern("[%Y-%m-%d %H:%M:%S] %v");
+    return logger;
+}
+
+// Closing the game waits at most this long for the queues, what is left is handled on the next start
+constexpr auto shutdownTimeLimit = std::chrono::seconds(2);
+
+void RunSaveManager(std::stop_token stopToken) {
+    std::stop_callback onStop(stopToken, []() { saveTrigger.Stop(); });
+
+    // Chain building also runs on this thread while it waits for the pool
+    LowerCurrentThreadPriority();
+
+    // The save index lives next to the ini so it stays with the plugin install
+    std::string iniPath = GetIniPath();
+    std::string indexPath = std::filesystem::path(iniPath).replace_filename("SaveManager.idx").string();
+    std::int64_t iniWriteTime = IniReader::GetWriteTime(iniPath);
+    UserVars iniVars = ReadUserVars(iniPath);
+
+    // Enabled before the first scan so startup is recorded too
+    std::shared_ptr<spdlog::logger> metricsLogger;
+    if (iniVars.enableMetrics) {
+        GetMetrics().SetEnabled(true);
+        metricsLogger = CreateMetricsLogger();
+    }
+    auto endPoll = [&metricsLogger]() {
+        Metrics& metrics = GetMetrics();
+        if (!metrics.IsEnabled()) return;
+        metrics.EndPoll();
+        if (metricsLogger) metrics.Flush(*metricsLogger);
+    };
+
+    // A verified save wakes the loop, deletions held back for it are released on that pass
+    SaveManager manager(iniVars, GetSavePath(), indexPath, ShouldDeferDeletions, []() { saveTrigger.Notify(); },
+        []() { return saveTrigger.GetOutsideChangeCount(); });
+    const UserVars& userVars = manager.GetUserVars();
+    endPoll();
+
+    std::unique_ptr<DirectoryWatcher> watcher;
+    auto startWatcher = [&watcher, &userVars]() {
+        if (!userVars.watchSaveFolder) {
+            watcher.reset();
+            return;
+        }
+        if (watcher) return;
+        watcher = CreateDirectoryWatcher();
+        if (!watcher->Start(GetSavePath(), []() { saveTrigger.Notify(); })) {
+            watcher.reset(); // Timed polling still covers the folder
+        }
+    };
+    startWatcher();
+
+    // The timed poll only runs when nothing else has woken the manager
+    auto pollInterval = std::chrono::seconds((int) (userVars.pollTime * 60));
+    auto debounceTime = std::chrono::milliseconds((int) (userVars.debounceTime * 1000));
+    TriggerReason reason;
+    while ((reason = saveTrigger.Wait(pollInterval, debounceTime, pollInterval)) != TriggerReason::Stop) {
+        // An edited ini is picked up on the next poll, without restarting the game
+        std::int64_t writeTime = IniReader::GetWriteTime(iniPath);
+        bool iniChanged = writeTime != iniWriteTime;
+        if (iniChanged) {
+            iniWriteTime = writeTime;
+            manager.ApplyUserVars(ReadUserVars(iniPath));
+            pollInterval = std::chrono::seconds((int) (userVars.pollTime * 60));
+            debounceTime = std::chrono::milliseconds((int) (userVars.debounceTime * 1000));
+            startWatcher();
+            if (userVars.enableMetrics && !metricsLogger) metricsLogger = CreateMetricsLogger();
+            GetMetrics().SetEnabled(userVars.enableMetrics);
+        }
+
+        // The watcher also wakes the loop for the files the manager removed itself, which leave nothing to update
+        // Game saves and deletions always update, they are counted before the game touches the folder
+        // The timed poll always updates, it is the safety net for changes made outside the game during a removal
+        if (reason == TriggerReason::Event && !iniChanged && !manager.NeedsUpdate()) continue;
+
+        manager.Update();
+        endPoll();
+    }
+    manager.Shutdown(shutdownTimeLimit);
+}
+
+// Stopped and joined when the game closes, so the manager's queues get a short while to finish the removals its last pass handed them
+// A jthread requests a stop and joins on its own if the game is torn down without closing its window
+std::jthread managerThread;
+WNDPROC gameWindowProc = nullptr;
+
+void StopSaveManager() {
+    managerThread.request_stop();
+    if (managerThread.joinable()) managerThread.join();
+}
+
+// SKSE sends no message when the game exits, its main window going away is the last point where the game still waits for us
+LRESULT CALLBACK GameWindowProc(HWND window, UINT message, WPARAM wParam, LPARAM lParam) {
+    if (message == WM_DESTROY) StopSaveManager();
+    if (!gameWindowProc) return DefWindowProcW(window, message, wParam, lParam);
+    return CallWindowProcW(gameWindowProc, window, message, wParam, lParam);
+}
+
+void WatchForGameExit() {
+    RE::Main* main = RE::Main::GetSingleton();
+    HWND window = main ? reinterpret_cast<HWND>(main->wnd) : nullptr;
+    if (!window) {
+        spdlog::warn("Could not find the game window, removals still queued when the game exits may be cut short");
+        return;
+    }
+    // Every other message is forwarded to the game's own procedure, the window is left alone if it cannot be read
+    if (!GetWindowLongPtrW(window, GWLP_WNDPROC)) {
+        spdlog::warn("Could not read the game window's procedure, removals still queued when the game exits may be cut short");
+        return;
+    }
+    gameWindowProc = reinterpret_cast<WNDPROC>(SetWindowLongPtrW(window, GWLP_WNDPROC, reinterpret_cast<LONG_PTR>(GameWindowProc)));
+    if (!gameWindowProc) spdlog::warn("Could not hook the game window, removals still queued when the game exits may be cut short");
+}
+
+void SetupLog() {
+    std::optional<std::filesystem::path> logDirectory = SKSE::log::log_directory();
+    if (!logDirectory) return;
+
+    auto fileSink = std::make_shared<spdlog::sinks::basic_file_sink_mt>((*logDirectory / "SkyrimSaveManager.log").string(), true);
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("SkyrimSaveManager", std::move(fileSink)));
+    spdlog::set_level(spdlog::level::info);
+    spdlog::flush_on(spdlog::level::info);
+}
+
+SKSEPluginLoad(const SKSE::LoadInterface *skse) {
+    SKSE::Init(skse);
+    SetupLog();
+
+    // Start subprocess for save management after other mods are loaded
+    SKSE::GetMessagingInterface()->RegisterListener([](SKSE::MessagingInterface::Message* message) {
+        switch (message->type) {
+        case SKSE::MessagingInterface::kDataLoaded: {
+            RE::UI::GetSingleton()->AddEventSink<RE::MenuOpenCloseEvent>(&loadingMenuWatcher);
+            RegisterMetricsCommand();
+            managerThread = std::jthread(RunSaveManager);
+            WatchForGameExit();
+            break;
+        }
+        case SKSE::MessagingInterface::kSaveGame:
+            lastSaveTime = std::chrono::steady_clock::now().time_since_epoch().count();
+            saveTrigger.NotifyOutsideChange();
+            break;
+        case SKSE::MessagingInterface::kDeleteGame:
+            saveTrigger.NotifyOutsideChange();
+            break;
+        }
+    });
+
+    return true;
+}
@@ -0,0 +1,341 @@
+#include "SaveArchive.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+#include <spdlog/spdlog.h>
+#include <zlib.h>
+
+#include "Metrics.h"
+#include "SaveNameParser.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char archiveMagic[4] = { 'S', 'S', 'M', 'A' };
+    constexpr char entryMagic[4] = { 'S', 'S', 'M', 'E' };
+    constexpr std::uint32_t archiveVersion = 1;
+
+    // Memory used by one archive or restore besides the compressor state, whatever the size of the save
+    constexpr size_t streamChunkSize = 256 * 1024;
+
+    // Saves are usually compressed by the game already, so the fastest level gives up little
+    constexpr int compressionLevel = 1;
+
+    // Names are a single file name, anything longer is a corrupt entry
+    constexpr std::uint32_t maxNameLength = 4096;
+
+    // Puts the archive back to its last whole entry
+    void TruncateArchive(const std::string& archivePath, std::uint64_t size) {
+        std::error_code error;
+        std::filesystem::resize_file(archivePath, size, error);
+        if (error) spdlog::warn("Could not truncate {}: {}", archivePath, error.message());
+    }
+
+    bool Compress(std::ifstream& input, std::fstream& output, std::uint64_t& rawSize, std::uint64_t& storedSize, std::uint32_t& crc) {
+        z_stream stream = {};
+        if (deflateInit(&stream, compressionLevel) != Z_OK) return false;
+
+        std::vector<unsigned char> in(streamChunkSize);
+        std::vector<unsigned char> out(streamChunkSize);
+        uLong runningCrc = crc32(0, nullptr, 0);
+        bool ok = true;
+        int flush = Z_NO_FLUSH;
+        while (ok && flush != Z_FINISH) {
+            input.read(reinterpret_cast<char*>(in.data()), in.size());
+            std::streamsize read = input.gcount();
+            if (input.bad()) {
+                ok = false;
+                break;
+            }
+            flush = input.eof() ? Z_FINISH : Z_NO_FLUSH;
+            rawSize += read;
+            runningCrc = crc32(runningCrc, in.data(), static_cast<uInt>(read));
+
+            stream.next_in = in.data();
+            stream.avail_in = static_cast<uInt>(read);
+            do {
+                stream.next_out = out.data();
+                stream.avail_out = static_cast<uInt>(out.size());
+                if (deflate(&stream, flush) == Z_STREAM_ERROR) {
+                    ok = false;
+                    break;
+                }
+                size_t produced = out.size() - stream.avail_out;
+                output.write(reinterpret_cast<const char*>(out.data()), produced);
+                storedSize += produced;
+            } while (stream.avail_out == 0);
+        }
+        deflateEnd(&stream);
+        crc = static_cast<std::uint32_t>(runningCrc);
+        return ok && output.good();
+    }
+}
+
+bool FlushToDisk(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(std::filesystem::path(path).c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    bool flushed = FlushFileBuffers(file);
+    CloseHandle(file);
+    return flushed;
+#else
+    int file = open(path.c_str(), O_RDWR);
+    if (file < 0) return false;
+    bool flushed = fsync(file) == 0;
+    close(file);
+    return flushed;
+#endif
+}
+
+std::string GetArchiveDir(const std::string& saveDir) {
+    return (std::filesystem::path(saveDir) / "SaveManagerArchive").string();
+}
+
+std::string GetArchivePath(const std::string& archiveDir, std::uint32_t chainId) {
+    char fileName[16];
+    std::snprintf(fileName, sizeof(fileName), "%08X.ssa", chainId);
+    return (std::filesystem::path(archiveDir) / fileName).string();
+}
+
+std::vector<ArchiveEntry> ListArchive(const std::string& archivePath, std::uint64_t* validSize) {
+    std::vector<ArchiveEntry> entries;
+    if (validSize) *validSize = 0;
+
+    std::ifstream file(archivePath, std::ios::binary);
+    if (!file) return entries;
+
+    std::error_code error;
+    std::uint64_t fileSize = std::filesystem::file_size(archivePath, error);
+    if (error) return entries;
+
+    ArchiveFileHeader fileHeader = {};
+    if (!file.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader))) return entries;
+    if (std::memcmp(fileHeader.magic, archiveMagic, sizeof(archiveMagic)) != 0 || fileHeader.version != archiveVersion) return entries;
+
+    std::uint64_t offset = sizeof(fileHeader);
+    if (validSize) *validSize = offset;
+
+    // Only the headers are read, the compressed data is skipped over
+    ArchiveEntryHeader header = {};
+    while (file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        if (std::memcmp(header.magic, entryMagic, sizeof(entryMagic)) != 0) break;
+        if (header.storedSize == 0 || header.nameLength == 0 || header.nameLength > maxNameLength) break;
+
+        std::uint64_t dataOffset = offset + sizeof(header) + header.nameLength;
+        if (dataOffset > fileSize || header.storedSize > fileSize - dataOffset) break;
+
+        ArchiveEntry entry;
+        entry.fileName.resize(header.nameLength);
+        if (!file.read(entry.fileName.data(), header.nameLength)) break;
+        entry.rawSize = header.rawSize;
+        entry.storedSize = header.storedSize;
+        entry.writeTime = header.writeTime;
+        entry.crc = header.crc;
+        entry.dataOffset = dataOffset;
+        entries.push_back(std::move(entry));
+
+        offset = dataOffset + header.storedSize;
+        if (validSize) *validSize = offset;
+        file.seekg(static_cast<std::streamoff>(offset));
+    }
+    return entries;
+}
+
+bool AppendToArchive(const std::string& archivePath, const std::string& filePath, ArchiveStats* stats, ArchiveTail* tail) {
+    std::error_code error;
+    std::filesystem::path sourcePath(filePath);
+    std::string fileName = sourcePath.filename().string();
+    std::uint64_t fileSize = std::filesystem::file_size(sourcePath, error);
+    if (error) return false;
+    auto writeTime = std::filesystem::last_write_time(sourcePath, error);
+    if (error) return false;
+
+    // A file whose removal failed after it was archived is not stored twice
+    ArchiveTail scanned;
+    if (!tail) tail = &scanned;
+    std::uint64_t archiveSize = std::filesystem::file_size(archivePath, error);
+    if (error) archiveSize = 0;
+    if (tail->validSize == 0 || tail->validSize != archiveSize) {
+        tail->entries.clear();
+        for (const ArchiveEntry& entry : ListArchive(archivePath, &tail->validSize)) {
+            tail->entries.emplace(entry.fileName, entry.rawSize);
+        }
+    }
+    if (tail->entries.contains({ fileName, fileSize })) return true;
+    std::uint64_t validSize = tail->validSize;
+
+    std::ifstream input(filePath, std::ios::binary);
+    if (!input) return false;
+
+    // An archive that cannot be read is never written over, its saves may still be restorable by hand
+    if (validSize == 0 && std::filesystem::file_size(archivePath, error) > 0 && !error) {
+        spdlog::warn("{} is not a save archive this version can add to", archivePath);
+        return false;
+    }
+
+    // A torn entry at the end is cut off before the next one is added
+    if (validSize == 0) {
+        std::ofstream create(archivePath, std::ios::binary | std::ios::trunc);
+        ArchiveFileHeader fileHeader = {};
+        std::memcpy(fileHeader.magic, archiveMagic, sizeof(archiveMagic));
+        fileHeader.version = archiveVersion;
+        create.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+        if (!create) return false;
+        validSize = sizeof(fileHeader);
+    }
+    else if (std::filesystem::file_size(archivePath, error) != validSize && !error) {
+        spdlog::warn("Cutting a partly written entry off {}", archivePath);
+        TruncateArchive(archivePath, validSize);
+    }
+
+    std::fstream output(archivePath, std::ios::binary | std::ios::in | std::ios::out);
+    if (!output) return false;
+    output.seekp(static_cast<std::streamoff>(validSize));
+
+    ArchiveEntryHeader header = {};
+    std::memcpy(header.magic, entryMagic, sizeof(entryMagic));
+    header.nameLength = static_cast<std::uint32_t>(fileName.size());
+    header.writeTime = static_cast<std::int64_t>(writeTime.time_since_epoch().count());
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(fileName.data(), fileName.size());
+
+    bool ok = output.good() && Compress(input, output, header.rawSize, header.storedSize, header.crc);
+    if (ok) {
+        // The finished header makes the entry visible
+        output.seekp(static_cast<std::streamoff>(validSize));
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ok = output.good();
+    }
+    output.close();
+    ok = ok && !output.fail() && FlushToDisk(archivePath);
+    if (!ok) {
+        TruncateArchive(archivePath, validSize);
+        tail->validSize = 0;
+        return false;
+    }
+    tail->validSize = validSize + sizeof(header) + fileName.size() + header.storedSize;
+    tail->entries.emplace(fileName, header.rawSize);
+
+    if (stats) {
+        stats->rawBytes += header.rawSize;
+        stats->storedBytes += header.storedSize;
+    }
+    return true;
+}
+
+bool ExtractFromArchive(const std::string& archivePath, const ArchiveEntry& entry, const std::string& outputPath, ArchiveStats* stats) {
+    std::ifstream input(archivePath, std::ios::binary);
+    if (!input) return false;
+    input.seekg(static_cast<std::streamoff>(entry.dataOffset));
+
+    std::ofstream output(outputPath, std::ios::binary | std::ios::trunc);
+    if (!output) return false;
+
+    z_stream stream = {};
+    if (inflateInit(&stream) != Z_OK) return false;
+
+    std::vector<unsigned char> in(streamChunkSize);
+    std::vector<unsigned char> out(streamChunkSize);
+    uLong crc = crc32(0, nullptr, 0);
+    std::uint64_t rawSize = 0;
+    std::uint64_t remaining = entry.storedSize;
+    int result = Z_OK;
+    while (result != Z_STREAM_END && remaining > 0) {
+        size_t chunk = static_cast<size_t>(std::min<std::uint64_t>(remaining, in.size()));
+        if (!input.read(reinterpret_cast<char*>(in.data()), chunk)) break;
+        remaining -= chunk;
+
+        stream.next_in = in.data();
+        stream.avail_in = static_cast<uInt>(chunk);
+        do {
+            stream.next_out = out.data();
+            stream.avail_out = static_cast<uInt>(out.size());
+            result = inflate(&stream, Z_NO_FLUSH);
+            if (result != Z_OK && result != Z_STREAM_END) break;
+
+            size_t produced = out.size() - stream.avail_out;
+            crc = crc32(crc, out.data(), static_cast<uInt>(produced));
+            output.write(reinterpret_cast<const char*>(out.data()), produced);
+            rawSize += produced;
+        } while (stream.avail_out == 0 && result != Z_STREAM_END);
+        if (result != Z_OK && result != Z_STREAM_END) break;
+    }
+    inflateEnd(&stream);
+    output.close();
+
+    std::error_code error;
+    if (result != Z_STREAM_END || output.fail() || rawSize != entry.rawSize || crc != entry.crc) {
+        spdlog::warn("Archived {} in {} is damaged", entry.fileName, archivePath);
+        std::filesystem::remove(outputPath, error);
+        return false;
+    }
+
+    // The game shows saves by their own timestamp, but the file keeps its original date anyway
+    std::filesystem::last_write_time(outputPath, std::filesystem::file_time_type(std::filesystem::file_time_type::duration(entry.writeTime)), error);
+    if (stats) {
+        stats->rawBytes += rawSize;
+        stats->storedBytes += entry.storedSize;
+    }
+    return true;
+}
+
+class ArchivingRemover : public SaveRemover {
+private:
+    std::string archiveDir;
+    std::unique_ptr<SaveRemover> remover;
+    std::unordered_map<std::uint32_t, ArchiveTail> tails;  // By chain id
+
+public:
+    ArchivingRemover(const std::string& archiveDir, std::unique_ptr<SaveRemover> remover)
+        : archiveDir(archiveDir), remover(std::move(remover)) {}
+
+    void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+        results.assign(paths.size(), RemoveResult::Missing);
+
+        std::error_code error;
+        std::filesystem::create_directories(archiveDir, error);
+
+        // Only files that made it into an archive are passed on for removal
+        std::vector<std::string> archivedPaths;
+        std::vector<size_t> archivedIndices;
+        Metrics& metrics = GetMetrics();
+        for (size_t i = 0; i < paths.size(); i++) {
+            std::filesystem::path path(paths[i]);
+            if (!std::filesystem::exists(path, error)) continue;
+
+            // Saves without a readable chain id go to chain 0, the same chain the manager puts them in
+            std::uint32_t chainId = ParseSaveName(path.stem().string()).chainId;
+            ArchiveStats stats;
+            if (!AppendToArchive(GetArchivePath(archiveDir, chainId), paths[i], &stats, &tails[chainId])) {
+                results[i] = RemoveResult::Retry;
+                continue;
+            }
+            metrics.Add(MetricCounter::FilesArchived);
+            metrics.Add(MetricCounter::ArchiveBytesIn, stats.rawBytes);
+            metrics.Add(MetricCounter::ArchiveBytesOut, stats.storedBytes);
+            archivedPaths.push_back(paths[i]);
+            archivedIndices.push_back(i);
+        }
+        if (archivedPaths.empty()) return;
+
+        std::vector<RemoveResult> removed;
+        remover->Remove(archivedPaths, removed);
+        for (size_t i = 0; i < archivedIndices.size(); i++) {
+            results[archivedIndices[i]] = removed[i];
+        }
+    }
+};
+
+std::unique_ptr<SaveRemover> CreateArchivingRemover(const std::string& archiveDir, std::unique_ptr<SaveRemover> remover) {
+    return std::make_unique<ArchivingRemover>(archiveDir, std::move(remover));
+}
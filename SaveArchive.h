@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SaveRemover.h"
+
+// An archive is one file per chain: a small file header followed by entries that are only ever appended
+// Each entry is an ArchiveEntryHeader, the file name, then the file compressed with deflate
+struct ArchiveFileHeader {
+    char magic[4];
+    std::uint32_t version;
+};
+static_assert(sizeof(ArchiveFileHeader) == 8);
+
+// storedSize is written last, an entry that still has it at 0 was cut off while being added
+struct ArchiveEntryHeader {
+    char magic[4];
+    std::uint32_t nameLength;
+    std::uint64_t rawSize;
+    std::uint64_t storedSize;
+    std::int64_t writeTime;  // Last write time of the original file, in file clock ticks
+    std::uint32_t crc;       // CRC-32 of the original file
+    std::uint32_t reserved;
+};
+static_assert(sizeof(ArchiveEntryHeader) == 40);
+
+struct ArchiveEntry {
+    std::string fileName;
+    std::uint64_t rawSize;
+    std::uint64_t storedSize;
+    std::int64_t writeTime;
+    std::uint32_t crc;
+    std::uint64_t dataOffset;
+};
+
+// Bytes going in and out of a single archive or restore
+struct ArchiveStats {
+    std::uint64_t rawBytes = 0;
+    std::uint64_t storedBytes = 0;
+};
+
+// What the last scan of an archive found, kept by its writer so that each append does not list the whole archive again
+// Trusted for as long as the archive is still validSize bytes long, a failed append clears it
+struct ArchiveTail {
+    std::uint64_t validSize = 0;  // 0 until the archive has been scanned
+    std::set<std::pair<std::string, std::uint64_t>> entries;  // File name and raw size of every entry
+};
+
+// Waits for the file to reach the disk, used before the original of an archived or stored file is removed
+bool FlushToDisk(const std::string& path);
+
+// Archives are kept in a folder inside the save folder, the game does not look in it
+std::string GetArchiveDir(const std::string& saveDir);
+
+// Archive that holds the saves of one chain
+std::string GetArchivePath(const std::string& archiveDir, std::uint32_t chainId);
+
+// Entries in the order they were added, a torn entry at the end is left out
+// validSize is set to the bytes of the archive up to the end of the last whole entry
+std::vector<ArchiveEntry> ListArchive(const std::string& archivePath, std::uint64_t* validSize = nullptr);
+
+// Streams a file through the compressor into the archive, creating the archive if needed
+// The archive is flushed to disk before this returns, on failure it is left as it was
+// A file already archived under the same name and size is not added again
+// With a tail the archive is only listed when the tail is empty or out of date
+bool AppendToArchive(const std::string& archivePath, const std::string& filePath, ArchiveStats* stats = nullptr, ArchiveTail* tail = nullptr);
+
+// Writes an entry back out, the output is removed again if it does not match the CRC of the original
+bool ExtractFromArchive(const std::string& archivePath, const ArchiveEntry& entry, const std::string& outputPath,
+    ArchiveStats* stats = nullptr);
+
+// Archives each file by the chain id in its name, then removes it with the given remover
+// Files that cannot be archived are kept and reported for a retry
+std::unique_ptr<SaveRemover> CreateArchivingRemover(const std::string& archiveDir, std::unique_ptr<SaveRemover> remover);
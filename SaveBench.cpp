@@ -0,0 +1,774 @@
+// Microbenchmarks for SkyrimSaveManager, runs headless on any platform
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "ChunkStore.h"
+#include "SaveArchive.h"
+#include "SaveChain.h"
+#include "SaveEnumerator.h"
+#include "SaveGame.h"
+#include "SaveNameParser.h"
+#include "UserVars.h"
+#include "WorkerPool.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Results a benchmark computes only to keep its loop, written so the compiler cannot drop them
+    volatile std::uint64_t benchSink = 0;
+
+    // The per-field substr/stoull/mktime parsing that SaveGame used before ParseSaveName
+    struct LegacyParsed {
+        std::uint32_t number = 0;
+        std::uint32_t chainId = 0;
+        time_t time = 0;
+    };
+
+    LegacyParsed LegacyParse(const std::string& saveName) {
+        LegacyParsed result;
+        try {
+            for (size_t i = 4; i < saveName.length(); i++) {
+                if (saveName[i] == '_') {
+                    result.number = (std::uint32_t) std::stoull(saveName.substr(4, i - 4));
+                    break;
+                }
+            }
+        } catch (...) {}
+        try {
+            std::tm saveDate = {};
+            char entryCount = 1;
+            for (size_t i = 0; i < saveName.length(); i++) {
+                if (entryCount == 7) {
+                    saveDate.tm_year = std::stoi(saveName.substr(i, 4)) - 1900;
+                    saveDate.tm_mon = std::stoi(saveName.substr(i + 4, 2)) - 1;
+                    saveDate.tm_mday = std::stoi(saveName.substr(i + 6, 2));
+                    saveDate.tm_hour = std::stoi(saveName.substr(i + 8, 2));
+                    saveDate.tm_min = std::stoi(saveName.substr(i + 10, 2));
+                    saveDate.tm_sec = std::stoi(saveName.substr(i + 12, 2));
+                    break;
+                }
+                if (saveName[i] == '_') entryCount++;
+            }
+            result.time = std::mktime(&saveDate);
+        } catch (...) {}
+        try {
+            char entryCount = 1;
+            for (size_t i = 0; i < saveName.length(); i++) {
+                if (entryCount == 2) {
+                    result.chainId = (std::uint32_t) std::stoull(saveName.substr(i, 8), nullptr, 16);
+                    break;
+                }
+                if (saveName[i] == '_') entryCount++;
+            }
+        } catch (...) {}
+        return result;
+    }
+
+    // Builds save names shaped like the game's, with a share of underscore locations and broken names
+    std::vector<std::string> MakeNameCorpus(size_t count, std::uint32_t seed) {
+        static const char* locations[] = {
+            "Whiterun", "RiverwoodWorld", "SolitudeWorld", "BleakFallsBarrow01", "Tamriel",
+            "Bleak_Falls_Barrow", "DLC2_RavenRock_Exterior", "Old_Hroldan_Inn", // Underscores break the 7th entry
+        };
+        std::mt19937 rng(seed);
+        auto random = [&rng](unsigned bound) { return static_cast<unsigned>(rng() % bound); };
+        std::vector<std::string> names;
+        names.reserve(count);
+
+        char buffer[256];
+        for (size_t i = 0; i < count; i++) {
+            snprintf(buffer, sizeof(buffer), "Save%zu_%08X_0_%s_%s_%06u_%04u%02u%02u%02u%02u%02u_%u_1",
+                i + 1, random(0xFFFFFFFF), "4A6F686E446F65", locations[random(std::size(locations))], random(1000000),
+                2020 + random(6), 1 + random(12), 1 + random(28), random(24), random(60), random(60), 1 + random(80));
+            names.emplace_back(buffer);
+
+            // Roughly 1% of names are cut short, as if written by a broken tool
+            if (random(100) == 0) names.back().resize(random(static_cast<unsigned>(names.back().size())));
+        }
+        return names;
+    }
+
+    template <typename Function>
+    double NanosecondsPerName(const std::vector<std::string>& names, Function&& parse) {
+        auto start = Clock::now();
+        for (const std::string& name : names) parse(name);
+        std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+        return elapsed.count() / names.size();
+    }
+
+    // One measured quantity of a benchmark run, written out as "bench.metric"
+    struct BenchResult {
+        std::string bench;
+        size_t saves;
+        std::vector<std::pair<std::string, double>> metrics;
+    };
+
+    std::vector<BenchResult> results;
+
+    void Report(const std::string& bench, size_t saves, std::vector<std::pair<std::string, double>> metrics) {
+        printf("%-12s %8zu saves", bench.c_str(), saves);
+        for (const auto& metric : metrics) printf("  %s %.1f", metric.first.c_str(), metric.second);
+        printf("\n");
+        results.push_back({ bench, saves, std::move(metrics) });
+    }
+
+    // Peak resident memory of the whole process so far, sizes are run smallest first so each peak belongs to its size
+    double PeakMemoryMb() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters = {};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+        return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+        rusage usage = {};
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+        return usage.ru_maxrss / 1024.0; // Kilobytes on Linux
+#endif
+    }
+
+    // Bytes currently allocated by the process, used to measure what a structure keeps on the heap
+    // Falls back to 0 where the allocator cannot be asked, which leaves the derived metrics at 0
+    double HeapBytesInUse() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS_EX counters = {};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters))) return 0;
+        return static_cast<double>(counters.PrivateUsage);
+#elif defined(__GLIBC__)
+        return static_cast<double>(mallinfo2().uordblks);
+#else
+        return 0;
+#endif
+    }
+
+    double Percentile(std::vector<float>& samples, double fraction) {
+        if (samples.empty()) return 0;
+        size_t index = static_cast<size_t>(fraction * (samples.size() - 1));
+        std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+        return samples[index];
+    }
+
+    // A save folder as the game would leave it: a few long playthroughs and many short ones,
+    // sessions of regular saves broken up by bursts of quicksave-like saves seconds apart,
+    // and save numbers that do not always follow the save times
+    std::vector<std::string> MakeWorkload(size_t count, size_t chainCount, std::uint32_t seed) {
+        static const char* locations[] = {
+            "Whiterun", "RiverwoodWorld", "SolitudeWorld", "BleakFallsBarrow01", "Tamriel", "Bleak_Falls_Barrow",
+        };
+        struct Chain {
+            std::uint32_t id;
+            std::int64_t time;
+            std::vector<size_t> saves;
+        };
+        struct Record {
+            std::uint32_t number;
+            size_t chain;
+            std::int64_t time;
+        };
+
+        std::mt19937 rng(seed);
+        auto random = [&rng](unsigned bound) { return static_cast<unsigned>(rng() % bound); };
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+        std::vector<Chain> chains(chainCount);
+        for (size_t i = 0; i < chainCount; i++) {
+            chains[i].id = static_cast<std::uint32_t>(i * 0x9E3779B1u + 1);
+            chains[i].time = DaysFromCivil(2020, 1, 1) * 86400 + random(5 * 365) * std::int64_t(86400);
+        }
+
+        std::vector<Record> records;
+        records.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            // Squaring skews the saves towards the first chains
+            double pick = unit(rng);
+            size_t chainIndex = std::min(chainCount - 1, static_cast<size_t>(pick * pick * chainCount));
+            Chain& chain = chains[chainIndex];
+
+            unsigned roll = random(100);
+            if (roll < 15) chain.time += 2 + random(20);              // Quicksave burst
+            else if (roll < 17) chain.time += 3600 * (2 + random(72)); // Break between sessions
+            else chain.time += static_cast<std::int64_t>(-std::log(1.0 - unit(rng)) * 25 * 60) + 1;
+
+            chain.saves.push_back(records.size());
+            records.push_back({ static_cast<std::uint32_t>(i + 1), chainIndex, chain.time });
+        }
+
+        // Saves made around a reload can carry numbers out of time order
+        for (Chain& chain : chains) {
+            for (size_t i = 1; i < chain.saves.size(); i++) {
+                if (random(100) == 0) std::swap(records[chain.saves[i]].number, records[chain.saves[i - 1]].number);
+            }
+        }
+
+        // Directory listings come back in no useful order
+        std::shuffle(records.begin(), records.end(), rng);
+
+        std::vector<std::string> names;
+        names.reserve(count);
+        char buffer[256];
+        for (const Record& record : records) {
+            time_t time = static_cast<time_t>(record.time);
+            std::tm date = *std::gmtime(&time);
+            snprintf(buffer, sizeof(buffer), "Save%u_%08X_0_%s_%s_%06u_%04d%02d%02d%02d%02d%02d_%u_1",
+                record.number, chains[record.chain].id, "4A6F686E446F65", locations[random(std::size(locations))], random(1000000),
+                date.tm_year + 1900, date.tm_mon + 1, date.tm_mday, date.tm_hour, date.tm_min, date.tm_sec, 1 + random(80));
+            names.emplace_back(buffer);
+        }
+        return names;
+    }
+
+    void BenchParse(size_t count) {
+        std::vector<std::string> names = MakeNameCorpus(count, 1234);
+
+        std::uint64_t legacySum = 0;
+        double legacyNs = NanosecondsPerName(names, [&](const std::string& name) {
+            LegacyParsed parsed = LegacyParse(name);
+            legacySum += parsed.number ^ parsed.chainId ^ parsed.time;
+        });
+
+        std::uint64_t parsedSum = 0;
+        size_t malformed = 0;
+        double parsedNs = NanosecondsPerName(names, [&](const std::string& name) {
+            ParsedSaveName parsed = ParseSaveName(name);
+            parsedSum += parsed.number ^ parsed.chainId ^ parsed.time;
+            malformed += !parsed.Ok();
+        });
+
+        Report("parse", names.size(), {
+            { "legacy_ns_per_name", legacyNs },
+            { "ns_per_name", parsedNs },
+            { "names_per_s", 1e9 / parsedNs },
+            { "malformed", static_cast<double>(malformed) },
+        });
+
+        // Keeps both loops from being optimized away
+        benchSink = legacySum ^ parsedSum;
+    }
+
+    // Everything SaveManager::reset does after listing the folder: reading every name, grouping by chain and building each chain
+    // Memory per save is what the built chains keep on the heap, divided by the saves they hold
+    void BenchBuild(const std::vector<std::string>& names, const UserVars& userVars) {
+        double heapBefore = HeapBytesInUse();
+        auto start = Clock::now();
+        std::unordered_map<std::uint32_t, std::vector<SaveGame>> savesByChain;
+        for (const std::string& name : names) {
+            SaveGame save(name);
+            savesByChain[save.GetChainId()].push_back(std::move(save));
+        }
+        auto parsed = Clock::now();
+
+        std::unordered_map<std::uint32_t, SaveChain> chains;
+        size_t deleted = 0;
+        size_t held = 0;
+        for (auto& batchPair : savesByChain) {
+            SaveChain& chain = chains.emplace(batchPair.first, SaveChain(userVars)).first->second;
+            chain.BuildFromBatch(std::move(batchPair.second));
+            deleted += chain.TakeDeletedSaves().size();
+            held += chain.GetSaveCount();
+        }
+        auto built = Clock::now();
+        savesByChain.clear();
+        double chainBytes = HeapBytesInUse() - heapBefore;
+
+        std::chrono::duration<double, std::milli> readMs = parsed - start;
+        std::chrono::duration<double, std::milli> buildMs = built - parsed;
+        Report("build", names.size(), {
+            { "chains", static_cast<double>(chains.size()) },
+            { "read_ms", readMs.count() },
+            { "build_ms", buildMs.count() },
+            { "saves_per_s", names.size() / ((readMs + buildMs).count() / 1000.0) },
+            { "deleted", static_cast<double>(deleted) },
+            { "bytes_per_save", held ? chainBytes / held : 0.0 },
+            { "peak_mb", PeakMemoryMb() },
+        });
+    }
+
+    // Builds every chain, serially without a pool, and returns the deleted names in chain id order
+    std::vector<std::string> BuildChains(const std::vector<std::string>& names, const UserVars& userVars, WorkerPool* pool, double& buildMs) {
+        std::map<std::uint32_t, std::vector<SaveGame>> savesByChain;
+        for (const std::string& name : names) {
+            SaveGame save(name);
+            savesByChain[save.GetChainId()].push_back(std::move(save));
+        }
+        std::vector<std::vector<SaveGame>*> batches;
+        std::vector<SaveChain> chains;
+        for (auto& batchPair : savesByChain) {
+            batches.push_back(&batchPair.second);
+            chains.emplace_back(userVars);
+        }
+
+        auto start = Clock::now();
+        auto build = [&](size_t i) { chains[i].BuildFromBatch(std::move(*batches[i])); };
+        if (pool) pool->ParallelFor(chains.size(), build);
+        else for (size_t i = 0; i < chains.size(); i++) build(i);
+        buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        std::vector<std::string> deleted;
+        for (SaveChain& chain : chains) {
+            for (DeletedSave& deletedSave : chain.TakeDeletedSaves()) deleted.push_back(std::move(deletedSave.saveName));
+        }
+        return deleted;
+    }
+
+    // Chain building fanned out over the worker pool, which must delete exactly what a serial build does
+    void BenchPool(const std::vector<std::string>& names, const UserVars& userVars, size_t threadCount) {
+        WorkerPool pool(threadCount);
+        double serialMs = 0;
+        double poolMs = 0;
+        std::vector<std::string> serialDeleted = BuildChains(names, userVars, nullptr, serialMs);
+        std::vector<std::string> poolDeleted = BuildChains(names, userVars, &pool, poolMs);
+
+        Report("pool", names.size(), {
+            { "threads", static_cast<double>(threadCount + 1) },
+            { "serial_ms", serialMs },
+            { "pool_ms", poolMs },
+            { "speedup", serialMs / poolMs },
+            { "identical", serialDeleted == poolDeleted ? 1.0 : 0.0 },
+        });
+    }
+
+    // Saves added one at a time in the order they were made, as SaveManager::Update does
+    // Adds that let go of older saves ran a thinning pass and are reported separately
+    void BenchIncremental(const std::vector<std::string>& names, const UserVars& userVars) {
+        std::vector<SaveGame> saves;
+        saves.reserve(names.size());
+        for (const std::string& name : names) saves.emplace_back(name);
+        std::sort(saves.begin(), saves.end(), [](const SaveGame& a, const SaveGame& b) {
+            if (a.GetTime() != b.GetTime()) return a.GetTime() < b.GetTime();
+            return a.GetSaveName() < b.GetSaveName();
+        });
+
+        std::unordered_map<std::uint32_t, SaveChain> chains;
+        std::vector<float> addNs;
+        std::vector<float> thinNs;
+        addNs.reserve(saves.size());
+        size_t deleted = 0;
+
+        auto start = Clock::now();
+        for (SaveGame& save : saves) {
+            auto found = chains.find(save.GetChainId());
+            if (found == chains.end()) found = chains.emplace(save.GetChainId(), SaveChain(userVars)).first;
+            SaveChain& chain = found->second;
+
+            auto addStart = Clock::now();
+            chain.AddSave(std::move(save));
+            std::chrono::duration<float, std::nano> elapsed = Clock::now() - addStart;
+
+            size_t dropped = chain.TakeDeletedSaves().size();
+            (dropped ? thinNs : addNs).push_back(elapsed.count());
+            deleted += dropped;
+        }
+        std::chrono::duration<double, std::milli> totalMs = Clock::now() - start;
+
+        Report("add", saves.size(), {
+            { "total_ms", totalMs.count() },
+            { "saves_per_s", saves.size() / (totalMs.count() / 1000.0) },
+            { "p50_ns", Percentile(addNs, 0.5) },
+            { "p99_ns", Percentile(addNs, 0.99) },
+            { "max_ns", Percentile(addNs, 1.0) },
+        });
+        Report("thin", thinNs.size(), {
+            { "deleted", static_cast<double>(deleted) },
+            { "p50_ns", Percentile(thinNs, 0.5) },
+            { "p99_ns", Percentile(thinNs, 0.99) },
+            { "max_ns", Percentile(thinNs, 1.0) },
+            { "peak_mb", PeakMemoryMb() },
+        });
+    }
+
+    // Stand-in for a save: runs of records that differ in a few fields, as the game writes changed forms,
+    // broken up by stretches of noise like the parts of a save that are already compressed
+    std::vector<char> MakeSyntheticSave(size_t bytes, std::mt19937& random) {
+        std::vector<char> data(bytes);
+        std::uniform_int_distribution<int> byte(0, 255);
+        size_t pos = 0;
+        while (pos < bytes) {
+            size_t run = std::min<size_t>(bytes - pos, 4096 + random() % 65536);
+            if (random() % 3 == 0) {
+                for (size_t i = 0; i < run; i++) data[pos + i] = static_cast<char>(byte(random));
+            }
+            else {
+                char record[48];
+                for (char& c : record) c = static_cast<char>(byte(random) & 0x0F);
+                for (size_t i = 0; i < run; i++) {
+                    if (i % sizeof(record) == 0) record[random() % 8] = static_cast<char>(byte(random));
+                    data[pos + i] = record[i % sizeof(record)];
+                }
+            }
+            pos += run;
+        }
+        return data;
+    }
+
+    void WriteFile(const std::filesystem::path& path, const std::vector<char>& data) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+    }
+
+    // The next save of a playthrough: most of the previous save with a few records changed,
+    // and a few stretches inserted or removed so that everything after them shifts
+    void MutateSyntheticSave(std::vector<char>& data, std::mt19937& random) {
+        for (int edit = 0; edit < 32; edit++) {
+            size_t pos = random() % data.size();
+            size_t run = std::min<size_t>(data.size() - pos, 16 + random() % 512);
+            switch (random() % 4) {
+                case 0:
+                    data.insert(data.begin() + pos, run, static_cast<char>(random()));
+                    break;
+                case 1:
+                    data.erase(data.begin() + pos, data.begin() + pos + run);
+                    break;
+                default:
+                    for (size_t i = 0; i < run; i++) data[pos + i] = static_cast<char>(random());
+                    break;
+            }
+        }
+    }
+
+    // Archives a set of saves into one chain archive, then restores each of them
+    // Uses the saves of a real folder when one is given, synthetic ones otherwise
+    void BenchArchive(const std::string& saveDir, size_t saveCount, size_t saveMb, std::uint32_t seed) {
+        std::error_code error;
+        std::filesystem::path workDir = std::filesystem::temp_directory_path(error) / ("SaveBenchArchive" + std::to_string(seed));
+        std::filesystem::remove_all(workDir, error);
+        std::filesystem::create_directories(workDir / "restored", error);
+
+        std::vector<std::filesystem::path> files;
+        if (!saveDir.empty()) {
+            for (const auto& entry : std::filesystem::directory_iterator(saveDir, error)) {
+                std::filesystem::path extension = entry.path().extension();
+                if (entry.is_regular_file() && (extension == ".ess" || extension == ".skse")) files.push_back(entry.path());
+            }
+            std::sort(files.begin(), files.end());
+            if (files.size() > saveCount * 2) files.resize(saveCount * 2);
+        }
+        else {
+            std::mt19937 random(seed);
+            for (size_t i = 0; i < saveCount; i++) {
+                files.push_back(workDir / ("Save" + std::to_string(i + 1) + ".ess"));
+                WriteFile(files.back(), MakeSyntheticSave(saveMb * 1024 * 1024, random));
+            }
+        }
+        if (files.empty()) {
+            fprintf(stderr, "No saves to archive in %s\n", saveDir.c_str());
+            return;
+        }
+
+        std::string archivePath = (workDir / "bench.ssa").string();
+        ArchiveStats archived;
+        auto start = Clock::now();
+        for (const std::filesystem::path& file : files) {
+            if (!AppendToArchive(archivePath, file.string(), &archived)) fprintf(stderr, "Could not archive %s\n", file.string().c_str());
+        }
+        double archiveSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        ArchiveStats restored;
+        std::vector<float> restoreMs;
+        start = Clock::now();
+        for (const ArchiveEntry& entry : ListArchive(archivePath)) {
+            auto restoreStart = Clock::now();
+            if (!ExtractFromArchive(archivePath, entry, (workDir / "restored" / entry.fileName).string(), &restored)) {
+                fprintf(stderr, "Could not restore %s\n", entry.fileName.c_str());
+            }
+            restoreMs.push_back(std::chrono::duration<float, std::milli>(Clock::now() - restoreStart).count());
+        }
+        double restoreSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::filesystem::remove_all(workDir, error);
+
+        double rawMb = archived.rawBytes / (1024.0 * 1024.0);
+        Report("archive", files.size(), {
+            { "raw_mb", rawMb },
+            { "ratio_pct", archived.rawBytes ? 100.0 * archived.storedBytes / archived.rawBytes : 0.0 },
+            { "archive_mb_per_s", rawMb / archiveSeconds },
+            { "restore_mb_per_s", restored.rawBytes / (1024.0 * 1024.0) / restoreSeconds },
+            { "restore_p50_ms", Percentile(restoreMs, 0.5) },
+            { "restore_max_ms", Percentile(restoreMs, 1.0) },
+        });
+    }
+
+    // Takes each chain into its own chunk store, save by save, then rehydrates every file
+    // Uses the saves of a real folder grouped by the chain id in their names when one is given, synthetic chains otherwise
+    void BenchDedup(const std::string& saveDir, size_t chainCount, size_t saveCount, size_t saveMb, std::uint32_t seed) {
+        std::error_code error;
+        std::filesystem::path workDir = std::filesystem::temp_directory_path(error) / ("SaveBenchDedup" + std::to_string(seed));
+        std::filesystem::remove_all(workDir, error);
+        std::filesystem::create_directories(workDir, error);
+
+        std::map<std::uint32_t, std::vector<std::filesystem::path>> chains;
+        if (!saveDir.empty()) {
+            for (const auto& entry : std::filesystem::directory_iterator(saveDir, error)) {
+                std::filesystem::path extension = entry.path().extension();
+                if (!entry.is_regular_file() || (extension != ".ess" && extension != ".skse")) continue;
+                chains[ParseSaveName(entry.path().stem().string()).chainId].push_back(entry.path());
+            }
+            for (auto& chainPair : chains) std::sort(chainPair.second.begin(), chainPair.second.end());
+        }
+        else {
+            std::mt19937 random(seed);
+            for (std::uint32_t chainId = 1; chainId <= chainCount; chainId++) {
+                std::vector<char> data = MakeSyntheticSave(saveMb * 1024 * 1024, random);
+                for (size_t i = 0; i < saveCount; i++) {
+                    if (i) MutateSyntheticSave(data, random);
+                    chains[chainId].push_back(workDir / ("Chain" + std::to_string(chainId) + "Save" + std::to_string(i + 1) + ".ess"));
+                    WriteFile(chains[chainId].back(), data);
+                }
+            }
+        }
+        if (chains.empty()) {
+            fprintf(stderr, "No saves to store in %s\n", saveDir.c_str());
+            return;
+        }
+
+        for (const auto& chainPair : chains) {
+            std::filesystem::path storeDir = workDir / ("Store" + std::to_string(chainPair.first));
+            ChunkStore store;
+            if (!store.Open(storeDir.string())) {
+                fprintf(stderr, "Could not open a chunk store in %s\n", storeDir.string().c_str());
+                continue;
+            }
+
+            ChunkStoreStats ingested;
+            auto start = Clock::now();
+            for (const std::filesystem::path& file : chainPair.second) {
+                if (!store.Ingest(file.string(), &ingested)) fprintf(stderr, "Could not store %s\n", file.string().c_str());
+            }
+            double ingestSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            std::uint64_t rehydratedBytes = 0;
+            start = Clock::now();
+            for (const std::filesystem::path& file : chainPair.second) {
+                std::filesystem::path outputPath = workDir / "rehydrated";
+                if (!store.Rehydrate(file.filename().string(), outputPath.string())) {
+                    fprintf(stderr, "Could not rehydrate %s\n", file.filename().string().c_str());
+                    continue;
+                }
+                rehydratedBytes += std::filesystem::file_size(outputPath, error);
+                std::filesystem::remove(outputPath, error);
+            }
+            double rehydrateSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            char bench[32];
+            snprintf(bench, sizeof(bench), "dedup_%08X", chainPair.first);
+            double rawMb = ingested.rawBytes / (1024.0 * 1024.0);
+            double packMb = store.GetPackBytes() / (1024.0 * 1024.0);
+            Report(bench, chainPair.second.size(), {
+                { "raw_mb", rawMb },
+                { "pack_mb", packMb },
+                { "dedup_ratio", packMb > 0.0 ? rawMb / packMb : 0.0 },
+                { "new_chunk_pct", ingested.chunks ? 100.0 * ingested.newChunks / ingested.chunks : 0.0 },
+                { "avg_chunk_kb", ingested.chunks ? ingested.rawBytes / 1024.0 / ingested.chunks : 0.0 },
+                { "ingest_mb_per_s", rawMb / ingestSeconds },
+                { "rehydrate_mb_per_s", rehydratedBytes / (1024.0 * 1024.0) / rehydrateSeconds },
+            });
+        }
+        std::filesystem::remove_all(workDir, error);
+    }
+
+    bool WriteJson(const std::string& path, std::uint32_t seed) {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) return false;
+
+        fprintf(file, "{\n  \"seed\": %u,\n  \"results\": [", seed);
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& result = results[i];
+            fprintf(file, "%s\n    {\"bench\": \"%s\", \"saves\": %zu", i ? "," : "", result.bench.c_str(), result.saves);
+            for (const auto& metric : result.metrics) fprintf(file, ", \"%s\": %.6g", metric.first.c_str(), metric.second);
+            fprintf(file, "}");
+        }
+        fprintf(file, "\n  ]\n}\n");
+        return fclose(file) == 0;
+    }
+
+    // The directory_iterator listing that SaveManager used before ListSaveFolder
+    std::unordered_map<std::string, std::uint64_t> LegacyListSaveFiles(const std::string& saveDir) {
+        std::unordered_map<std::string, std::uint64_t> saveNames;
+        std::unordered_map<std::string, std::uint64_t> skseSizes;
+        for (const auto& entry : std::filesystem::directory_iterator(saveDir)) {
+            if (!entry.is_regular_file()) continue;
+            std::string saveName = entry.path().stem().string();
+            if (saveName.length() <= 4 || saveName.substr(0, 4) != "Save") continue;
+
+            std::error_code error;
+            std::uint64_t size = entry.file_size(error);
+            if (error) size = 0;
+            if (entry.path().extension() == ".ess") saveNames[std::move(saveName)] += size;
+            else if (entry.path().extension() == ".skse") skseSizes.emplace(std::move(saveName), size);
+        }
+        for (const auto& sksePair : skseSizes) {
+            auto found = saveNames.find(sksePair.first);
+            if (found != saveNames.end()) found->second += sksePair.second;
+        }
+        return saveNames;
+    }
+
+    // Lists a save folder the old and the new way, the files are cached by the first run so both are warm
+    // Uses a real folder when one is given, otherwise one with .skse mirrors, autosaves and other files mixed in
+    void BenchEnumerate(const std::string& saveDir, size_t saveCount, std::uint32_t seed) {
+        std::error_code error;
+        std::filesystem::path workDir = std::filesystem::temp_directory_path(error) / ("SaveBenchEnumerate" + std::to_string(seed));
+        std::string listDir = saveDir;
+        if (listDir.empty()) {
+            std::filesystem::remove_all(workDir, error);
+            std::filesystem::create_directories(workDir, error);
+            listDir = workDir.string();
+
+            std::mt19937 random(seed);
+            std::vector<std::string> names = MakeWorkload(saveCount, std::max<size_t>(1, saveCount / 1000), seed);
+            for (size_t i = 0; i < names.size(); i++) {
+                WriteFile(workDir / (names[i] + ".ess"), std::vector<char>(1 + random() % 256));
+                if (random() % 4) WriteFile(workDir / (names[i] + ".skse"), std::vector<char>(1 + random() % 64));
+                if (random() % 10 == 0) WriteFile(workDir / ("Autosave" + std::to_string(i) + ".ess"), std::vector<char>(16));
+                if (random() % 20 == 0) WriteFile(workDir / ("notes" + std::to_string(i) + ".txt"), std::vector<char>(16));
+            }
+        }
+
+        constexpr int runs = 9;
+        std::vector<float> legacyMs;
+        std::vector<float> listMs;
+        std::unordered_map<std::string, std::uint64_t> legacySaves;
+        std::unordered_map<std::string, std::uint64_t> listedSaves;
+        for (int run = 0; run < runs; run++) {
+            auto start = Clock::now();
+            legacySaves = LegacyListSaveFiles(listDir);
+            legacyMs.push_back(std::chrono::duration<float, std::milli>(Clock::now() - start).count());
+
+            // Moved into a map like SaveManager::ListSaveFiles, so both sides hand over the same thing
+            start = Clock::now();
+            std::vector<ListedSave> listed;
+            ListSaveFolder(listDir, listed);
+            listedSaves.clear();
+            listedSaves.reserve(listed.size());
+            for (ListedSave& save : listed) listedSaves.emplace(std::move(save.saveName), save.stat.size);
+            listMs.push_back(std::chrono::duration<float, std::milli>(Clock::now() - start).count());
+        }
+        if (saveDir.empty()) std::filesystem::remove_all(workDir, error);
+
+        double legacy = Percentile(legacyMs, 0.5);
+        double list = Percentile(listMs, 0.5);
+        Report("enumerate", listedSaves.size(), {
+            { "legacy_ms", legacy },
+            { "list_ms", list },
+            { "speedup", list > 0 ? legacy / list : 0.0 },
+            { "identical", legacySaves == listedSaves ? 1.0 : 0.0 },
+        });
+    }
+
+    std::vector<size_t> ParseSizes(const char* list) {
+        std::vector<size_t> sizes;
+        for (const char* cur = list; *cur;) {
+            char* end = nullptr;
+            unsigned long long size = strtoull(cur, &end, 10);
+            if (end == cur) break;
+            if (size) sizes.push_back(static_cast<size_t>(size));
+            cur = *end == ',' ? end + 1 : end;
+        }
+        std::sort(sizes.begin(), sizes.end());
+        return sizes;
+    }
+
+    void PrintUsage() {
+        printf("Usage: SaveBench [--sizes 10000,100000,1000000] [--chains N] [--seed N] [--threads N] [--ini SaveManager.ini] [--json results.json]\n");
+        printf("                 [--archive-saves N] [--archive-mb N] [--archive-dir <save folder>]\n");
+        printf("                 [--dedup-chains N] [--dedup-saves N] [--dedup-mb N] [--dedup-dir <save folder>]\n");
+        printf("                 [--enum-saves N] [--enum-dir <save folder>]\n");
+        printf("  --chains   Playthroughs per workload, defaults to one per 1000 saves\n");
+        printf("  --threads  Pool threads besides the caller, defaults to what the plugin uses\n");
+        printf("  --archive-saves  Saves to archive and restore, 0 skips the archive bench, defaults to 8\n");
+        printf("  --archive-mb     Size of each synthetic save, defaults to 8\n");
+        printf("  --archive-dir    Archives the saves of a real folder instead of synthetic ones\n");
+        printf("  --dedup-chains   Synthetic chains to take into chunk stores, 0 skips the dedup bench, defaults to 2\n");
+        printf("  --dedup-saves    Saves per synthetic chain, each a small edit of the one before, defaults to 8\n");
+        printf("  --dedup-mb       Size of the first save of each synthetic chain, defaults to 8\n");
+        printf("  --dedup-dir      Stores the saves of a real folder by chain instead of synthetic ones\n");
+        printf("  --enum-saves     Saves in the synthetic folder listed by the enumerate bench, 0 skips it, defaults to 10000\n");
+        printf("  --enum-dir       Lists a real save folder instead of a synthetic one\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = { 10000, 100000, 1000000 };
+    size_t chainCount = 0;
+    size_t threadCount = GetDefaultWorkerCount();
+    std::uint32_t seed = 1234;
+    std::string iniPath;
+    std::string jsonPath;
+    size_t archiveSaves = 8;
+    size_t archiveMb = 8;
+    std::string archiveDir;
+    size_t dedupChains = 2;
+    size_t dedupSaves = 8;
+    size_t dedupMb = 8;
+    std::string dedupDir;
+    size_t enumSaves = 10000;
+    std::string enumDir;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (hasValue && strcmp(argv[i], "--sizes") == 0) sizes = ParseSizes(argv[++i]);
+        else if (hasValue && strcmp(argv[i], "--chains") == 0) chainCount = std::stoull(argv[++i]);
+        else if (hasValue && strcmp(argv[i], "--threads") == 0) threadCount = std::stoull(argv[++i]);
+        else if (hasValue && strcmp(argv[i], "--seed") == 0) seed = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+        else if (hasValue && strcmp(argv[i], "--ini") == 0) iniPath = argv[++i];
+        else if (hasValue && strcmp(argv[i], "--json") == 0) jsonPath = argv[++i];
+        else if (hasValue && strcmp(argv[i], "--archive-saves") == 0) archiveSaves = std::stoull(argv[++i]);
+        else if (hasValue && strcmp(argv[i], "--archive-mb") == 0) archiveMb = std::stoull(argv[++i]);
+        else if (hasValue && strcmp(argv[i], "--archive-dir") == 0) archiveDir = argv[++i];
+        else if (hasValue && strcmp(argv[i], "--dedup-chains") == 0) dedupChains = std::stoull(argv[++i]);
+        else if (hasValue && strcmp(argv[i], "--dedup-saves") == 0) dedupSaves = std::stoull(argv[++i]);
+        else if (hasValue && strcmp(argv[i], "--dedup-mb") == 0) dedupMb = std::stoull(argv[++i]);
+        else if (hasValue && strcmp(argv[i], "--dedup-dir") == 0) dedupDir = argv[++i];
+        else if (hasValue && strcmp(argv[i], "--enum-saves") == 0) enumSaves = std::stoull(argv[++i]);
+        else if (hasValue && strcmp(argv[i], "--enum-dir") == 0) enumDir = argv[++i];
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (sizes.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    // Without an ini the plugin defaults are used
+    UserVars userVars = ReadUserVars(iniPath);
+
+    for (size_t size : sizes) {
+        std::vector<std::string> names = MakeWorkload(size, chainCount ? chainCount : std::max<size_t>(1, size / 1000), seed);
+        BenchBuild(names, userVars);
+        BenchIncremental(names, userVars);
+        BenchPool(names, userVars, threadCount);
+    }
+    BenchParse(sizes.back());
+    if (archiveSaves) BenchArchive(archiveDir, archiveSaves, archiveMb, seed);
+    if (dedupChains || !dedupDir.empty()) BenchDedup(dedupDir, dedupChains, dedupSaves, dedupMb, seed);
+    if (enumSaves || !enumDir.empty()) BenchEnumerate(enumDir, enumSaves, seed);
+
+    if (!jsonPath.empty() && !WriteJson(jsonPath, seed)) {
+        fprintf(stderr, "Cannot write %s\n", jsonPath.c_str());
+        return 1;
+    }
+    return 0;
+}
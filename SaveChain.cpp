@@ -0,0 +1,460 @@
+#include "SaveChain.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <span>
+
+#include <spdlog/spdlog.h>
+
+#include "Metrics.h"
+
+namespace {
+    // Gives each save missing its game time the time AddSave would give it if the saves arrived in number order
+    void PlaceMissingGameTimes(std::vector<SaveGame>& saves) {
+        if (std::none_of(saves.begin(), saves.end(), [](const SaveGame& save) { return save.IsMissingGameTime(); })) return;
+
+        std::vector<size_t> byNumber(saves.size());
+        for (size_t i = 0; i < saves.size(); i++) byNumber[i] = i;
+        std::stable_sort(byNumber.begin(), byNumber.end(), [&saves](size_t a, size_t b) {
+            return saves[a].GetNumber() < saves[b].GetNumber();
+        });
+
+        // Saves numbered before the first one with a game time count down from it, the rest count up from the one before
+        size_t first = std::find_if(byNumber.begin(), byNumber.end(), [&saves](size_t i) {
+            return !saves[i].IsMissingGameTime();
+        }) - byNumber.begin();
+        if (first == byNumber.size()) {
+            first = 0;
+            saves[byNumber[0]].SetGameTime(0);
+        }
+        for (size_t i = first; i-- > 0;) {
+            saves[byNumber[i]].SetGameTime(saves[byNumber[i + 1]].GetTime() - 1);
+        }
+        for (size_t i = first + 1; i < byNumber.size(); i++) {
+            if (saves[byNumber[i]].IsMissingGameTime()) saves[byNumber[i]].SetGameTime(saves[byNumber[i - 1]].GetTime() + 1);
+        }
+    }
+
+    // Walks from the oldest save to the newest, each kept save sets the target time of the next one
+    // Of the last save before the target and the first save after it, the one closer to the target is kept
+    // Returns the indices of the saves to delete, block holds the saves of one block newest first
+    // Block is any random access sequence of SaveRecord, the chain's own records or Cascade's window
+    // The spacing is a run-time value from sTierLayout, there is no per-tier specialisation to pick at compile time
+    template <typename Block>
+    std::vector<size_t> SelectThinned(const Block& block, float desiredSpacing) {
+        std::vector<size_t> toDelete;
+        size_t end = block.size();
+        time_t spacing = static_cast<time_t>(desiredSpacing * 3600.0);
+        if (end < 3 || spacing <= 0) return toDelete;
+
+        size_t kept = end - 1;         // Last save kept, the oldest save of the block to begin with
+        size_t pending = end;          // Save short of the target that may still be kept, end if there is none
+        for (size_t i = end - 1; i-- > 0;) {
+            time_t target = block[kept].time + spacing;
+            if (block[i].time >= target && pending != end && target - block[pending].time < block[i].time - target) {
+                // The save just short of the target is closer to it, this save is measured from that one instead
+                kept = pending;
+                pending = end;
+                target = block[kept].time + spacing;
+            }
+
+            if (block[i].time < target) {
+                if (pending != end) toDelete.push_back(pending);
+                pending = i;
+            }
+            else {
+                if (pending != end) toDelete.push_back(pending);
+                kept = i;
+                pending = end;
+            }
+        }
+
+        // The newest save is left pending when it is short of the target, it is kept until a newer save replaces it
+        return toDelete;
+    }
+}
+
+void SaveChain::CleanBlocks() {
+    const int tierCount = userVars.tierCount;
+
+    // A block is only thinned once it is full, the last block also whenever saves reach it
+    bool spilled = false;
+    for (int block = PrimaryBlock; block < tierCount; block++) {
+        const RetentionTier& tier = userVars.tiers[block];
+        bool last = block == tierCount - 1;
+        bool reached = spilled;
+        bool full = tier.count >= 0 && BlockSize(block) > static_cast<size_t>(tier.count);
+        spilled = false;
+        if (!full && !(last && reached)) continue;
+
+        // Optimize to match the desired time spacing
+        ThinBlock(block, tier.spacing);
+        if (tier.count < 0 || BlockSize(block) <= static_cast<size_t>(tier.count)) continue;
+
+        if (!last) {
+            // Move any overflow to the next block
+            blockEnds[block] = BlockBegin(block) + tier.count;
+            spilled = true;
+        }
+        else {
+            // Delete any excess (oldest first)
+            std::vector<size_t> excess;
+            for (size_t i = blockEnds[block]; i > BlockBegin(block) + tier.count; i--) {
+                excess.push_back(i - 1);
+            }
+            DeleteSaves(block, excess);
+        }
+    }
+}
+
+void SaveChain::ThinBlock(int block, float desiredSpacing) {
+    size_t begin = BlockBegin(block);
+    std::vector<size_t> toDelete = SelectThinned(std::span<const SaveRecord>(records).subspan(begin, BlockSize(block)), desiredSpacing);
+    for (size_t& index : toDelete) index += begin;
+    DeleteSaves(block, toDelete);
+}
+
+// The records are compacted in a single pass
+void SaveChain::DeleteSaves(int block, std::vector<size_t>& indices) {
+    if (indices.empty()) return;
+    std::sort(indices.begin(), indices.end());
+
+    std::vector<std::uint32_t> numbers;
+    numbers.reserve(indices.size());
+    for (size_t index : indices) {
+        const HeldSave* save = FindSave(records[index].number);
+        assert(save);
+        totalBytes -= save->size;
+        deletedSaves.push_back({ std::string(names.Get(save->name)), static_cast<SaveBlock>(block) });
+        names.Remove(save->name);
+        numbers.push_back(save->number);
+    }
+    std::sort(numbers.begin(), numbers.end());
+    std::erase_if(savesByNumber, [&numbers](const HeldSave& save) {
+        return std::binary_search(numbers.begin(), numbers.end(), save.number);
+    });
+
+    // Shift the kept records down over the deleted ones
+    size_t write = indices.front();
+    size_t next = 0;
+    for (size_t read = indices.front(); read < records.size(); read++) {
+        if (next < indices.size() && indices[next] == read) {
+            next++;
+            continue;
+        }
+        records[write++] = records[read];
+    }
+    records.resize(write);
+
+    for (int b = block; b < userVars.tierCount; b++) {
+        blockEnds[b] -= indices.size();
+    }
+    if (names.NeedsCompaction()) CompactNames();
+}
+
+void SaveChain::CompactNames() {
+    size_t liveBytes = 0;
+    for (const HeldSave& save : savesByNumber) {
+        liveBytes += save.name.length;
+    }
+
+    SaveNameArena compacted;
+    compacted.Reserve(liveBytes);
+    for (HeldSave& save : savesByNumber) {
+        save.name = compacted.Add(names.Get(save.name));
+    }
+    names = std::move(compacted);
+}
+
+bool SaveChain::InsertSave(SaveGame&& save) {
+    // Verify that the given save does not already exist
+    auto it = std::lower_bound(savesByNumber.begin(), savesByNumber.end(), save.GetNumber(), [](const HeldSave& held, std::uint32_t number) {
+        return held.number < number;
+    });
+    if (it != savesByNumber.end() && it->number == save.GetNumber()) {
+        // This happens because of bugged savefiles.
+        // Could delete them, but ignoring them is safer.
+        return false;
+    }
+
+    if (save.IsMissingGameTime()) save.SetGameTime(TimeFromNeighbours(save.GetNumber()));
+    SaveRecord record = { save.GetTime(), save.GetNumber() };
+    totalBytes += save.GetSize();
+    savesByNumber.insert(it, HeldSave{ save.GetNumber(), names.Add(save.GetSaveName()), save.GetSize() });
+
+    // Binary search for the first save that is older than this one, saves made in the same second go in name order
+    const std::string& saveName = save.GetSaveName();
+    size_t index = std::upper_bound(records.begin(), records.end(), record.time, [this, &saveName](time_t time, const SaveRecord& other) {
+        if (time != other.time) return time > other.time;
+        return saveName < names.Get(FindSave(other.number)->name);
+    }) - records.begin();
+
+    // The save joins the block of the next newer save, cleaning the blocks moves it on if that block is full
+    // Saves inserted out of time order end up in the same blocks only when a single clean follows them all
+    int block = PrimaryBlock;
+    while (index > 0 && block < LastBlock() && index - 1 >= blockEnds[block]) {
+        block++;
+    }
+
+    // Place the save in the correct spot inside it's block
+    records.insert(records.begin() + index, record);
+    for (int b = block; b < userVars.tierCount; b++) {
+        blockEnds[b]++;
+    }
+    return true;
+}
+
+time_t SaveChain::TimeFromNeighbours(std::uint32_t saveNumber) const {
+    auto it = std::lower_bound(savesByNumber.begin(), savesByNumber.end(), saveNumber, [](const HeldSave& held, std::uint32_t number) {
+        return held.number < number;
+    });
+    auto timeOf = [this](std::uint32_t number) {
+        return std::find_if(records.begin(), records.end(), [number](const SaveRecord& record) { return record.number == number; })->time;
+    };
+    if (it != savesByNumber.begin()) return timeOf(std::prev(it)->number) + 1;
+    if (it != savesByNumber.end()) return timeOf(it->number) - 1;
+    return 0;
+}
+
+bool SaveChain::AddSave(SaveGame save) {
+    if (!InsertSave(std::move(save))) return false;
+
+    //CheckBlockIntegrity(true);
+    UpdateSaveBlocks();
+    return true;
+}
+
+void SaveChain::BuildFromBatch(std::vector<SaveGame> saves) {
+    records.clear();
+    savesByNumber.clear();
+    names.Clear();
+    blockEnds = {};
+    totalBytes = 0;
+
+    PlaceMissingGameTimes(saves);
+
+    // Newest first, ties broken by name so that duplicate save numbers are resolved the same way every time
+    std::sort(saves.begin(), saves.end(), [](const SaveGame& a, const SaveGame& b) {
+        if (a.GetTime() != b.GetTime()) return a.GetTime() > b.GetTime();
+        return a.GetSaveName() < b.GetSaveName();
+    });
+
+    // Of two saves with the same number, the oldest is kept, as AddSave ignores the one that arrives second
+    std::vector<size_t> byNumber(saves.size());
+    for (size_t i = 0; i < saves.size(); i++) byNumber[i] = i;
+    std::stable_sort(byNumber.begin(), byNumber.end(), [&saves](size_t a, size_t b) {
+        return saves[a].GetNumber() < saves[b].GetNumber();
+    });
+    std::vector<bool> duplicate(saves.size());
+    size_t nameBytes = 0;
+    for (size_t i = 0; i < byNumber.size(); i++) {
+        duplicate[byNumber[i]] = i + 1 < byNumber.size() && saves[byNumber[i]].GetNumber() == saves[byNumber[i + 1]].GetNumber();
+        if (!duplicate[byNumber[i]]) nameBytes += saves[byNumber[i]].GetSaveName().size();
+    }
+
+    std::vector<SaveRecord> ordered;
+    ordered.reserve(saves.size());
+    savesByNumber.reserve(saves.size());
+    names.Reserve(nameBytes);
+    for (size_t i = 0; i < saves.size(); i++) {
+        if (duplicate[i]) continue;
+        const SaveGame& save = saves[i];
+        ordered.push_back({ save.GetTime(), save.GetNumber() });
+        totalBytes += save.GetSize();
+        savesByNumber.push_back({ save.GetNumber(), names.Add(save.GetSaveName()), save.GetSize() });
+    }
+    std::sort(savesByNumber.begin(), savesByNumber.end(), [](const HeldSave& a, const HeldSave& b) {
+        return a.number < b.number;
+    });
+    Cascade(std::move(ordered));
+
+    // Most of a large batch is usually thinned away, the room reserved for it is given back
+    savesByNumber.shrink_to_fit();
+}
+
+// The records are already newest first, so they only have to run through the blocks again
+void SaveChain::Rebuild(const UserVars& newVars) {
+    userVars = newVars;
+    Cascade(std::exchange(records, {}));
+}
+
+// Each block only ever sees the saves the block before it lets go of, one at a time and oldest first
+// So the blocks are run one after another, each over the whole stream the block before it passed on
+// A limited block still replays every arrival and thins its window each time, rather than thinning the stream once:
+// which save a thin keeps depends on the window it saw, so a single pass would keep different saves than AddSave does
+// That costs O(n * count) per block, the window is a deque so each arrival is added at the front in constant time
+void SaveChain::Cascade(std::vector<SaveRecord> ordered) {
+    PhaseTimer timer(MetricPhase::Thin);
+    records.clear();
+    blockEnds = {};
+
+    std::vector<std::pair<std::uint32_t, SaveBlock>> deleted;
+    std::vector<SaveRecord> stream = std::move(ordered);
+    std::deque<SaveRecord> window;
+    for (int block = PrimaryBlock; block < userVars.tierCount; block++) {
+        const RetentionTier& tier = userVars.tiers[block];
+        bool last = block == LastBlock();
+        std::vector<SaveRecord> passedOn;
+        window.clear();
+
+        // The window is compacted in a single pass
+        auto thin = [&window, &deleted, &tier, block]() {
+            std::vector<size_t> toDelete = SelectThinned(window, tier.spacing);
+            if (toDelete.empty()) return;
+            std::sort(toDelete.begin(), toDelete.end());
+            size_t kept = 0;
+            for (size_t j = 0, next = 0; j < window.size(); j++) {
+                if (next < toDelete.size() && toDelete[next] == j) {
+                    deleted.emplace_back(window[j].number, block);
+                    next++;
+                    continue;
+                }
+                window[kept++] = window[j];
+            }
+            window.resize(kept);
+            std::reverse(deleted.end() - toDelete.size(), deleted.end()); // Oldest first, as before
+        };
+
+        if (last && tier.count < 0) {
+            // A block without a limit is thinned each time a save reaches it, which keeps the same saves as thinning them all at once
+            window.assign(stream.begin(), stream.end());
+            thin();
+        }
+        else {
+            // As CleanBlocks does for each save AddSave places: a full block is thinned, then passes its oldest save on
+            // The last block is thinned whenever a save reaches it and deletes its oldest saves instead
+            size_t limit = static_cast<size_t>(tier.count);
+            for (size_t i = stream.size(); i-- > 0;) {
+                window.push_front(stream[i]);
+                if (window.size() <= limit && !last) continue;
+
+                thin();
+                while (window.size() > limit) {
+                    if (last) deleted.emplace_back(window.back().number, block);
+                    else passedOn.push_back(window.back());
+                    window.pop_back();
+                }
+            }
+        }
+
+        records.insert(records.end(), window.begin(), window.end());
+        blockEnds[block] = records.size();
+
+        // Passed on oldest first, the next block takes them newest first like the rest
+        std::reverse(passedOn.begin(), passedOn.end());
+        stream = std::move(passedOn);
+    }
+
+    // Deleted saves are let go of in one batch once every block has run
+    std::vector<std::uint32_t> numbers;
+    numbers.reserve(deleted.size());
+    for (const auto& [number, block] : deleted) {
+        const HeldSave* save = FindSave(number);
+        assert(save);
+        totalBytes -= save->size;
+        deletedSaves.push_back({ std::string(names.Get(save->name)), block });
+        names.Remove(save->name);
+        numbers.push_back(number);
+    }
+    std::sort(numbers.begin(), numbers.end());
+    std::erase_if(savesByNumber, [&numbers](const HeldSave& save) {
+        return std::binary_search(numbers.begin(), numbers.end(), save.number);
+    });
+    if (names.NeedsCompaction()) CompactNames();
+    records.shrink_to_fit();
+}
+
+bool SaveChain::RemoveSave(std::uint32_t saveNumber, std::string_view saveName) {
+    // Both entries are found before either is touched, a failed lookup leaves the chain as it was
+    auto it = std::lower_bound(savesByNumber.begin(), savesByNumber.end(), saveNumber, [](const HeldSave& held, std::uint32_t number) {
+        return held.number < number;
+    });
+    if (it == savesByNumber.end() || it->number != saveNumber || names.Get(it->name) != saveName) {
+        return false;
+    }
+    auto recordIt = std::find_if(records.begin(), records.end(), [saveNumber](const SaveRecord& record) {
+        return record.number == saveNumber;
+    });
+    if (recordIt == records.end()) return false;
+
+    totalBytes -= it->size;
+    names.Remove(it->name);
+    savesByNumber.erase(it);
+    size_t index = recordIt - records.begin();
+    records.erase(recordIt);
+    for (int b = PrimaryBlock; b < userVars.tierCount; b++) {
+        if (blockEnds[b] > index) blockEnds[b]--;
+    }
+
+    // A block only passes saves on once it is full, so every block before a non-empty one is full
+    // Each block short of its count takes the newest saves of the next, down through every tier
+    for (int b = PrimaryBlock; b < LastBlock(); b++) {
+        while (BlockSize(b) < static_cast<size_t>(userVars.tiers[b].count) && BlockSize(b + 1) > 0) {
+            blockEnds[b]++;
+        }
+    }
+    return true;
+}
+
+bool SaveChain::GetOldestTime(SaveBlock block, time_t& time) const {
+    if (block > LastBlock() || BlockSize(block) == 0) return false;
+    time = records[blockEnds[block] - 1].time;
+    return true;
+}
+
+bool SaveChain::DeleteOldest(SaveBlock block) {
+    if (block > LastBlock() || BlockSize(block) == 0) return false;
+    std::vector<size_t> oldest = { blockEnds[block] - 1 };
+    DeleteSaves(block, oldest);
+    return true;
+}
+
+void SaveChain::UpdateSaveBlocks() {
+    assert(CheckBlockIntegrity());
+    PhaseTimer timer(MetricPhase::Thin);
+    CleanBlocks();
+}
+
+bool SaveChain::CheckBlockIntegrity(bool log) const {
+    // Check to see if all saves are sorted correctly, which also keeps the blocks aligned
+    bool sorted = std::is_sorted(records.begin(), records.end(), [](const SaveRecord& a, const SaveRecord& b) {
+        return a.time > b.time;
+    });
+    if (log && !sorted) spdlog::error("Save records not sorted.");
+
+    // Check to see if the blocks cover every record
+    bool bounded = std::is_sorted(blockEnds.begin(), blockEnds.begin() + userVars.tierCount) &&
+        blockEnds[LastBlock()] == records.size() && records.size() == savesByNumber.size();
+    if (log && !bounded) spdlog::error("Save blocks do not match the save records.");
+
+    return sorted && bounded;
+}
+
+std::uint64_t ApplyFolderBudget(const std::vector<SaveChain*>& chains, std::uint64_t totalBytes, std::uint64_t maxBytes) {
+    int lastBlock = PrimaryBlock;
+    for (SaveChain* chain : chains) {
+        lastBlock = std::max(lastBlock, chain->GetTierCount() - 1);
+    }
+
+    // The primary block is never touched
+    for (SaveBlock block = lastBlock; block > PrimaryBlock && totalBytes > maxBytes; block--) {
+        while (totalBytes > maxBytes) {
+            SaveChain* oldestChain = nullptr;
+            time_t oldestTime = 0;
+            for (SaveChain* chain : chains) {
+                time_t time;
+                if (chain->GetOldestTime(block, time) && (!oldestChain || time < oldestTime)) {
+                    oldestChain = chain;
+                    oldestTime = time;
+                }
+            }
+            if (!oldestChain) break;
+
+            std::uint64_t before = oldestChain->GetTotalBytes();
+            oldestChain->DeleteOldest(block);
+            totalBytes -= before - oldestChain->GetTotalBytes();
+        }
+    }
+    return totalBytes;
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "SaveGame.h"
+#include "SaveNameArena.h"
+#include "UserVars.h"
+
+// Entry of a chain's time ordered save store, the rest of the save lives in savesByNumber
+struct SaveRecord {
+    time_t time;
+    std::uint32_t number;
+};
+
+// The rest of a held save, its name is kept in the chain's name arena
+struct HeldSave {
+    std::uint32_t number;
+    SaveNameRef name;
+    std::uint64_t size;
+};
+
+// A held save as the chain hands it out, the name is only valid until the chain changes
+struct SaveView {
+    std::string_view saveName;
+    std::uint32_t number;
+    time_t time;
+    std::uint64_t size;
+};
+
+// Index of a block in the tier layout, in the order saves cascade through them
+// The primary block is always first, saves are deleted once they leave the last block
+using SaveBlock = int;
+inline constexpr SaveBlock PrimaryBlock = 0;
+
+// Save let go of by a chain, with the block it was in when it was deleted
+struct DeletedSave {
+    std::string saveName;
+    SaveBlock block;
+};
+
+// Decides which saves of one playthrough are kept
+// The chain never touches the disk, deleted saves are collected for the caller to remove
+class SaveChain {
+private:
+    UserVars userVars;
+
+    // Every save in the chain, newest first
+    // Each block is a range of records, block b ends at blockEnds[b] and starts where the previous one ends
+    // Moving a save to the next block is a boundary move rather than a copy
+    std::vector<SaveRecord> records;
+    std::array<size_t, maxTierCount> blockEnds = {};
+    // Sorted by number, a flat array keeps the chain to a few allocations however many saves it holds
+    std::vector<HeldSave> savesByNumber;
+    SaveNameArena names;
+
+    // Saves deleted since the last call to TakeDeletedSaves
+    std::vector<DeletedSave> deletedSaves;
+
+    // Bytes of every save held, kept up to date on each insert and delete
+    std::uint64_t totalBytes = 0;
+
+    const HeldSave* FindSave(std::uint32_t saveNumber) const {
+        auto it = std::lower_bound(savesByNumber.begin(), savesByNumber.end(), saveNumber, [](const HeldSave& save, std::uint32_t number) {
+            return save.number < number;
+        });
+        return it != savesByNumber.end() && it->number == saveNumber ? &*it : nullptr;
+    }
+
+    size_t BlockBegin(int block) const {
+        return block == PrimaryBlock ? 0 : blockEnds[block - 1];
+    }
+
+    size_t BlockSize(int block) const {
+        return blockEnds[block] - BlockBegin(block);
+    }
+
+    int LastBlock() const {
+        return userVars.tierCount - 1;
+    }
+
+    // Thins and spills every block from the newest down
+    // Not specialised on a fixed block count: sTierLayout sets the count and every tier's size and spacing at run time,
+    // so a fixed bound is all a specialisation could fold, and the cost is in ThinBlock rather than the loop
+    void CleanBlocks();
+
+    // Keeps the saves whose spacing is closest to the desired spacing in a single sweep from the oldest save
+    // The oldest and newest saves of the block are always kept, the rest are deleted in one batch
+    void ThinBlock(int block, float desiredSpacing);
+
+    // Deletes the saves at the given record indices, which must all be inside the block
+    void DeleteSaves(int block, std::vector<size_t>& indices);
+
+    // Packs the names of the saves still held into a new arena
+    void CompactNames();
+
+    // Time for a save missing its game time: just after the save numbered before it, or just before the one after it
+    time_t TimeFromNeighbours(std::uint32_t saveNumber) const;
+
+    // Places the saves, given newest first, in the blocks they would be in had they been added one at a time in time order
+    void Cascade(std::vector<SaveRecord> ordered);
+
+    // Places a save in time order without cleaning up the blocks
+    // Returns false if the save was ignored
+    bool InsertSave(SaveGame&& save);
+
+public:
+    SaveChain(const UserVars& iniVariables) : userVars(iniVariables) {}
+
+    // Adds a single save that arrived after the chain was built
+    // Returns false if the save was ignored
+    bool AddSave(SaveGame save);
+
+    // Replaces the chain with the given saves, sorting them once and running each block over its saves in time order
+    // The saves kept and deleted are those AddSave would keep and delete given the saves one at a time in time order
+    void BuildFromBatch(std::vector<SaveGame> saves);
+
+    // Takes new user variables and places the saves already held again, as BuildFromBatch would
+    void Rebuild(const UserVars& newVars);
+
+    // Forgets a save whose files were removed outside of the manager
+    // Returns false if the chain does not hold a save with this number and name
+    bool RemoveSave(std::uint32_t saveNumber, std::string_view saveName);
+
+    bool HasSave(std::uint32_t saveNumber, std::string_view saveName) const {
+        const HeldSave* save = FindSave(saveNumber);
+        return save && names.Get(save->name) == saveName;
+    }
+
+    // Empty if the chain holds no saves, only valid until the chain changes
+    std::string_view GetNewestSaveName() const {
+        if (records.empty()) return {};
+        return names.Get(FindSave(records.front().number)->name);
+    }
+
+    std::vector<DeletedSave> TakeDeletedSaves() {
+        return std::exchange(deletedSaves, {});
+    }
+
+    size_t GetSaveCount() const {
+        return savesByNumber.size();
+    }
+
+    std::uint64_t GetTotalBytes() const {
+        return totalBytes;
+    }
+
+    int GetTierCount() const {
+        return userVars.tierCount;
+    }
+
+    // Time of the oldest save in the block, returns false if the block is empty
+    bool GetOldestTime(SaveBlock block, time_t& time) const;
+
+    // Deletes the oldest save in the block, returns false if the block is empty
+    bool DeleteOldest(SaveBlock block);
+
+    // Calls function(const SaveView&, SaveBlock) for every save still in the chain, newest first
+    template <typename Function>
+    void ForEachSave(Function&& function) const {
+        int block = PrimaryBlock;
+        for (size_t i = 0; i < records.size(); i++) {
+            while (i >= blockEnds[block]) block++;
+            const HeldSave* save = FindSave(records[i].number);
+            function(SaveView{ names.Get(save->name), records[i].number, records[i].time, save->size }, static_cast<SaveBlock>(block));
+        }
+    }
+
+    void UpdateSaveBlocks();
+
+    bool CheckBlockIntegrity(bool log = false) const;
+};
+
+// Deletes the oldest non-primary saves across all chains until their saves take up no more than maxBytes
+// Overflow saves go first, then tertiary, then secondary, and within a block the oldest save of any chain
+// Chains must be given in a stable order, it breaks ties between saves made in the same second
+// Returns the bytes still held, which is over maxBytes only if the primary blocks alone are larger
+std::uint64_t ApplyFolderBudget(const std::vector<SaveChain*>& chains, std::uint64_t totalBytes, std::uint64_t maxBytes);
@@ -0,0 +1,191 @@
+#include "SaveEnumerator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#include <filesystem>
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace {
+    enum class SaveFileKind {
+        None,
+        Ess,
+        Skse,
+    };
+
+    template <typename Char>
+    bool EndsWith(const Char* name, size_t length, const char* suffix, size_t suffixLength) {
+        if (length < suffixLength) return false;
+        for (size_t i = 0; i < suffixLength; i++) {
+            if (name[length - suffixLength + i] != static_cast<Char>(suffix[i])) return false;
+        }
+        return true;
+    }
+
+    // Length of the save name if the file is a save's .ess or .skse, 0 otherwise
+    // If the first 4 letters of the filename are not "Save" then move on (Autosave / Quicksave)
+    template <typename Char>
+    size_t MatchSaveFile(const Char* name, size_t length, SaveFileKind& kind) {
+        kind = SaveFileKind::None;
+        if (length <= 4 || name[0] != 'S' || name[1] != 'a' || name[2] != 'v' || name[3] != 'e') return 0;
+
+        size_t stemLength = 0;
+        if (EndsWith(name, length, ".ess", 4)) {
+            kind = SaveFileKind::Ess;
+            stemLength = length - 4;
+        }
+        else if (EndsWith(name, length, ".skse", 5)) {
+            kind = SaveFileKind::Skse;
+            stemLength = length - 5;
+        }
+        if (stemLength <= 4) kind = SaveFileKind::None;
+        return kind == SaveFileKind::None ? 0 : stemLength;
+    }
+
+    // .skse files are set aside during the listing and folded into their saves once it is done
+    struct Listing {
+        std::vector<ListedSave>& saves;
+        std::vector<ListedSave> skseFiles;
+
+        void Add(SaveFileKind kind, std::string saveName, std::uint64_t size, time_t writeTime) {
+            if (kind == SaveFileKind::Ess) saves.push_back({ std::move(saveName), { size, writeTime } });
+            else skseFiles.push_back({ std::move(saveName), { size, 0 } });
+        }
+
+        // SKSE save mirrors are assumed to not exist without a .ess counterpart
+        void PairFiles() {
+            auto byName = [](const ListedSave& a, const ListedSave& b) {
+                return a.saveName < b.saveName;
+            };
+            std::sort(saves.begin(), saves.end(), byName);
+            std::sort(skseFiles.begin(), skseFiles.end(), byName);
+
+            auto save = saves.begin();
+            for (const ListedSave& skse : skseFiles) {
+                save = std::lower_bound(save, saves.end(), skse, byName);
+                if (save == saves.end()) break;
+                if (save->saveName == skse.saveName) save->stat.size += skse.stat.size;
+            }
+        }
+    };
+}
+
+#ifdef _WIN32
+
+bool ListSaveFolder(const std::string& dir, std::vector<ListedSave>& saves) {
+    saves.clear();
+    Listing listing{ saves, {} };
+
+    // The basic info level skips short names, and large fetch asks for many entries per call
+    std::wstring pattern = (std::filesystem::path(dir) / L"*").wstring();
+    WIN32_FIND_DATAW data = {};
+    HANDLE find = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND;
+
+    do {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+
+        SaveFileKind kind;
+        size_t stemLength = MatchSaveFile(data.cFileName, wcslen(data.cFileName), kind);
+        if (!stemLength) continue;
+
+        // Same code page as std::filesystem::path::string(), so the names can be turned back into paths
+        int length = WideCharToMultiByte(CP_ACP, 0, data.cFileName, static_cast<int>(stemLength), nullptr, 0, nullptr, nullptr);
+        if (length <= 0) continue;
+        std::string saveName(length, '\0');
+        WideCharToMultiByte(CP_ACP, 0, data.cFileName, static_cast<int>(stemLength), saveName.data(), length, nullptr, nullptr);
+
+        std::uint64_t size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+
+        // FILETIME counts 100ns intervals since 1601
+        std::uint64_t fileTime = (static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+        time_t writeTime = fileTime > 116444736000000000ull ? static_cast<time_t>((fileTime - 116444736000000000ull) / 10000000) : 0;
+
+        listing.Add(kind, std::move(saveName), size, writeTime);
+    } while (FindNextFileW(find, &data));
+
+    bool complete = GetLastError() == ERROR_NO_MORE_FILES;
+    FindClose(find);
+    listing.PairFiles();
+    return complete;
+}
+
+#else
+
+namespace {
+    // Entries that may be regular files are stat'd relative to the open folder, following links like the game would
+    void AddEntry(Listing& listing, int dirFd, const char* name, unsigned char type) {
+        if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN) return;
+
+        SaveFileKind kind;
+        size_t stemLength = MatchSaveFile(name, std::strlen(name), kind);
+        if (!stemLength) return;
+
+        struct stat status = {};
+        if (fstatat(dirFd, name, &status, 0) != 0 || !S_ISREG(status.st_mode)) return;
+        listing.Add(kind, std::string(name, stemLength), static_cast<std::uint64_t>(status.st_size), status.st_mtime);
+    }
+}
+
+bool ListSaveFolder(const std::string& dir, std::vector<ListedSave>& saves) {
+    saves.clear();
+    Listing listing{ saves, {} };
+
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd < 0) return false;
+
+#ifdef __linux__
+    // Fills a whole buffer of entries per call, readdir would copy them out one at a time
+    alignas(dirent64) char buffer[32 * 1024];
+    bool complete = true;
+    for (;;) {
+        long read = syscall(SYS_getdents64, dirFd, buffer, sizeof(buffer));
+        if (read < 0 && errno == EINTR) continue;
+        if (read <= 0) {
+            complete = read == 0;
+            break;
+        }
+        for (long offset = 0; offset < read;) {
+            const dirent64* entry = reinterpret_cast<const dirent64*>(buffer + offset);
+            offset += entry->d_reclen;
+            AddEntry(listing, dirFd, entry->d_name, entry->d_type);
+        }
+    }
+    close(dirFd);
+#else
+    DIR* folder = fdopendir(dirFd);
+    if (!folder) {
+        close(dirFd);
+        return false;
+    }
+    bool complete = true;
+    for (;;) {
+        errno = 0;
+        const dirent* entry = readdir(folder);
+        if (!entry) {
+            complete = errno == 0;
+            break;
+        }
+        AddEntry(listing, dirFd, entry->d_name, entry->d_type);
+    }
+    closedir(folder);
+#endif
+
+    listing.PairFiles();
+    return complete;
+}
+
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// Size and write time of a save's files as the folder listing reported them
+struct SaveFileStat {
+    std::uint64_t size = 0; // Of the .ess and .skse together
+    time_t writeTime = 0;   // Of the .ess, 0 if not known
+};
+
+struct ListedSave {
+    std::string saveName; // File name without the extension
+    SaveFileStat stat;
+};
+
+// Lists every Save*.ess in the folder with its .skse folded in, sorted by save name
+// Names are matched on the raw bytes of the listing, only saves are ever copied out of it
+// On Windows the listing is fetched in large batches that carry sizes and times, elsewhere the names come in
+// large batches and only the matching files are stat'd
+// Autosaves, quicksaves and .skse files without a .ess are left out, returns false if the folder cannot be listed
+bool ListSaveFolder(const std::string& dir, std::vector<ListedSave>& saves);
@@ -0,0 +1,34 @@
+#include "SaveGame.h"
+
+#include <optional>
+
+#include "EssHeader.h"
+
+SaveGame::SaveGame(std::string fileName) : saveName(std::move(fileName)) {
+    // Fields that Tod's intelligence made unreadable are left at 0
+    // A chain id of 0 is the same as what Tod does when he can't read the save id
+    ParsedSaveName parsed = ParseSaveName(saveName);
+    saveNumber = parsed.number;
+    chainId = parsed.chainId;
+    saveTime = static_cast<time_t>(parsed.time);
+    parseErrors = parsed.errors;
+}
+
+void SaveGame::ApplyHeader(const EssHeader* header, time_t writeTime, bool useGameTime) {
+    if (!header) {
+        if ((parseErrors & SaveNameBadTimestamp) && writeTime) SetWriteTime(writeTime);
+        if (useGameTime) SetMissingGameTime();
+        return;
+    }
+
+    if (parseErrors & SaveNameBadNumber) saveNumber = header->saveNumber;
+    // The FILETIME is true UTC while names hold the local wall-clock time
+    if ((parseErrors & SaveNameBadTimestamp) && header->GetSaveTime()) saveTime = static_cast<time_t>(UtcToNameTime(header->GetSaveTime()));
+
+    // A real time mixed in with game times would always sort as the newest save, so it is flagged instead
+    if (useGameTime) {
+        std::optional<std::int64_t> gameTime = header->GetGameTime();
+        if (gameTime) SetGameTime(static_cast<time_t>(*gameTime));
+        else SetMissingGameTime();
+    }
+}
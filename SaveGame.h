@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <utility>
+
+#include "SaveNameParser.h"
+
+struct EssHeader;
+
+// A save as read from the folder or the index, on its way into a chain
+// Chains keep only a compact record of it, so a SaveGame is moved along and never copied
+class SaveGame { // All save numbers are unique, but may be out of order by time
+private:
+    std::string saveName;
+    std::uint32_t saveNumber;
+    std::uint32_t chainId;
+    time_t saveTime;
+    std::uint64_t saveSize = 0; // Bytes of the .ess and .skse files together
+    std::uint8_t parseErrors;
+    bool missingGameTime = false;
+
+public:
+    SaveGame(std::string fileName);
+
+    // Restores a save that was already read on an earlier run
+    SaveGame(std::string fileName, std::uint32_t number, std::uint32_t chainId, time_t time)
+        : saveName(std::move(fileName)), saveNumber(number), chainId(chainId), saveTime(time), parseErrors(0) {}
+
+    SaveGame(SaveGame&&) = default;
+    SaveGame& operator=(SaveGame&&) = default;
+    SaveGame(const SaveGame&) = delete;
+    SaveGame& operator=(const SaveGame&) = delete;
+
+    // True if the name alone is not enough and the save's header should be read
+    bool NeedsHeader(bool useGameTime) const {
+        return useGameTime || (parseErrors & (SaveNameBadNumber | SaveNameBadTimestamp));
+    }
+
+    // Fills in what the name could not provide from the save's own header, null if it could not be read
+    // Without a header the file's write time stands in for an unreadable timestamp, 0 if that is unknown too
+    // The chain id is not stored in the header, so it cannot be recovered
+    void ApplyHeader(const EssHeader* header, time_t writeTime, bool useGameTime);
+
+    const std::string& GetSaveName() const {
+        return saveName;
+    }
+    std::uint32_t GetChainId() const {
+        return chainId;
+    }
+    std::uint32_t GetNumber() const {
+        return saveNumber;
+    }
+    time_t GetTime() const {
+        return saveTime;
+    }
+    std::uint64_t GetSize() const {
+        return saveSize;
+    }
+    // Sizes come from the folder listing, the name and header do not hold them
+    void SetSize(std::uint64_t size) {
+        saveSize = size;
+    }
+    // The file's write time stands in when neither the name nor the header has a readable time
+    // It is true UTC, so it is moved onto the wall-clock base of the names first
+    void SetWriteTime(time_t writeTime) {
+        saveTime = static_cast<time_t>(UtcToNameTime(writeTime));
+    }
+    // With bUseGameTime, a save whose game time could not be read has no time comparable to the others
+    // Its chain places it next to the saves numbered around it instead
+    bool IsMissingGameTime() const {
+        return missingGameTime;
+    }
+    void SetMissingGameTime() {
+        missingGameTime = true;
+    }
+    // Places a save that was missing its game time
+    void SetGameTime(time_t time) {
+        saveTime = time;
+        missingGameTime = false;
+    }
+    // SaveNameError flags for the fields that could not be read from the name
+    std::uint8_t GetParseErrors() const {
+        return parseErrors;
+    }
+};
@@ -0,0 +1,131 @@
+#include "SaveIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "SaveArchive.h"
+
+namespace {
+    constexpr char indexMagic[4] = { 'S', 'S', 'M', 'I' };
+    constexpr std::uint32_t indexVersion = 4;
+
+    // FNV-1a, continued from hash so several buffers can be chained
+    std::uint64_t Fnv1a(const void* data, size_t length, std::uint64_t hash = 14695981039346656037ull) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < length; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+}
+
+std::uint64_t HashSaveName(std::string_view name) {
+    return Fnv1a(name.data(), name.size());
+}
+
+std::int64_t GetDirWriteTime(const std::string& dir) {
+    std::error_code error;
+    auto writeTime = std::filesystem::last_write_time(dir, error);
+    if (error) return 0;
+    return static_cast<std::int64_t>(writeTime.time_since_epoch().count());
+}
+
+std::uint64_t GetIndexSourceHash(const std::string& saveDir, bool useGameTime) {
+    std::string normalized = std::filesystem::path(saveDir).lexically_normal().string();
+    return Fnv1a(&useGameTime, sizeof(useGameTime), HashSaveName(normalized));
+}
+
+bool SaveIndex::Open(const std::string& path, std::uint64_t sourceHash) {
+    header = nullptr;
+    records = {};
+    names = nullptr;
+    if (!file.Open(path)) return false;
+
+    std::span<const std::byte> bytes = file.GetBytes();
+    if (bytes.size() < sizeof(SaveIndexHeader)) return false;
+
+    const SaveIndexHeader* candidate = reinterpret_cast<const SaveIndexHeader*>(bytes.data());
+    if (std::memcmp(candidate->magic, indexMagic, sizeof(indexMagic)) != 0) return false;
+    if (candidate->version != indexVersion || candidate->sourceHash != sourceHash) return false;
+
+    // Sizes are checked before they are multiplied so a corrupt count cannot overflow
+    size_t body = bytes.size() - sizeof(SaveIndexHeader);
+    if (candidate->recordCount > body / sizeof(SaveIndexRecord)) return false;
+    if (candidate->recordCount * sizeof(SaveIndexRecord) + candidate->nameBytes != body) return false;
+    if (Fnv1a(bytes.data() + sizeof(SaveIndexHeader), body) != candidate->checksum) return false;
+
+    std::span<const SaveIndexRecord> candidateRecords(
+        reinterpret_cast<const SaveIndexRecord*>(bytes.data() + sizeof(SaveIndexHeader)), static_cast<size_t>(candidate->recordCount));
+    for (const SaveIndexRecord& record : candidateRecords) {
+        if (std::uint64_t(record.nameOffset) + record.nameLength > candidate->nameBytes) return false;
+    }
+
+    header = candidate;
+    records = candidateRecords;
+    names = reinterpret_cast<const char*>(records.data() + records.size());
+    return true;
+}
+
+const SaveIndexRecord* SaveIndex::Find(std::string_view name) const {
+    std::uint64_t hash = HashSaveName(name);
+    auto it = std::lower_bound(records.begin(), records.end(), hash, [](const SaveIndexRecord& record, std::uint64_t hash) {
+        return record.nameHash < hash;
+    });
+    for (; it != records.end() && it->nameHash == hash; ++it) {
+        if (GetName(*it) == name) return &*it;
+    }
+    return nullptr;
+}
+
+bool SaveIndex::Write(const std::string& path, std::uint64_t sourceHash, std::int64_t dirWriteTime, const std::vector<IndexedSave>& saves) {
+    std::vector<SaveIndexRecord> records;
+    records.reserve(saves.size());
+    std::string names;
+    for (const IndexedSave& save : saves) {
+        if (save.name.size() > UINT16_MAX) continue;
+
+        SaveIndexRecord record = {};
+        record.nameHash = HashSaveName(save.name);
+        record.time = save.time;
+        record.size = save.size;
+        record.number = save.number;
+        record.chainId = save.chainId;
+        record.nameOffset = static_cast<std::uint32_t>(names.size());
+        record.nameLength = static_cast<std::uint16_t>(save.name.size());
+        record.verified = save.verified ? 1 : 0;
+        record.crc = save.verified ? save.crc : 0;
+        records.push_back(record);
+        names.append(save.name);
+    }
+    std::sort(records.begin(), records.end(), [](const SaveIndexRecord& a, const SaveIndexRecord& b) {
+        return a.nameHash < b.nameHash;
+    });
+
+    SaveIndexHeader header = {};
+    std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = indexVersion;
+    header.recordCount = records.size();
+    header.nameBytes = names.size();
+    header.dirWriteTime = dirWriteTime;
+    header.sourceHash = sourceHash;
+    header.checksum = Fnv1a(names.data(), names.size(), Fnv1a(records.data(), records.size() * sizeof(SaveIndexRecord)));
+
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(SaveIndexRecord));
+        file.write(names.data(), names.size());
+        if (!file) return false;
+    }
+    // Flushed before the rename, or a crash could leave the new name pointing at data that never reached the disk
+    if (!FlushToDisk(tempPath)) return false;
+
+    std::error_code error;
+    std::filesystem::rename(tempPath, path, error);
+    return !error;
+}
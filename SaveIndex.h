@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+
+// One known save, fixed size so the record table can be used straight from the mapping
+// Records are sorted by nameHash, the names themselves follow the record table
+struct SaveIndexRecord {
+    std::uint64_t nameHash;
+    std::int64_t time;
+    std::uint64_t size;  // Bytes of the .ess and .skse files
+    std::uint32_t number;
+    std::uint32_t chainId;
+    std::uint32_t nameOffset;
+    std::uint16_t nameLength;
+    std::uint16_t verified;     // 1 if the .ess checked good, its CRC32C is then in crc
+    std::uint32_t crc;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(SaveIndexRecord) == 48);
+
+struct SaveIndexHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t recordCount;
+    std::uint64_t nameBytes;
+    std::int64_t dirWriteTime;   // Last write time of the save folder when it was listed
+    std::uint64_t sourceHash;    // Save folder and the settings that change how saves are read
+    std::uint64_t checksum;      // Of everything after the header
+};
+static_assert(sizeof(SaveIndexHeader) == 48);
+
+// Save as it is written to the index
+struct IndexedSave {
+    std::string_view name;
+    std::uint32_t number;
+    std::uint32_t chainId;
+    std::int64_t time;
+    std::uint64_t size;
+    bool verified = false;
+    std::uint32_t crc = 0;
+};
+
+std::uint64_t HashSaveName(std::string_view name);
+
+// Stamp of the save folder, a different stamp means saves may have been created or deleted since
+std::int64_t GetDirWriteTime(const std::string& dir);
+
+// Identifies the save folder and settings an index was written for
+std::uint64_t GetIndexSourceHash(const std::string& saveDir, bool useGameTime);
+
+// Binary index of every save the manager knew about, kept between sessions so startup does not reread the folder
+class SaveIndex {
+private:
+    MappedFile file;
+    const SaveIndexHeader* header = nullptr;
+    std::span<const SaveIndexRecord> records;
+    const char* names = nullptr;
+
+public:
+    // Maps and validates the index, returns false if it is missing, corrupt or written for another source
+    bool Open(const std::string& path, std::uint64_t sourceHash);
+
+    std::int64_t GetDirWriteTime() const {
+        return header->dirWriteTime;
+    }
+    std::span<const SaveIndexRecord> GetRecords() const {
+        return records;
+    }
+    std::string_view GetName(const SaveIndexRecord& record) const {
+        return { names + record.nameOffset, record.nameLength };
+    }
+
+    // Returns nullptr if the save is not in the index
+    const SaveIndexRecord* Find(std::string_view name) const;
+
+    // Replaces the index at path in one step, so a crash never leaves half an index behind
+    static bool Write(const std::string& path, std::uint64_t sourceHash, std::int64_t dirWriteTime, const std::vector<IndexedSave>& saves);
+};
@@ -1,551 +1,822 @@
-// Main script for SkyrimSaveManager
+#include "SaveManager.h"
 
-#include <thread>
-#include <chrono>
-#include <Windows.h>
-#include <spdlog/sinks/basic_file_sink.h>
-#include <spdlog/sinks/msvc_sink.h>
+#include <algorithm>
+#include <cassert>
 #include <filesystem>
-#include <shlobj.h>
-#include <shellapi.h>
+#include <map>
+#include <optional>
+
+#include <spdlog/spdlog.h>
+
+#include "ChunkStore.h"
+#include "ColdStorage.h"
+#include "EssHeader.h"
+#include "Metrics.h"
+#include "SaveArchive.h"
+#include "SaveIndex.h"
+#include "SaveNameParser.h"
+#include "SaveRemover.h"
+
+SaveManager::SaveManager(const UserVars& userVars, const std::string& saveDir, const std::string& indexPath,
+    std::function<bool()> deferDeletions, std::function<void()> onVerified, std::function<std::uint64_t()> outsideChangeCount)
+    : userVars(userVars), saveDir(saveDir), indexPath(indexPath), outsideChangeCount(std::move(outsideChangeCount)), onVerified(std::move(onVerified)) {
+    workerPool = std::make_unique<WorkerPool>(GetDefaultWorkerCount());
+    if (userVars.verifySaves) saveVerifier = std::make_unique<SaveVerifier>(this->onVerified);
+
+    // Saves the cold restore puts back are changes the queues did not make either
+    if (this->outsideChangeCount) {
+        this->outsideChangeCount = [this, count = std::move(this->outsideChangeCount)]() { return count() + restoredFiles.load(); };
+    }
 
-void LogDebugMsg(const std::string message) {
-    RE::ConsoleLog::GetSingleton()->Print(message.c_str());
-}
+    // Every remover that changes the save folder keeps knownWriteTime up with its own changes
+    auto stamped = [this](std::unique_ptr<SaveRemover> remover) {
+        return CreateStampingRemover(this->saveDir, knownWriteTime, this->outsideChangeCount, std::move(remover));
+    };
 
-std::string GetIniPath() {
-    char dllPathBuffer[MAX_PATH];
-    HMODULE hMod = nullptr;
+    // Recycling goes through the shell, which is kept to a single worker
+    if (userVars.dryRun) {
+        deletionQueue = std::make_unique<DeletionQueue>(CreateDryRunRemover(), 1);
+    }
+    else {
+        deletionQueue = std::make_unique<DeletionQueue>(stamped(CreateSaveRemover(userVars.recycle)), userVars.recycle ? 1 : 2);
+    }
 
-    if (GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCSTR)GetIniPath, &hMod)) {
-        GetModuleFileNameA(hMod, dllPathBuffer, MAX_PATH);
-        std::string dllPath(dllPathBuffer);
-        return dllPath.substr(0, dllPath.find_last_of("/\\")) + "\\SaveManager.ini";
-    } else {
-        return std::string("C:\\");
+    // A single archiving worker bounds the memory spent on compression, and recycling would keep the space archiving frees
+    if (userVars.archiveOverflow && !userVars.dryRun) {
+        archiveQueue = std::make_unique<DeletionQueue>(stamped(CreateArchivingRemover(GetArchiveDir(saveDir), CreateSaveRemover(false))), 1);
     }
-}
 
-class IniReader {
-private:
-    std::string iniPath;
-    std::string iniSection;
+    // Old saves are moved into the chunk store one at a time, like archiving
+    std::string storeDir = GetChunkStoreDir(saveDir);
+    if (userVars.dedupOldSaves && !userVars.dryRun) {
+        chunkStore = std::make_unique<ChunkStore>();
+        if (chunkStore->Open(storeDir)) {
+            storeQueue = std::make_unique<DeletionQueue>(stamped(CreateChunkStoreRemover(*chunkStore, CreateSaveRemover(false))), 1);
+        }
+        else {
+            spdlog::warn("Could not open the chunk store in {}, old saves are left as they are", storeDir);
+            chunkStore.reset();
+        }
+    }
+    else if (!userVars.dryRun) {
+        RestoreChunkStore(storeDir);
+    }
 
-public:
-    IniReader(const std::string& path, const std::string& iniSection) {
-        this->iniPath = path;
-        this->iniSection = iniSection;
+    // Saves moved out under an earlier sColdSaveFolder are brought back in the background, scans pick them up as they land
+    // A new cold folder is only used from the first start after all of them are back
+    bool coldRestoring = false;
+    std::string previousColdDir = ReadColdFolderPointer(saveDir);
+    if (!previousColdDir.empty() && !userVars.dryRun &&
+        std::filesystem::path(previousColdDir).lexically_normal() != std::filesystem::path(userVars.coldSaveFolder).lexically_normal()) {
+        coldRestoring = true;
+        coldRestoreThread = std::jthread([this, previousColdDir](std::stop_token stopToken) {
+            LowerCurrentThreadPriority();
+            if (RestoreColdStorage(previousColdDir, stopToken)) WriteColdFolderPointer(this->saveDir, std::string());
+        });
     }
 
-    int ReadInt(const std::string& key, int default_) const {
-        return static_cast<int>(GetPrivateProfileIntA(iniSection.c_str(), key.c_str(), default_, iniPath.c_str()));
+    // Moves to the cold folder are mostly copies to a slower disk, one at a time is all it can take
+    if (!userVars.coldSaveFolder.empty() && !userVars.dryRun && !coldRestoring) {
+        coldStorage = std::make_unique<ColdStorage>();
+        if (coldStorage->Open(userVars.coldSaveFolder)) {
+            migrateQueue = std::make_unique<DeletionQueue>(stamped(CreateColdStorageRemover(*coldStorage, CreateSaveRemover(false))), 1);
+            // Only written when it changes, rewriting it would move the save folder's stamp on every start
+            if (previousColdDir != userVars.coldSaveFolder) WriteColdFolderPointer(saveDir, userVars.coldSaveFolder);
+        }
+        else {
+            spdlog::warn("Could not open the cold save folder {}, old saves are left in the save folder", userVars.coldSaveFolder);
+            coldStorage.reset();
+        }
     }
 
-    bool ReadBool(const std::string& key, const std::string& default_) const {
-        char buffer[6] = {};
-        GetPrivateProfileStringA(iniSection.c_str(), key.c_str(), default_.c_str(), buffer, sizeof(buffer), iniPath.c_str());
-        std::string value(buffer);
-        return value == "1" || value == "true" || value == "True" || value == "TRUE";
+    for (DeletionQueue* queue : { deletionQueue.get(), archiveQueue.get(), storeQueue.get(), migrateQueue.get() }) {
+        if (queue) queue->SetDeferCheck(deferDeletions);
     }
+    ApplyQueueSettings();
 
-    float ReadFloat(const std::string& key, float default_) const {
-        char buffer[32] = {};
-        GetPrivateProfileStringA(iniSection.c_str(), key.c_str(), std::to_string(default_).c_str(), buffer, sizeof(buffer), iniPath.c_str());
+    if (!RestoreFromIndex()) {
+        reset();
+    }
 
-        try {
-            return std::stof(std::string(buffer));
-        }
-        catch (const std::exception&) {
-            return default_;
-        }
+    // Files that were stored but not yet removed when the game last closed
+    if (chunkStore) {
+        std::vector<std::string> leftovers;
+        chunkStore->ForEachFile([this, &leftovers](const std::string& fileName, std::uint64_t) {
+            std::error_code error;
+            std::string path = (std::filesystem::path(this->saveDir) / fileName).string();
+            if (std::filesystem::exists(path, error)) leftovers.push_back(std::move(path));
+        });
+        if (!leftovers.empty()) storeQueue->Enqueue(leftovers);
     }
 
-    std::string ReadStr(const std::string& key, const std::string& default_) {
-        char buffer[255] = {};
-        GetPrivateProfileStringA(iniSection.c_str(), key.c_str(), default_.c_str(), buffer, sizeof(buffer), iniPath.c_str());
-        return std::string(buffer);
-    }
-};
-
-std::string GetDocPath() {
-    PWSTR path = nullptr;
-    std::string docPath = "C:\\";
-    if (SUCCEEDED(SHGetKnownFolderPath(FOLDERID_Documents, 0, NULL, &path))) {
-        int size_needed = WideCharToMultiByte(CP_UTF8, 0, path, -1, NULL, 0, NULL, NULL);
-        if (size_needed > 0) {
-            char* buffer = new char[size_needed];
-            WideCharToMultiByte(CP_UTF8, 0, path, -1, buffer, size_needed, NULL, NULL);
-            std::string strPath(buffer);
-            delete[] buffer;
-            docPath = strPath;
-        }
-        docPath += "\\My Games\\Skyrim Special Edition\\";
+    // Files of saves that were partly moved to the cold folder when the game last closed
+    if (coldStorage) {
+        std::vector<std::string> leftovers;
+        coldStorage->ForEachSave([this, &leftovers](const std::string& saveName, std::uint64_t) {
+            std::error_code error;
+            for (const char* extension : { ".ess", ".skse" }) {
+                std::string path = SaveFilePath(saveName, extension);
+                if (std::filesystem::exists(path, error)) leftovers.push_back(std::move(path));
+            }
+        });
+        if (!leftovers.empty()) migrateQueue->Enqueue(leftovers);
+    }
+}
 
-        CoTaskMemFree(path);
+void SaveManager::ApplyQueueSettings() {
+    auto minFileAge = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(userVars.minSaveAge));
+    for (DeletionQueue* queue : { deletionQueue.get(), archiveQueue.get(), storeQueue.get(), migrateQueue.get() }) {
+        if (!queue) continue;
+        queue->SetBudget(userVars.maxDeletesPerSecond, userVars.maxDeleteMBPerSecond * 1024.0 * 1024.0);
+        queue->SetMinFileAge(minFileAge);
     }
-    return docPath;
 }
 
-// This needs to be something that no sane indiviual would
-// use as their local save path
-#define undefinedPathStr "Undefined Local Path: Fk y0"
+void SaveManager::RestoreChunkStore(const std::string& storeDir) {
+    std::error_code error;
+    if (!std::filesystem::exists(storeDir, error)) return;
 
-std::string GetLocalSavePath(std::string docPath) {
-    std::string localSavePath(undefinedPathStr);
-    if (std::filesystem::exists(docPath + "SkyrimCustom.ini")) {
-        IniReader reader(docPath + "SkyrimCustom.ini", "General");
-        localSavePath = reader.ReadStr("SLocalSavePath", undefinedPathStr);
-    }
-    if (localSavePath == undefinedPathStr && std::filesystem::exists(docPath + "Skyrim.ini")) {
-        IniReader reader(docPath + "Skyrim.ini", "General");
-        localSavePath = reader.ReadStr("SLocalSavePath", undefinedPathStr);
+    ChunkStore store;
+    if (!store.Open(storeDir)) return;
+    std::vector<std::string> fileNames;
+    store.ForEachFile([&fileNames](const std::string& fileName, std::uint64_t) {
+        fileNames.push_back(fileName);
+    });
+
+    size_t failed = 0;
+    for (const std::string& fileName : fileNames) {
+        std::string path = (std::filesystem::path(saveDir) / fileName).string();
+        if (std::filesystem::exists(path, error)) continue;
+        if (!store.Rehydrate(fileName, path)) failed++;
     }
-    if (localSavePath == undefinedPathStr) {
-        localSavePath = "Saves/";
+    if (failed) {
+        spdlog::warn("Could not bring {} files back out of the chunk store, it is kept in {}", failed, storeDir);
+        return;
     }
-    
-    return localSavePath;
+    std::filesystem::remove_all(storeDir, error);
+    spdlog::info("bDedupOldSaves is off, moved {} files out of the chunk store", fileNames.size());
 }
 
-std::string GetSavePath() {
-    std::string docPath = GetDocPath();
-    return docPath + GetLocalSavePath(docPath);
-}
+bool SaveManager::RestoreColdStorage(const std::string& coldDir, std::stop_token stopToken) {
+    // A cold folder on a drive that is not connected must not be mistaken for an empty one
+    std::error_code error;
+    ColdStorage storage;
+    if (!std::filesystem::is_directory(coldDir, error) || !storage.Open(coldDir)) {
+        spdlog::warn("Could not open the earlier cold save folder {}, its saves stay there and no new cold folder is used until it is back", coldDir);
+        return false;
+    }
+    std::vector<std::string> saveNames;
+    storage.ForEachSave([&saveNames](const std::string& saveName, std::uint64_t) {
+        saveNames.push_back(saveName);
+    });
 
-class SaveGame { // All save numbers are unique, but may be out of order by time
-private:
-    const std::string saveName;
-    UINT32 saveNumber;
-    UINT32 chainId;
-    time_t saveTime;
-    
-    UINT32 CalcSaveNumber() {
-        // The save number is always in the first entry in the save name
-        // The save number is always followed by an _ and pre-fixed by "Save"
-        for (int i = 4; i < saveName.length(); i++) {
-            if (saveName[i] == '_') {
-                return (UINT32) std::stoull(saveName.substr(4, i - 4));
-            }
+    // The .ess goes last, a scan that sees it then also sees its .skse
+    size_t failed = 0;
+    for (const std::string& saveName : saveNames) {
+        if (stopToken.stop_requested()) {
+            spdlog::info("Stopped bringing saves back from {}, the rest come back on the next start", coldDir);
+            return false;
         }
-        return 0;
-    }
-    
-    time_t CalcSaveTime() {
-        // Timestamp is the 7th entry in the format YYYYMMDDHHMMSS
-        std::tm saveDate = { 0 };
-        char entryCount = 1;
-        for (size_t i = 0; i < saveName.length(); i++) {
-            if (entryCount == 7) {
-                saveDate.tm_year = std::stoi(saveName.substr(i, 4)) - 1900;
-                saveDate.tm_mon = std::stoi(saveName.substr(i + 4, 2)) - 1;
-                saveDate.tm_mday = std::stoi(saveName.substr(i + 6, 2));
-                saveDate.tm_hour = std::stoi(saveName.substr(i + 8, 2));
-                saveDate.tm_min = std::stoi(saveName.substr(i + 10, 2));
-                saveDate.tm_sec = std::stoi(saveName.substr(i + 12, 2));
-                break;
-            }
-            if (saveName[i] == '_') entryCount++;
+        bool restored = true;
+        for (const char* extension : { ".skse", ".ess" }) {
+            std::string fileName = saveName + extension;
+            std::string path = SaveFilePath(saveName, extension);
+            if (!storage.HoldsFile(fileName) || std::filesystem::exists(path, error)) continue;
+            restoredFiles++;
+            if (!storage.Restore(fileName, path)) restored = false;
+        }
+        if (!restored) {
+            failed++;
+            continue;
         }
-        return std::mktime(&saveDate);
-    }
 
-    UINT32 CalcChainId() {
-        // Chain Id is always the 2nd entry and is 8 digit hex
-        UINT32 saveId = 0;
-        char entryCount = 1;
-        for (int i = 0; i < saveName.length(); i++) {
-            if (entryCount == 2) {
-                saveId = (UINT32) std::stoull(saveName.substr(i, 8), nullptr, 16);
-                break;
-            }
-            if (saveName[i] == '_') entryCount++;
+        // Dropped from the cold folder only once both files are back
+        for (const std::string& path : storage.RemoveSave(saveName)) {
+            std::filesystem::remove(path, error);
         }
-        return saveId;
     }
+    if (failed) {
+        spdlog::warn("Could not bring {} saves back from the earlier cold save folder {}, they are kept there", failed, coldDir);
+        return false;
+    }
+    spdlog::info("sColdSaveFolder changed, moved {} saves back from {}", saveNames.size(), coldDir);
+    return true;
+}
 
-public:
-    // Needs to compile with this so that unordered_map[SaveId] can be used in checks
-    SaveGame() { throw std::out_of_range("Cannot construct a SaveGame without parameters"); }
+void SaveManager::StoreOldSaves() {
+    if (!chunkStore) return;
 
-    SaveGame(const std::string& fileName) : saveName(fileName) {
-        // Try to stop Tod's intelligence from screwing over the plugin
-        try {
-            saveNumber = CalcSaveNumber();
-        } catch (...) {
-            //LogDebugMsg("[SkyrimSaveManager] Error reading number of save:");
-            //LogDebugMsg(fileName);
-            saveNumber = 0;
-        }
-        try {
-            saveTime = CalcSaveTime(); // Possibly add option for using game time instead of irl time
-        } catch (...) {
-            // Possibly upgrade to reading metadata from the save as a backup
-            //LogDebugMsg("[SkyrimSaveManager] Error reading time of save:");
-            //LogDebugMsg(fileName);
-            saveTime = 0;
-        }
-        try {
-            chainId = CalcChainId();
-        } catch (...) {
-            //LogDebugMsg("[SkyrimSaveManager] Error reading Id of save:");
-            //LogDebugMsg(fileName);
-            chainId = 0; // Same as what Tod does when he can't read the save id
-        }
-    }
-    std::string GetSaveName() {
-        return saveName;
-    }
-    UINT32 GetChainId() {
-        return chainId;
-    }
-    UINT32 GetNumber() {
-        return saveNumber;
-    }
-    time_t GetTime() {
-        return saveTime;
-    }
-};
-
-// Documentation on user variables can be found in SaveManager.ini
-struct UserVars {
-    float pollTime;
-    bool recycle;
-    int primaryBlockCount;
-    int secondaryBlockCount;
-    float desiredSecondarySpacing;
-    int tertiaryBlockCount;
-    float desiredTertiarySpacing;
-    int maxOverflow;
-    float desiredOverflowSpacing;
-};
-
-class SaveChain {
-private:
-    UserVars userVars;
-    std::string saveDir;
-
-    std::vector<UINT32> primaryBlock;
-    std::vector<UINT32> secondaryBlock;
-    std::vector<UINT32> tertiaryBlock;
-    std::vector<UINT32> overflow;
-    std::unordered_map<UINT32, SaveGame> savesByNumber;
-
-    void CleanPrimaryBlock() {
-        // Move any overflow to the secondary block
-        while (primaryBlock.size() > userVars.primaryBlockCount) {
-            secondaryBlock.insert(secondaryBlock.begin(), primaryBlock.back());
-            primaryBlock.pop_back();
-        }
+    std::erase_if(storingSaves, [this](const std::string& saveName) {
+        return !knownSaves.contains(saveName) || chunkStore->HoldsSave(saveName);
+    });
+    for (const auto& chainPair : saveChainsById) {
+        chainPair.second.ForEachSave([this](const SaveView& save, SaveBlock block) {
+            // Cold blocks are left to MigrateOldSaves
+            if (block == PrimaryBlock || IsColdBlock(block) || storingSaves.contains(save.saveName)) return;
+            if (chunkStore->HoldsSave(save.saveName) || chunkStore->IsPinned(save.saveName)) return;
+
+            std::string saveName(save.saveName);
+            storeQueue->Enqueue({ SaveFilePath(saveName, ".ess"), SaveFilePath(saveName, ".skse") });
+            storingSaves.insert(std::move(saveName));
+        });
     }
+}
+
+bool SaveManager::IsColdBlock(SaveBlock block) const {
+    return coldStorage && block >= userVars.coldFromBlock - 1;
+}
 
-    void CleanSecondaryBlock() {
-        // Optimize to match the desired time spacing
-        for (long long i = secondaryBlock.size() - 1; i >= 2; i--) {
-            // If the time between the next next save and this save is less than or equal to the desired spacing
-            if ((savesByNumber[secondaryBlock[i - 2]].GetTime() -
-                savesByNumber[secondaryBlock[i]].GetTime()) <
-                userVars.desiredSecondarySpacing * 3600)
-            {
-                // It is save to delete the save inbetween them
-                DeleteSave(secondaryBlock, secondaryBlock[i - 1]);
+void SaveManager::MigrateOldSaves() {
+    if (!coldStorage) return;
+
+    std::erase_if(migratingSaves, [this](const std::string& saveName) {
+        return !knownSaves.contains(saveName) || coldStorage->HoldsSave(saveName);
+    });
+    std::error_code error;
+    for (const auto& chainPair : saveChainsById) {
+        chainPair.second.ForEachSave([this, &error](const SaveView& save, SaveBlock block) {
+            if (!IsColdBlock(block) || migratingSaves.contains(save.saveName) || coldStorage->HoldsSave(save.saveName)) return;
+            std::string saveName(save.saveName);
+
+            // A save stored while it was in a warmer block is brought back out to be moved, once the store is done with it
+            if (chunkStore && (storingSaves.contains(saveName) || chunkStore->IsPinned(saveName))) return;
+            if (chunkStore && chunkStore->HoldsSave(saveName)) {
+                RehydrateSave(saveName);
+                if (!std::filesystem::exists(SaveFilePath(saveName, ".ess"), error)) return;
+                chunkStore->RemoveSave(saveName);
             }
-        }
 
-        // Move any overflow to the tertiary block
-        while (secondaryBlock.size() > userVars.secondaryBlockCount) {
-            tertiaryBlock.insert(tertiaryBlock.begin(), secondaryBlock.back());
-            secondaryBlock.pop_back();
-        }
+            migrateQueue->Enqueue({ SaveFilePath(saveName, ".ess"), SaveFilePath(saveName, ".skse") });
+            migratingSaves.insert(std::move(saveName));
+        });
     }
+}
 
-    void CleanTertiaryBlock() {
-        // Optimize to match the desired time spacing
-        for (long long i = tertiaryBlock.size() - 1; i >= 2; i--) {
-            // If the time between the next next save and this save is less than or equal to the desired spacing
-            if ((savesByNumber[tertiaryBlock[i - 2]].GetTime() -
-                savesByNumber[tertiaryBlock[i]].GetTime()) <
-                userVars.desiredTertiarySpacing * 3600)
-            {
-                // It is save to delete the save inbetween them
-                DeleteSave(tertiaryBlock, tertiaryBlock[i - 1]);
-            }
-        }
+void SaveManager::RehydrateSave(const std::string& saveName) {
+    std::error_code error;
+    for (const char* extension : { ".ess", ".skse" }) {
+        std::string path = SaveFilePath(saveName, extension);
+        if (!chunkStore->HoldsFile(saveName + extension) || std::filesystem::exists(path, error)) continue;
+        if (!chunkStore->Rehydrate(saveName + extension, path)) spdlog::warn("Could not bring {} back out of the chunk store", path);
+    }
+}
 
-        // Move any overflow to the tertiary block
-        while (tertiaryBlock.size() > userVars.tertiaryBlockCount) {
-            overflow.insert(overflow.begin(), tertiaryBlock.back());
-            tertiaryBlock.pop_back();
-        }
+std::string SaveManager::SaveFilePath(const std::string& saveName, const char* extension) const {
+    return (std::filesystem::path(saveDir) / (saveName + extension)).string();
+}
+
+bool SaveManager::ListSaveFiles(std::unordered_map<std::string, SaveFileStat>& saveNames) {
+    PhaseTimer timer(MetricPhase::Enumerate);
+
+    // Taken first, anything that changes the folder during the listing makes the stamp stale
+    if (outsideChangeCount) listedOutsideChanges = outsideChangeCount();
+    listedWriteTime = GetDirWriteTime(saveDir);
+    knownWriteTime = listedWriteTime;
+
+    // Sizes come with the listing (on Windows without touching the files), so saves are never measured again
+    std::vector<ListedSave> listed;
+    if (!ListSaveFolder(saveDir, listed)) {
+        spdlog::warn("Could not list the save folder {}", saveDir);
+        return false;
+    }
+    saveNames.clear();
+    saveNames.reserve(listed.size());
+    for (ListedSave& save : listed) {
+        saveNames.emplace(std::move(save.saveName), save.stat);
     }
 
-    void CleanOverflow() {
-        // Match the desired time spacing
-        for (long long i = overflow.size() - 1; i >= 2; i--) {
-            // If the time between the next next save and this save is less than or equal to the desired spacing
-            if ((savesByNumber[overflow[i - 2]].GetTime() -
-                savesByNumber[overflow[i]].GetTime()) <
-                userVars.desiredOverflowSpacing * 3600)
-            {
-                // It is save to delete the save inbetween them
-                DeleteSave(overflow, overflow[i - 1]);
-            }
+    // Saves in the chunk store are still kept, they are listed as if they were in the folder
+    if (chunkStore) {
+        chunkStore->ForEachSave([&saveNames](const std::string& saveName, std::uint64_t bytes) {
+            saveNames.try_emplace(saveName, SaveFileStat{ bytes, 0 });
+        });
+
+        // A save can be stored again by the worker just after it was deleted
+        for (const std::string& saveName : pendingDeletes) {
+            if (chunkStore->HoldsSave(saveName)) chunkStore->RemoveSave(saveName);
         }
-        // Delete any excess
-        while (userVars.maxOverflow >= 0 && overflow.size() > userVars.maxOverflow) {
-            UINT32 saveToDelete = overflow.back();
-            DeleteSave(overflow, saveToDelete);
+    }
+
+    // Saves in cold storage are still kept, they are listed from its manifest without touching the cold folder
+    if (coldStorage) {
+        coldStorage->ForEachSave([&saveNames](const std::string& saveName, std::uint64_t bytes) {
+            saveNames.try_emplace(saveName, SaveFileStat{ bytes, 0 });
+        });
+
+        // A save can be moved again by the worker just after it was deleted
+        for (const std::string& saveName : pendingDeletes) {
+            if (!coldStorage->HoldsSave(saveName)) continue;
+            std::vector<std::string> coldPaths = coldStorage->RemoveSave(saveName);
+            deletionQueue->Enqueue(coldPaths);
         }
     }
 
-    bool RecycleFile(const std::string& filePath) {
-        // Convert string to wstring
-        int wlen = MultiByteToWideChar(CP_UTF8, 0, filePath.c_str(), -1, nullptr, 0);
-        if (wlen == 0) return false;
+    // Once a deleted save's file is gone it no longer needs to be skipped
+    std::erase_if(pendingDeletes, [&saveNames](const std::string& saveName) {
+        return saveNames.erase(saveName) == 0;
+    });
+    GetMetrics().Add(MetricCounter::FilesScanned, saveNames.size());
+    return true;
+}
 
-        std::wstring filePathW(wlen, 0);
-        MultiByteToWideChar(CP_UTF8, 0, filePath.c_str(), -1, &filePathW[0], wlen);
+SaveGame SaveManager::ReadSave(const std::string& saveName, const SaveFileStat& stat) {
+    PhaseTimer timer(MetricPhase::Parse);
+    Metrics& metrics = GetMetrics();
+    SaveGame save(saveName);
 
-        std::wstring doubleNullPath = filePathW + L'\0';
+    std::uint8_t errors = save.GetParseErrors();
+    if (errors & SaveNameBadNumber) metrics.Add(MetricCounter::ParseBadNumber);
+    if (errors & SaveNameBadChainId) metrics.Add(MetricCounter::ParseBadChainId);
+    if (errors & SaveNameBadTimestamp) metrics.Add(MetricCounter::ParseBadTimestamp);
 
-        SHFILEOPSTRUCTW fileOp = { 0 };
-        fileOp.wFunc = FO_DELETE;
-        fileOp.pFrom = doubleNullPath.c_str();
-        fileOp.fFlags = FOF_ALLOWUNDO | FOF_NOCONFIRMATION | FOF_SILENT;
+    // Only read the save itself when the name is not enough
+    if (save.NeedsHeader(userVars.useGameTime)) {
+        std::optional<EssHeader> header = ReadEssHeader(SaveFilePath(saveName, ".ess"));
+        if (!header && chunkStore && chunkStore->HoldsFile(saveName + ".ess")) {
+            header = ParseEssHeader(chunkStore->ReadPrefix(saveName + ".ess", essHeaderReadLimit));
+        }
+        if (!header && coldStorage && coldStorage->HoldsFile(saveName + ".ess")) {
+            header = ReadEssHeader(coldStorage->GetFilePath(saveName + ".ess"));
+        }
+        metrics.Add(MetricCounter::HeaderReads);
+        if (!header) metrics.Add(MetricCounter::HeaderFailures);
+        save.ApplyHeader(header ? &*header : nullptr, stat.writeTime, userVars.useGameTime);
+    }
+    save.SetSize(stat.size);
+    return save;
+}
 
-        int result = SHFileOperationW(&fileOp);
-        return (result == 0 && !fileOp.fAnyOperationsAborted);
+SaveChain& SaveManager::GetChain(std::uint32_t chainId) {
+    auto found = saveChainsById.find(chainId);
+    if (found == saveChainsById.end()) {
+        found = saveChainsById.emplace(chainId, SaveChain(userVars)).first;
     }
+    return found->second;
+}
 
-    void DeleteSave(std::vector<UINT32>& affectedBlock, UINT32 SaveNumber) {
-        // Collect the save to be deleted
-        SaveGame saveToRemove = std::move(savesByNumber[SaveNumber]);
-        // Remove the save from the SaveGame lookup map
-        savesByNumber.erase(SaveNumber);
+void SaveManager::ForgetDeletedSaves(SaveChain& chain) {
+    std::vector<DeletedSave> deletedSaves = chain.TakeDeletedSaves();
+    if (deletedSaves.empty()) return;
+    GetMetrics().Add(MetricCounter::SavesDeleted, deletedSaves.size());
+
+    // Every deleted save was known, so the chain id comes from the first of them
+    auto known = knownSaves.find(deletedSaves.front().saveName);
+    std::uint32_t chainId = known != knownSaves.end() ? known->second.chainId : 0;
+    bool hold = saveVerifier && known != knownSaves.end() && CheckPrimaryBlock(chainId, chain) != SaveCheck::Good;
+
+    for (DeletedSave& deletedSave : deletedSaves) {
+        // Held saves are already forgotten by the chain, pendingDeletes keeps them from being listed again
+        knownSaves.erase(deletedSave.saveName);
+        pendingDeletes.insert(deletedSave.saveName);
+        indexDirty = true;
+        if (hold) heldDeletes[chainId].push_back(std::move(deletedSave));
+        else RemoveDeletedSave(deletedSave);
+    }
+}
 
-        // Remove the save number from it's block
-        auto saveIt = std::find(affectedBlock.begin(), affectedBlock.end(), SaveNumber);
-        assert(saveIt != affectedBlock.end());
-        affectedBlock.erase(saveIt);
+void SaveManager::RemoveDeletedSave(const DeletedSave& deletedSave) {
+    // Hand the save's associated files to the deletion workers
+    const std::string& deletedName = deletedSave.saveName;
+    DeletionQueue& queue = archiveQueue && deletedSave.block == userVars.tierCount - 1 ? *archiveQueue : *deletionQueue;
 
-        // Remove the save's associated files
-        std::string fileName = saveDir + "\\" + saveToRemove.GetSaveName();
-        if (userVars.recycle) {
-            RecycleFile(fileName + ".ess");
-            RecycleFile(fileName + ".skse"); // silently fails if non-existent
-        }
-        else {
-            DeleteFileA((fileName + ".ess").c_str());
-            DeleteFileA((fileName + ".skse").c_str()); // silently fails if non-existent
-        }
+    // The archive only reads the save folder, so a stored save is brought back out for it first
+    if (chunkStore) {
+        if (&queue == archiveQueue.get()) RehydrateSave(deletedName);
+        chunkStore->RemoveSave(deletedName);
+        storingSaves.erase(deletedName);
+    }
+    if (saveVerifier) saveVerifier->Forget(SaveFilePath(deletedName, ".ess"));
+    reportedBadSaves.erase(deletedName);
+
+    // .skse is skipped if non-existent, the archive reads a save in cold storage where it is
+    std::vector<std::string> paths = { SaveFilePath(deletedName, ".ess"), SaveFilePath(deletedName, ".skse") };
+    if (coldStorage) {
+        std::vector<std::string> coldPaths = coldStorage->RemoveSave(deletedName);
+        paths.insert(paths.end(), coldPaths.begin(), coldPaths.end());
+        migratingSaves.erase(deletedName);
     }
+    queue.Enqueue(paths);
+}
+
+SaveCheck SaveManager::CheckPrimaryBlock(std::uint32_t chainId, const SaveChain& chain) {
+    if (!saveVerifier) return SaveCheck::Good;
 
-public:
-    SaveChain(UserVars& iniVariables, const std::string& saveDir) : userVars(iniVariables), saveDir(saveDir) {}
+    // Every save is checked, so all of them are queued at once rather than one per pass
+    SaveCheck blockCheck = SaveCheck::Good;
+    chain.ForEachSave([&](const SaveView& save, SaveBlock block) {
+        if (block != PrimaryBlock) return;
 
-    void AddSave(SaveGame save) {
-        // Verify that the given save does not already exist
-        auto it = savesByNumber.find(save.GetNumber());
-        if (it != savesByNumber.end()) {
-            // This happens because of bugged savefiles.
-            // Could delete them, but ignoring them is safer.
+        std::string saveName(save.saveName);
+        SaveVerifyResult result;
+        SaveCheck check = saveVerifier->Check(SaveFilePath(saveName, ".ess"), &result);
+        if (check == SaveCheck::Good) {
+            reportedBadSaves.erase(saveName);
             return;
         }
-
-        savesByNumber.emplace(save.GetNumber(), save);
-
-        // Find the correct block for the save to be in
-        std::vector<UINT32>* curBlockPtr = nullptr;
-        if (primaryBlock.size() < userVars.primaryBlockCount ||
-            save.GetTime() > savesByNumber[primaryBlock.back()].GetTime())
-        {
-            curBlockPtr = &primaryBlock;
+        if (check == SaveCheck::Bad) {
+            blockCheck = SaveCheck::Bad;
+            if (reportedBadSaves.insert(saveName).second) {
+                GetMetrics().Add(MetricCounter::SavesDamaged);
+                spdlog::warn("{} in chain {:08X} looks damaged ({}), older saves are kept until the primary block checks good",
+                    saveName, chainId, result.problem);
+            }
         }
-        else if (userVars.secondaryBlockCount > 0 &&
-            (secondaryBlock.size() < userVars.secondaryBlockCount ||
-             save.GetTime() > savesByNumber[secondaryBlock.back()].GetTime()))
-        {
-            curBlockPtr = &secondaryBlock;
+        else if (blockCheck == SaveCheck::Good) {
+            blockCheck = SaveCheck::Pending;
         }
-        else if (userVars.tertiaryBlockCount > 0 &&
-            (tertiaryBlock.size() < userVars.tertiaryBlockCount ||
-             save.GetTime() > savesByNumber[tertiaryBlock.back()].GetTime()))
-        {
-            curBlockPtr = &tertiaryBlock;
+    });
+    return blockCheck;
+}
+
+void SaveManager::ReleaseHeldDeletes() {
+    for (auto it = heldDeletes.begin(); it != heldDeletes.end();) {
+        // A chain that is gone has nothing left to protect
+        auto chain = saveChainsById.find(it->first);
+        if (saveVerifier && chain != saveChainsById.end() && CheckPrimaryBlock(it->first, chain->second) != SaveCheck::Good) {
+            ++it;
+            continue;
         }
-        else {
-            curBlockPtr = &overflow;
+        for (const DeletedSave& deletedSave : it->second) {
+            RemoveDeletedSave(deletedSave);
         }
+        it = heldDeletes.erase(it);
+        indexDirty = true;
+    }
+}
 
-        // Place the save in the correct spot inside it's block
+bool SaveManager::CheckDrift() {
+    size_t heldSaves = 0;
+    for (auto& gameInstancePair : saveChainsById) {
+        if (!gameInstancePair.second.CheckBlockIntegrity()) return true;
+        heldSaves += gameInstancePair.second.GetSaveCount();
+    }
+    size_t expectedSaves = 0;
+    for (const auto& knownPair : knownSaves) {
+        if (!knownPair.second.ignored) expectedSaves++;
+    }
+    return heldSaves != expectedSaves;
+}
 
-        // If the block is empty, it will be sorted with the 1 item
-        if (curBlockPtr->empty()) {
-            curBlockPtr->emplace_back(save.GetNumber());
-        }
-        else {
-            // Binary insertion
-            long long lowIndex = 0;
-            long long highIndex = curBlockPtr->size() - 1;
-            while (lowIndex <= highIndex) {
-                long long midIndex = (lowIndex + highIndex) / 2;
-                time_t midVal = savesByNumber[curBlockPtr->at(midIndex)].GetTime();
-
-                if (save.GetTime() < midVal) {
-                    lowIndex = midIndex + 1;
-                }
-                else {
-                    highIndex = midIndex - 1;
-                }
-            }
-            curBlockPtr->insert(curBlockPtr->begin() + lowIndex, save.GetNumber());
-        }
+void SaveManager::BuildChains(std::unordered_map<std::uint32_t, std::vector<SaveGame>> savesByChain) {
+    saveChainsById.clear();
+
+    // Chains are created up front so the workers never touch the map
+    struct BuildJob {
+        std::uint32_t chainId;
+        SaveChain* chain;
+        std::vector<SaveGame>* saves;
+    };
+    std::vector<BuildJob> jobs;
+    for (auto& batchPair : savesByChain) {
+        jobs.push_back({ batchPair.first, &GetChain(batchPair.first), &batchPair.second });
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const BuildJob& a, const BuildJob& b) { return a.chainId < b.chainId; });
 
-        //CheckBlockIntegrity(true);
-        UpdateSaveBlocks();
+    // Build each game instance in one pass, chains share nothing so they are built side by side
+    {
+        PhaseTimer timer(MetricPhase::Build);
+        workerPool->ParallelFor(jobs.size(), [&jobs](size_t i) {
+            jobs[i].chain->BuildFromBatch(std::move(*jobs[i].saves));
+        });
     }
 
-    void UpdateSaveBlocks() {
-        assert(CheckBlockIntegrity());
+    // Deletions are handed on in chain id order so they do not depend on which worker finished first
+    for (BuildJob& job : jobs) {
+        ForgetDeletedSaves(*job.chain);
+    }
+    for (auto& knownPair : knownSaves) {
+        KnownSave& known = knownPair.second;
+        known.ignored = !saveChainsById.at(known.chainId).HasSave(known.number, knownPair.first);
+    }
 
-        if (primaryBlock.size() > userVars.primaryBlockCount) {
-            CleanPrimaryBlock();
-        }
-        if (secondaryBlock.size() > userVars.secondaryBlockCount) {
-            CleanSecondaryBlock();
+    // Check integrety of each game instance
+    folderBytes = 0;
+    for (auto& gameInstancePair : saveChainsById) {
+        assert(gameInstancePair.second.CheckBlockIntegrity());
+        folderBytes += gameInstancePair.second.GetTotalBytes();
+    }
+    indexDirty = true;
+    EnforceFolderBudget();
+    StoreOldSaves();
+    MigrateOldSaves();
+}
+
+void SaveManager::EnforceFolderBudget() {
+    if (userVars.maxFolderMB < 0) return;
+    PhaseTimer timer(MetricPhase::Thin);
+
+    std::uint64_t maxBytes = static_cast<std::uint64_t>(userVars.maxFolderMB) * 1024 * 1024;
+    if (folderBytes > maxBytes) {
+        // Chain id order keeps ties between chains the same on every run
+        std::map<std::uint32_t, SaveChain*> chainsById;
+        for (auto& gameInstancePair : saveChainsById) {
+            chainsById.emplace(gameInstancePair.first, &gameInstancePair.second);
         }
-        if (tertiaryBlock.size() > userVars.tertiaryBlockCount) {
-            CleanTertiaryBlock();
+        std::vector<SaveChain*> chains;
+        for (auto& chainPair : chainsById) chains.push_back(chainPair.second);
+
+        std::uint64_t bytesBefore = folderBytes;
+        folderBytes = ApplyFolderBudget(chains, folderBytes, maxBytes);
+        for (SaveChain* chain : chains) {
+            ForgetDeletedSaves(*chain);
         }
-        if (overflow.size() > userVars.maxOverflow) {
-            CleanOverflow();
+        if (folderBytes != bytesBefore) {
+            spdlog::info("Deleted {:.1f} MB of saves to fit iMaxFolderMB = {}", (bytesBefore - folderBytes) / (1024.0 * 1024.0), userVars.maxFolderMB);
         }
     }
-    
-    bool CheckBlockIntegrity(bool log = false) {
-        // Check to see if all blocks are sorted correctly
-        bool primarySorted = std::is_sorted(primaryBlock.begin(), primaryBlock.end(), [this](UINT32 a, UINT32 b) {
-            return savesByNumber[a].GetTime() > savesByNumber[b].GetTime();
-        });
-        bool secondarySorted = std::is_sorted(secondaryBlock.begin(), secondaryBlock.end(), [this](UINT32 a, UINT32 b) {
-            return savesByNumber[a].GetTime() > savesByNumber[b].GetTime();
-        });
-        bool tertiarySorted = std::is_sorted(tertiaryBlock.begin(), tertiaryBlock.end(), [this](UINT32 a, UINT32 b) {
-            return savesByNumber[a].GetTime() > savesByNumber[b].GetTime();
-        });
-        bool overflowSorted = std::is_sorted(overflow.begin(), overflow.end(), [this](UINT32 a, UINT32 b) {
-            return savesByNumber[a].GetTime() > savesByNumber[b].GetTime();
-        });
-        if (log) {
-            if (!primarySorted) LogDebugMsg("Primary block not sorted.");
-            if (!secondarySorted) LogDebugMsg("Secondary block not sorted.");
-            if (!tertiarySorted) LogDebugMsg("Tertiary block not sorted.");
-            if (!overflowSorted) LogDebugMsg("Overflow not sorted.");
+
+    // Only logged once each time the folder goes over, every poll would find the same primary saves
+    bool primaryOverBudget = folderBytes > maxBytes;
+    if (primaryOverBudget && !overFolderBudget) {
+        spdlog::warn("Primary saves alone take {:.1f} MB, more than iMaxFolderMB = {}", folderBytes / (1024.0 * 1024.0), userVars.maxFolderMB);
+    }
+    overFolderBudget = primaryOverBudget;
+}
+
+bool SaveManager::RestoreFromIndex() {
+    if (indexPath.empty()) return false;
+
+    knownSaves.clear();
+    std::unordered_map<std::uint32_t, std::vector<SaveGame>> savesByChain;
+    size_t reread = 0;
+    if (!ReadIndex(savesByChain, reread)) return false;
+
+    // The index is no longer mapped here, Windows cannot replace a file that is still mapped
+    spdlog::info("Restored {} saves from the save index, {} read from disk", knownSaves.size(), reread);
+    BuildChains(std::move(savesByChain));
+    WriteIndex();
+    return true;
+}
+
+bool SaveManager::ReadIndex(std::unordered_map<std::uint32_t, std::vector<SaveGame>>& savesByChain, size_t& reread) {
+    SaveIndex index;
+    if (!index.Open(indexPath, GetIndexSourceHash(saveDir, userVars.useGameTime))) {
+        spdlog::info("No usable save index at {}, scanning the whole save folder", indexPath);
+        return false;
+    }
+
+    if (index.GetDirWriteTime() != 0 && index.GetDirWriteTime() == GetDirWriteTime(saveDir)) {
+        // Nothing was created or deleted since the index was written, the folder is not listed at all
+        if (outsideChangeCount) listedOutsideChanges = outsideChangeCount();
+        listedWriteTime = index.GetDirWriteTime();
+        knownWriteTime = listedWriteTime;
+        for (const SaveIndexRecord& record : index.GetRecords()) {
+            std::string saveName(index.GetName(record));
+            if (saveVerifier && record.verified) saveVerifier->Remember(SaveFilePath(saveName, ".ess"), record.crc);
+            knownSaves[saveName] = { record.chainId, record.number, false };
+            SaveGame& save = savesByChain[record.chainId].emplace_back(saveName, record.number, record.chainId, static_cast<time_t>(record.time));
+            save.SetSize(record.size);
         }
+    }
+    else {
+        // Only saves that are new or were rewritten since the last session are read again
+        std::unordered_map<std::string, SaveFileStat> saveFiles;
+        if (!ListSaveFiles(saveFiles)) return false;
+        for (auto& filePair : saveFiles) {
+            const std::string& saveName = filePair.first;
+            const SaveIndexRecord* record = index.Find(saveName);
+            if (saveVerifier && record && record->verified) saveVerifier->Remember(SaveFilePath(saveName, ".ess"), record->crc);
+            std::optional<SaveGame> save;
+            if (record && record->size == filePair.second.size) {
+                save.emplace(saveName, record->number, record->chainId, static_cast<time_t>(record->time));
+                save->SetSize(filePair.second.size);
+            }
+            else {
+                save.emplace(ReadSave(saveName, filePair.second));
+                reread++;
+            }
 
-        // Check to see if blocks are ordered correctly
-        bool ps_order = ((primaryBlock.empty() || secondaryBlock.empty()) ||
-            (savesByNumber[primaryBlock.back()].GetTime() >= savesByNumber[secondaryBlock.front()].GetTime()));
-        bool st_order = ((secondaryBlock.empty() || tertiaryBlock.empty()) ||
-            (savesByNumber[secondaryBlock.back()].GetTime() >= savesByNumber[tertiaryBlock.front()].GetTime()));
-        bool to_order = ((tertiaryBlock.empty() || overflow.empty()) ||
-            (savesByNumber[tertiaryBlock.back()].GetTime() >= savesByNumber[overflow.front()].GetTime()));
-        if (log) {
-            if (!ps_order) LogDebugMsg("Primary-Secondary blocks not aligned.");
-            if (!st_order) LogDebugMsg("Secondary-Tertiary blocks not aligned.");
-            if (!to_order) LogDebugMsg("Tertiary-Overflow blocks not aligned.");
+            knownSaves[saveName] = { save->GetChainId(), save->GetNumber(), false };
+            savesByChain[save->GetChainId()].push_back(std::move(*save));
         }
+    }
+    return true;
+}
 
-        return primarySorted && secondarySorted && tertiarySorted && overflowSorted && ps_order && st_order && to_order;
+void SaveManager::WriteIndex() {
+    if (indexPath.empty() || !indexDirty) return;
+
+    // Duplicates are not held by a chain, they are read again the next time the folder is listed
+    // Verified saves keep their CRC, so the next session only hashes them instead of walking them again
+    std::vector<IndexedSave> saves;
+    saves.reserve(knownSaves.size());
+    for (const auto& gameInstancePair : saveChainsById) {
+        std::uint32_t chainId = gameInstancePair.first;
+        gameInstancePair.second.ForEachSave([this, &saves, chainId](const SaveView& save, SaveBlock) {
+            IndexedSave& indexed = saves.emplace_back(save.saveName, save.number, chainId, save.time, save.size);
+            if (saveVerifier) indexed.verified = saveVerifier->GetGoodCrc(SaveFilePath(std::string(save.saveName), ".ess"), indexed.crc);
+        });
     }
-};
 
+    // Held saves are still on disk but in no chain, listing the folder finds them again
+    std::int64_t dirWriteTime = relistOnStart || !heldDeletes.empty() ? 0 : listedWriteTime;
+    if (SaveIndex::Write(indexPath, GetIndexSourceHash(saveDir, userVars.useGameTime), dirWriteTime, saves)) {
+        indexDirty = false;
+    }
+    else {
+        spdlog::warn("Could not write the save index to {}", indexPath);
+    }
+}
 
-class SaveManager {
-private:
-    // User variables
-    UserVars userVars;
+void SaveManager::reset() {
+    knownSaves.clear();
+
+    // Find and group every game instance based on save Ids
+    std::unordered_map<std::uint32_t, std::vector<SaveGame>> savesByChain;
+    std::unordered_map<std::string, SaveFileStat> saveFiles;
+    ListSaveFiles(saveFiles);
+    for (const auto& filePair : saveFiles) {
+        SaveGame save = ReadSave(filePair.first, filePair.second);
+        std::uint32_t chainId = save.GetChainId();
+        knownSaves[filePair.first] = { chainId, save.GetNumber(), false };
+        savesByChain[chainId].push_back(std::move(save));
+    }
 
-    // Datastructure for all save chains
-    std::unordered_map<UINT32, SaveChain> saveChainsById;
+    BuildChains(std::move(savesByChain));
+    WriteIndex();
+}
+
+void SaveManager::Shutdown(std::chrono::steady_clock::duration timeLimit) {
+    auto deadline = std::chrono::steady_clock::now() + timeLimit;
+    if (coldRestoreThread.joinable()) {
+        coldRestoreThread.request_stop();
+        coldRestoreThread.join();
+    }
+    size_t dropped = 0;
+    for (DeletionQueue* queue : { deletionQueue.get(), archiveQueue.get(), storeQueue.get(), migrateQueue.get() }) {
+        if (queue) dropped += queue->StopBy(deadline);
+    }
+    if (dropped) {
+        spdlog::info("Closing with {} files still queued, they are handled on the next start", dropped);
+        relistOnStart = true;
+    }
 
-public:
-    SaveManager() {
-        IniReader reader(GetIniPath(), "SaveManager");
+    // Saves verified during the session keep their CRC for the next one
+    if (dropped || saveVerifier) indexDirty = true;
+    WriteIndex();
+}
 
-        // Load ini vars
-        userVars.pollTime = reader.ReadFloat("fPollTime", 1.0);
-        userVars.recycle = reader.ReadBool("bRecycle", "false");
-        userVars.primaryBlockCount = reader.ReadInt("iPrimaryBlockCount", 16);
-        userVars.secondaryBlockCount = reader.ReadInt("iSecondaryBlockCount", 32);
-        userVars.desiredSecondarySpacing = reader.ReadFloat("fDesiredSecondarySpacing", 0.5);
-        userVars.tertiaryBlockCount = reader.ReadInt("iTertiaryBlockCount", 64);
-        userVars.desiredTertiarySpacing = reader.ReadFloat("fDesiredTertiarySpacing", 1.0);
-        userVars.maxOverflow = reader.ReadInt("iMaxOverflow", -1);
-        userVars.desiredOverflowSpacing = reader.ReadFloat("fDesiredOverflowSpacing", 4.0);
+bool SaveManager::NeedsUpdate() const {
+    if (!outsideChangeCount || outsideChangeCount() != listedOutsideChanges || !heldDeletes.empty()) return true;
+    std::int64_t writeTime = GetDirWriteTime(saveDir);
+    return writeTime == 0 || writeTime != knownWriteTime;
+}
 
-        // Clamp user input
-        if (userVars.primaryBlockCount < 1) userVars.primaryBlockCount = 1;
-        if (userVars.secondaryBlockCount < 0) userVars.secondaryBlockCount = 0;
-        if (userVars.tertiaryBlockCount < 0) userVars.tertiaryBlockCount = 0;
+void SaveManager::Update() {
+    // A folder that cannot be listed is left alone rather than treated as empty
+    std::unordered_map<std::string, SaveFileStat> saveNames;
+    if (!ListSaveFiles(saveNames)) return;
+    ReleaseHeldDeletes();
 
-        reset();
+    // Saves that were deleted (or renamed away) outside of the manager
+    std::vector<std::string> removedSaves;
+    for (const auto& knownPair : knownSaves) {
+        if (!saveNames.contains(knownPair.first)) removedSaves.push_back(knownPair.first);
     }
 
-    void reset() {
-        saveChainsById.clear();
-        // Find and group every game instance based on save Ids
-        for (const auto& entry : std::filesystem::directory_iterator(GetSavePath())) {
-            if (entry.is_regular_file() && entry.path().extension() == ".ess") {
-                // SKSE save mirrors are assumed to not exist without a .ess counterpart
-                // If the first 4 letters of the filename are not "Save" then move on (Autosave / Quicksave)
-                std::string saveName = entry.path().stem().string();
-                if (saveName.length() <= 4 || saveName.substr(0, 4) != "Save") continue;
-                
-                SaveGame curSave(saveName);
-                auto found = saveChainsById.find(curSave.GetChainId());
-                if (found != saveChainsById.end()) {
-                    SaveChain& chain = found->second;
-                    chain.AddSave(std::move(curSave));
-                } else {
-                    SaveChain chain(userVars, GetSavePath());
-                    UINT32 chainId = curSave.GetChainId();
-                    chain.AddSave(std::move(curSave));
-                    saveChainsById.emplace(chainId, std::move(chain));
-                }
-            }
+    for (const std::string& saveName : removedSaves) {
+        KnownSave known = knownSaves[saveName];
+        knownSaves.erase(saveName);
+        indexDirty = true;
+        GetMetrics().Add(MetricCounter::SavesRemovedExternally);
+        if (known.ignored) continue;
+
+        auto found = saveChainsById.find(known.chainId);
+        std::uint64_t chainBytes = found == saveChainsById.end() ? 0 : found->second.GetTotalBytes();
+        if (found == saveChainsById.end() || !found->second.RemoveSave(known.number, saveName)) {
+            reset();
+            return;
         }
-
-        // Check integrety of each game instance
-        for (auto& gameInstancePair : saveChainsById) {
-            assert(gameInstancePair.second.CheckBlockIntegrity());
+        folderBytes -= chainBytes - found->second.GetTotalBytes();
+        if (found->second.GetSaveCount() == 0) {
+            saveChainsById.erase(found);
         }
     }
 
-    float GetPollTime() {
-        return userVars.pollTime;
+    // Saves that were created (or renamed to) since the last scan, added in the order they were made
+    std::vector<SaveGame> addedSaves;
+    for (const auto& filePair : saveNames) {
+        if (!knownSaves.contains(filePair.first)) {
+            addedSaves.push_back(ReadSave(filePair.first, filePair.second));
+        }
     }
-};
+    std::sort(addedSaves.begin(), addedSaves.end(), [](const SaveGame& a, const SaveGame& b) {
+        if (a.GetTime() != b.GetTime()) return a.GetTime() < b.GetTime();
+        return a.GetSaveName() < b.GetSaveName();
+    });
 
+    // Each chain takes its own new saves in that order, the chains themselves are independent
+    struct AddJob {
+        SaveChain* chain = nullptr;
+        std::uint64_t bytesBefore = 0;
+        std::vector<SaveGame> saves;
+        std::vector<std::pair<std::string, KnownSave>> known;
+    };
+    std::map<std::uint32_t, AddJob> jobsByChain;
+    for (SaveGame& save : addedSaves) {
+        AddJob& job = jobsByChain[save.GetChainId()];
+        if (!job.chain) {
+            job.chain = &GetChain(save.GetChainId());
+            job.bytesBefore = job.chain->GetTotalBytes();
+        }
+        job.known.push_back({ save.GetSaveName(), { save.GetChainId(), save.GetNumber(), false } });
+        job.saves.push_back(std::move(save));
+    }
+    std::vector<AddJob*> jobs;
+    for (auto& jobPair : jobsByChain) jobs.push_back(&jobPair.second);
+
+    {
+        PhaseTimer timer(MetricPhase::Build);
+        workerPool->ParallelFor(jobs.size(), [&jobs](size_t i) {
+            AddJob& job = *jobs[i];
+            for (size_t j = 0; j < job.saves.size(); j++) {
+                job.known[j].second.ignored = !job.chain->AddSave(std::move(job.saves[j]));
+            }
+        });
+    }
+    GetMetrics().Add(MetricCounter::SavesAdded, addedSaves.size());
 
-void RunSaveManager() {
-    SaveManager manager;
+    // Merged in chain id order, saves deleted by the same update are forgotten right away
+    for (AddJob* job : jobs) {
+        for (auto& knownPair : job->known) {
+            knownSaves[knownPair.first] = knownPair.second;
+        }
+        indexDirty = true;
+        folderBytes = folderBytes - job->bytesBefore + job->chain->GetTotalBytes();
+        ForgetDeletedSaves(*job->chain);
+    }
+    EnforceFolderBudget();
 
-    while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds((int) (manager.GetPollTime() * 60)));
-        manager.reset();
+    if (CheckDrift()) {
+        reset();
+        return;
     }
+    StoreOldSaves();
+    MigrateOldSaves();
+    WriteIndex();
 }
 
-SKSEPluginLoad(const SKSE::LoadInterface *skse) {
-    SKSE::Init(skse);
+void SaveManager::ApplyUserVars(const UserVars& newVars) {
+    UserVars applied = newVars;
+    if (applied.recycle != userVars.recycle || applied.dryRun != userVars.dryRun || applied.archiveOverflow != userVars.archiveOverflow ||
+        applied.dedupOldSaves != userVars.dedupOldSaves || applied.coldSaveFolder != userVars.coldSaveFolder) {
+        spdlog::info("bRecycle, bDryRun, bArchiveOverflow, bDedupOldSaves and sColdSaveFolder take effect the next time the game starts");
+    }
+    applied.recycle = userVars.recycle;
+    applied.dryRun = userVars.dryRun;
+    applied.archiveOverflow = userVars.archiveOverflow;
+    applied.dedupOldSaves = userVars.dedupOldSaves;
+    applied.coldSaveFolder = userVars.coldSaveFolder;
+
+    bool rescan = applied.useGameTime != userVars.useGameTime;
+    bool rebuild = applied.tierCount != userVars.tierCount || applied.tiers != userVars.tiers;
+    bool rebudget = applied.maxFolderMB != userVars.maxFolderMB;
+    bool remigrate = applied.coldFromBlock != userVars.coldFromBlock;
+    userVars = applied;
+    ApplyQueueSettings();
+    spdlog::info("Reloaded the user variables");
+
+    // Without the verifier every held save is let go of right away
+    if (userVars.verifySaves && !saveVerifier) {
+        saveVerifier = std::make_unique<SaveVerifier>(onVerified);
+    }
+    else if (!userVars.verifySaves && saveVerifier) {
+        saveVerifier.reset();
+        ReleaseHeldDeletes();
+    }
+
+    // Save times come from the save headers instead of the names, every save has to be read again
+    if (rescan) {
+        reset();
+        return;
+    }
 
-    // Start subprocess for save management after other mods are loaded
-    SKSE::GetMessagingInterface()->RegisterListener([](SKSE::MessagingInterface::Message* message) {
-        if (message->type == SKSE::MessagingInterface::kDataLoaded) {
-            std::thread task(RunSaveManager);
-            task.detach();
+    if (rebuild) {
+        std::map<std::uint32_t, SaveChain*> chainsById;
+        for (auto& gameInstancePair : saveChainsById) {
+            chainsById.emplace(gameInstancePair.first, &gameInstancePair.second);
         }
-    });
+        std::vector<SaveChain*> chains;
+        for (auto& chainPair : chainsById) chains.push_back(chainPair.second);
 
-    return true;
+        {
+            PhaseTimer timer(MetricPhase::Build);
+            workerPool->ParallelFor(chains.size(), [this, &chains](size_t i) {
+                chains[i]->Rebuild(userVars);
+            });
+        }
+
+        folderBytes = 0;
+        for (SaveChain* chain : chains) {
+            ForgetDeletedSaves(*chain);
+            folderBytes += chain->GetTotalBytes();
+        }
+        indexDirty = true;
+    }
+    if (rebuild || rebudget || remigrate) {
+        EnforceFolderBudget();
+        StoreOldSaves();
+        MigrateOldSaves();
+        WriteIndex();
+    }
 }
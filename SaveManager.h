@@ -0,0 +1,189 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "ChunkStore.h"
+#include "ColdStorage.h"
+#include "DeletionQueue.h"
+#include "SaveChain.h"
+#include "SaveEnumerator.h"
+#include "SaveGame.h"
+#include "SaveVerifier.h"
+#include "UserVars.h"
+#include "WorkerPool.h"
+
+// Keeps every save chain in one save folder up to date and removes the saves they let go of
+class SaveManager {
+private:
+    // Where a known save file was placed on the last scan
+    struct KnownSave {
+        std::uint32_t chainId;
+        std::uint32_t number;
+        bool ignored; // Duplicate save number, not held by its chain
+    };
+
+    // User variables
+    UserVars userVars;
+    std::string saveDir;
+
+    // Known saves are kept here between sessions, empty to always scan the folder
+    std::string indexPath;
+    bool indexDirty = false;
+    bool relistOnStart = false; // Files were left behind on disk, the next start lists the folder instead of trusting the index
+    std::int64_t listedWriteTime = 0; // Save folder stamp taken before the last listing
+    // The stamp as the manager left the folder, moved on past the last listing by the queues' own removals
+    std::atomic<std::int64_t> knownWriteTime = 0;
+    // Changes the plugin saw the game make, and how many there were when the folder was last listed
+    std::function<std::uint64_t()> outsideChangeCount;
+    std::uint64_t listedOutsideChanges = 0;
+
+    // Datastructure for all save chains
+    std::unordered_map<std::uint32_t, SaveChain> saveChainsById;
+
+    // Every save file seen on the last scan, by name
+    std::unordered_map<std::string, KnownSave> knownSaves;
+
+    // Bytes of every save held by the chains, kept up to date on each add and delete
+    std::uint64_t folderBytes = 0;
+    bool overFolderBudget = false;
+
+    // Saves handed to the deletion queue whose files may still be on disk
+    std::unordered_set<std::string> pendingDeletes;
+
+    // Removes the files of deleted saves in the background
+    std::unique_ptr<DeletionQueue> deletionQueue;
+
+    // Compresses saves that leave the last block before removing them, only with bArchiveOverflow
+    std::unique_ptr<DeletionQueue> archiveQueue;
+
+    // Holds kept saves outside the primary block, only with bDedupOldSaves
+    // Saves are moved in by storeQueue, storingSaves are the ones it has not finished yet
+    std::unique_ptr<ChunkStore> chunkStore;
+    std::unique_ptr<DeletionQueue> storeQueue;
+    std::unordered_set<std::string, SaveNameHash, std::equal_to<>> storingSaves;
+
+    // Holds kept saves from iColdFromBlock on in another folder, only with sColdSaveFolder
+    // Saves are moved out by migrateQueue, migratingSaves are the ones it has not finished yet
+    std::unique_ptr<ColdStorage> coldStorage;
+    std::unique_ptr<DeletionQueue> migrateQueue;
+    std::unordered_set<std::string, SaveNameHash, std::equal_to<>> migratingSaves;
+
+    // Checks every save in the primary block of a chain before any of its older saves are removed, only with bVerifySaves
+    // Saves a chain lets go of while one of them is unchecked or damaged wait in heldDeletes, still on disk
+    // heldDeletes is not kept in the index, while it holds saves the index makes the next start list the folder and hold them again
+    std::unique_ptr<SaveVerifier> saveVerifier;
+    std::function<void()> onVerified;
+    std::unordered_map<std::uint32_t, std::vector<DeletedSave>> heldDeletes;
+    std::unordered_set<std::string> reportedBadSaves;
+
+    // Builds and thins independent chains side by side
+    std::unique_ptr<WorkerPool> workerPool;
+
+    // Brings saves back from a cold folder that sColdSaveFolder no longer points to, counting each file it puts in the save folder
+    // Declared last so it is stopped before anything it uses goes away
+    std::atomic<std::uint64_t> restoredFiles = 0;
+    std::jthread coldRestoreThread;
+
+    std::string SaveFilePath(const std::string& saveName, const char* extension) const;
+
+    // Every save in the folder with the size of its .ess and .skse files
+    // Saves that are queued for deletion are left out, returns false if the folder could not be listed
+    bool ListSaveFiles(std::unordered_map<std::string, SaveFileStat>& saveFiles);
+
+    SaveGame ReadSave(const std::string& saveName, const SaveFileStat& stat);
+    SaveChain& GetChain(std::uint32_t chainId);
+
+    // Adding saves can cause the chain to delete older ones
+    void ForgetDeletedSaves(SaveChain& chain);
+
+    // Hands a deleted save's files to the queue that removes them
+    void RemoveDeletedSave(const DeletedSave& deletedSave);
+
+    // Good once every save in the chain's primary block has been verified, bad if any is damaged
+    // Always good without bVerifySaves
+    SaveCheck CheckPrimaryBlock(std::uint32_t chainId, const SaveChain& chain);
+
+    // Removes the held saves of every chain whose primary block is now known to be good
+    void ReleaseHeldDeletes();
+
+    // Hands every non-primary save that is still in the folder to the chunk store
+    void StoreOldSaves();
+
+    // Whether saves in the block belong in cold storage
+    bool IsColdBlock(SaveBlock block) const;
+
+    // Hands every save in a cold block that is still in the folder to cold storage
+    void MigrateOldSaves();
+
+    // Writes a stored save back into the save folder
+    void RehydrateSave(const std::string& saveName);
+
+    // Moves every save out of a chunk store left from when bDedupOldSaves was on, then removes the store
+    void RestoreChunkStore(const std::string& storeDir);
+
+    // Moves every save back out of a cold folder that sColdSaveFolder no longer points to, runs on coldRestoreThread
+    // Returns false if any save is still held there or it was stopped first
+    bool RestoreColdStorage(const std::string& coldDir, std::stop_token stopToken);
+
+    // Sets the deletion budget and minimum file age of every queue from userVars
+    void ApplyQueueSettings();
+
+    // Builds every chain from saves grouped by chain id, replacing the current ones
+    void BuildChains(std::unordered_map<std::uint32_t, std::vector<SaveGame>> savesByChain);
+
+    // Deletes the oldest non-primary saves of any chain until the folder fits in iMaxFolderMB
+    void EnforceFolderBudget();
+
+    // Starts from the index of the last session, only reading saves that changed since
+    // Returns false if there is no usable index
+    bool RestoreFromIndex();
+    // Reads the saves the index holds, rereading those that changed, the index is unmapped again on return
+    bool ReadIndex(std::unordered_map<std::uint32_t, std::vector<SaveGame>>& savesByChain, size_t& reread);
+    void WriteIndex();
+
+    // Checks that the chains hold exactly the saves that are known to be on disk
+    bool CheckDrift();
+
+public:
+    // With bDryRun set, saves are only logged instead of removed
+    // Deletions wait while deferDeletions returns true, it is called from the deletion workers
+    // onVerified is called from the verifier thread once a save has been checked, Update releases what it was holding
+    // outsideChangeCount counts the folder changes known not to be the manager's own, without it NeedsUpdate is always true
+    SaveManager(const UserVars& userVars, const std::string& saveDir, const std::string& indexPath = std::string(),
+        std::function<bool()> deferDeletions = nullptr, std::function<void()> onVerified = nullptr,
+        std::function<std::uint64_t()> outsideChangeCount = nullptr);
+
+    // Rebuilds every save chain from scratch
+    void reset();
+
+    // Applies only the saves that were created, deleted or renamed since the last scan
+    // Falls back to a full reset if the chains no longer match the save folder
+    void Update();
+
+    // False when the save folder has only changed by the manager's own removals since it was last listed,
+    // no outside change was counted and no saves are waiting on a verified save, an Update would then find nothing to do
+    bool NeedsUpdate() const;
+
+    // Takes user variables read again from an edited ini
+    // Block sizes and spacings are applied to the saves the chains already hold, without listing the folder
+    // bRecycle, bDryRun, bArchiveOverflow, bDedupOldSaves and sColdSaveFolder pick how saves are removed and only change on a restart
+    void ApplyUserVars(const UserVars& newVars);
+
+    // Stops every queue, removing what it can within timeLimit so closing the game is never held up for long
+    // Whatever is left is found again by the next start, the index it writes makes that start list the folder
+    void Shutdown(std::chrono::steady_clock::duration timeLimit);
+
+    const UserVars& GetUserVars() const {
+        return userVars;
+    }
+};
@@ -0,0 +1,12 @@
+#include "SaveNameArena.h"
+
+SaveNameRef SaveNameArena::Add(std::string_view name) {
+    SaveNameRef ref = { static_cast<std::uint32_t>(buffer.size()), static_cast<std::uint32_t>(name.size()) };
+    buffer.append(name);
+    return ref;
+}
+
+void SaveNameArena::Clear() {
+    buffer.clear();
+    deadBytes = 0;
+}
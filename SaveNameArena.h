@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Lets sets and maps keyed by a save name be searched with a string_view, without building a string first
+struct SaveNameHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view name) const {
+        return std::hash<std::string_view>{}(name);
+    }
+};
+
+// Where a name lives inside a SaveNameArena
+struct SaveNameRef {
+    std::uint32_t offset;
+    std::uint32_t length;
+};
+
+// Names of the saves a chain holds, packed into one buffer instead of one heap block per name
+// Removing a name only leaves a gap, the owner squeezes the gaps out once NeedsCompaction returns true
+class SaveNameArena {
+private:
+    std::string buffer;
+    size_t deadBytes = 0;
+
+public:
+    SaveNameRef Add(std::string_view name);
+
+    void Remove(SaveNameRef name) {
+        deadBytes += name.length;
+    }
+
+    // Only valid until the next Add
+    std::string_view Get(SaveNameRef name) const {
+        return std::string_view(buffer).substr(name.offset, name.length);
+    }
+
+    void Reserve(size_t bytes) {
+        buffer.reserve(bytes);
+    }
+
+    void Clear();
+
+    // Gaps take up more than half the buffer
+    bool NeedsCompaction() const {
+        return deadBytes > 4096 && deadBytes * 2 > buffer.size();
+    }
+
+    size_t GetCapacity() const {
+        return buffer.capacity();
+    }
+};
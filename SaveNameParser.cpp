@@ -0,0 +1,93 @@
+#include "SaveNameParser.h"
+
+#include <charconv>
+#include <ctime>
+
+namespace {
+    constexpr size_t timestampLength = 14; // YYYYMMDDHHMMSS
+
+    constexpr unsigned ReadDigits(const char* digits, size_t count) {
+        unsigned value = 0;
+        for (size_t i = 0; i < count; i++) {
+            value = value * 10 + static_cast<unsigned>(digits[i] - '0');
+        }
+        return value;
+    }
+
+    // Expects exactly 14 digits, returns false if the date or time is out of range
+    bool ReadTimestamp(const char* digits, std::int64_t& time) {
+        unsigned year = ReadDigits(digits, 4);
+        unsigned month = ReadDigits(digits + 4, 2);
+        unsigned day = ReadDigits(digits + 6, 2);
+        unsigned hour = ReadDigits(digits + 8, 2);
+        unsigned minute = ReadDigits(digits + 10, 2);
+        unsigned second = ReadDigits(digits + 12, 2);
+
+        // Unsigned wrap-around folds the lower bound checks into the upper ones
+        if (month - 1 >= 12 || day - 1 >= 31 || hour >= 24 || minute >= 60 || second > 60) return false;
+
+        time = DaysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+        return true;
+    }
+}
+
+ParsedSaveName ParseSaveName(std::string_view saveName) noexcept {
+    ParsedSaveName result;
+    result.errors = SaveNameBadNumber | SaveNameBadChainId | SaveNameBadTimestamp;
+
+    // The save number is always in the first entry in the save name, pre-fixed by "Save"
+    if (saveName.size() <= 4 || saveName.substr(0, 4) != "Save") return result;
+
+    const char* const begin = saveName.data();
+    const char* const end = begin + saveName.size();
+    const char* fieldStart = begin + 4;
+    const char* timestamp = nullptr;
+    bool allDigits = true;
+    int field = 1;
+
+    for (const char* ptr = fieldStart; ; ptr++) {
+        if (ptr != end && *ptr != '_') {
+            allDigits &= static_cast<unsigned char>(*ptr - '0') < 10;
+            continue;
+        }
+
+        size_t fieldLength = static_cast<size_t>(ptr - fieldStart);
+        if (field == 1) {
+            auto [parsedEnd, ec] = std::from_chars(fieldStart, ptr, result.number);
+            if (ec == std::errc() && parsedEnd == ptr) result.errors &= ~SaveNameBadNumber;
+        }
+        else if (field == 2) {
+            // Chain Id is always the 2nd entry and is 8 digit hex
+            const char* idEnd = fieldLength > 8 ? fieldStart + 8 : ptr;
+            auto [parsedEnd, ec] = std::from_chars(fieldStart, idEnd, result.chainId, 16);
+            if (ec == std::errc() && parsedEnd != fieldStart) result.errors &= ~SaveNameBadChainId;
+        }
+        else if (allDigits && fieldLength == timestampLength) {
+            // Normally the 7th entry, but location names may contain underscores
+            // so take the last 14 digit entry instead of counting from the front
+            timestamp = fieldStart;
+        }
+
+        if (ptr == end) break;
+        fieldStart = ptr + 1;
+        allDigits = true;
+        field++;
+    }
+
+    if (timestamp && ReadTimestamp(timestamp, result.time)) {
+        result.errors &= ~SaveNameBadTimestamp;
+    }
+    return result;
+}
+
+std::int64_t UtcToNameTime(std::int64_t utcTime) noexcept {
+    time_t time = static_cast<time_t>(utcTime);
+    std::tm local = {};
+#ifdef _WIN32
+    if (localtime_s(&local, &time) != 0) return utcTime;
+#else
+    if (!localtime_r(&time, &local)) return utcTime;
+#endif
+    return DaysFromCivil(local.tm_year + 1900, static_cast<unsigned>(local.tm_mon + 1), static_cast<unsigned>(local.tm_mday)) * 86400 +
+        local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Fields of a save name that could not be read, combined as bit flags
+enum SaveNameError : std::uint8_t {
+    SaveNameOk = 0,
+    SaveNameBadNumber = 1 << 0,
+    SaveNameBadChainId = 1 << 1,
+    SaveNameBadTimestamp = 1 << 2,
+};
+
+// Save names look like Save12_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240101123045_5_1
+// Fields that fail to parse are left at 0 and flagged in errors
+struct ParsedSaveName {
+    std::uint32_t number = 0;
+    std::uint32_t chainId = 0;
+    std::int64_t time = 0; // Seconds since the epoch, taking the local wall-clock timestamp in the name as UTC
+    std::uint8_t errors = SaveNameOk;
+
+    bool Ok() const {
+        return errors == SaveNameOk;
+    }
+};
+
+// Days between 1970-01-01 and the given date in the proleptic Gregorian calendar
+constexpr std::int64_t DaysFromCivil(std::int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const std::int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<std::int64_t>(dayOfEra) - 719468;
+}
+
+// Reads the save number, chain id and timestamp in a single pass without allocating or throwing
+ParsedSaveName ParseSaveName(std::string_view saveName) noexcept;
+
+// Moves a true UTC time, like a header FILETIME or a file's write time, onto the wall-clock base of save names
+// so that saves timed from their files sort among the saves timed from their names
+std::int64_t UtcToNameTime(std::int64_t utcTime) noexcept;
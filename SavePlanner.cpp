@@ -0,0 +1,235 @@
+// Headless retention planner for SkyrimSaveManager
+// Shows which saves the plugin would keep and delete without touching any file
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "EssHeader.h"
+#include "SaveChain.h"
+#include "SaveEnumerator.h"
+#include "SaveGame.h"
+#include "SaveNameParser.h"
+#include "UserVars.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    const char* defaultBlockNames[] = { "primary", "secondary", "tertiary", "overflow" };
+
+    // Blocks of an sTierLayout are numbered, apart from the first and last
+    std::string BlockName(SaveBlock block, int tierCount) {
+        if (tierCount == defaultTierCount) return defaultBlockNames[block];
+        if (block == PrimaryBlock) return "primary";
+        if (block == tierCount - 1) return "overflow";
+        return "block" + std::to_string(block + 1);
+    }
+
+    double MillisecondsSince(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // Save times already hold the wall-clock time of the names, so they are printed as they are rather than as UTC
+    std::string FormatTime(time_t time) {
+        char buffer[32] = {};
+        std::tm fields = {};
+#ifdef _WIN32
+        if (gmtime_s(&fields, &time) != 0) return "?";
+#else
+        if (!gmtime_r(&time, &fields)) return "?";
+#endif
+        if (!std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &fields)) return "?";
+        return buffer;
+    }
+
+    // Takes the same saves the plugin would, from a save folder or a file listing one save per line
+    // A listing file has no sizes or times, so iMaxFolderMB only has an effect on a real folder
+    std::vector<ListedSave> ListSaves(const std::string& source, bool isDirectory) {
+        std::vector<ListedSave> saves;
+        if (isDirectory) {
+            if (!ListSaveFolder(source, saves)) std::fprintf(stderr, "Could not list %s\n", source.c_str());
+            return saves;
+        }
+
+        std::ifstream file(source);
+        std::string line;
+        while (std::getline(file, line)) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+            std::filesystem::path path(line);
+            if (path.extension() == ".skse") continue;
+            std::string saveName = path.extension() == ".ess" ? path.stem().string() : path.filename().string();
+
+            // If the first 4 letters of the filename are not "Save" then move on (Autosave / Quicksave)
+            if (saveName.length() <= 4 || saveName.compare(0, 4, "Save") != 0) continue;
+            saves.push_back({ std::move(saveName), {} });
+        }
+        return saves;
+    }
+
+    // Shows the ini as the plugin reads it, after defaults and clamping
+    void PrintUserVars(const UserVars& userVars) {
+        std::printf("fPollTime = %g\n", userVars.pollTime);
+        std::printf("bWatchSaveFolder = %d\n", userVars.watchSaveFolder);
+        std::printf("fDebounceTime = %g\n", userVars.debounceTime);
+        std::printf("bRecycle = %d\n", userVars.recycle);
+        std::printf("bDryRun = %d\n", userVars.dryRun);
+        std::printf("bArchiveOverflow = %d\n", userVars.archiveOverflow);
+        std::printf("bDedupOldSaves = %d\n", userVars.dedupOldSaves);
+        std::printf("sColdSaveFolder = %s\n", userVars.coldSaveFolder.c_str());
+        std::printf("iColdFromBlock = %d\n", userVars.coldFromBlock);
+        std::printf("fMaxDeletesPerSecond = %g\n", userVars.maxDeletesPerSecond);
+        std::printf("fMaxDeleteMBPerSecond = %g\n", userVars.maxDeleteMBPerSecond);
+        std::printf("fMinSaveAge = %g\n", userVars.minSaveAge);
+        std::printf("bVerifySaves = %d\n", userVars.verifySaves);
+        std::printf("bUseGameTime = %d\n", userVars.useGameTime);
+        std::printf("bEnableMetrics = %d\n", userVars.enableMetrics);
+        std::printf("iPrimaryBlockCount = %d\n", userVars.primaryBlockCount);
+        std::printf("iSecondaryBlockCount = %d\n", userVars.secondaryBlockCount);
+        std::printf("fDesiredSecondarySpacing = %g\n", userVars.desiredSecondarySpacing);
+        std::printf("iTertiaryBlockCount = %d\n", userVars.tertiaryBlockCount);
+        std::printf("fDesiredTertiarySpacing = %g\n", userVars.desiredTertiarySpacing);
+        std::printf("iMaxOverflow = %d\n", userVars.maxOverflow);
+        std::printf("fDesiredOverflowSpacing = %g\n", userVars.desiredOverflowSpacing);
+        std::printf("iMaxFolderMB = %d\n", userVars.maxFolderMB);
+        std::printf("sTierLayout =");
+        for (int i = 0; i < userVars.tierCount; i++) {
+            std::printf("%s %d:%g", i ? "," : "", userVars.tiers[i].count, userVars.tiers[i].spacing);
+        }
+        std::printf("\n");
+    }
+
+    void PrintUsage() {
+        std::printf("Usage: SavePlanner <save folder | listing file> [SaveManager.ini] [-q]\n");
+        std::printf("       SavePlanner --vars [SaveManager.ini]\n");
+        std::printf("  A listing file holds one save file name per line\n");
+        std::printf("  -q      Only print the per-chain summary\n");
+        std::printf("  --vars  Print the user variables read from the ini and exit\n");
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> args;
+    bool quiet = false;
+    bool printVars = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "-q") == 0) quiet = true;
+        else if (std::strcmp(argv[i], "--vars") == 0) printVars = true;
+        else args.emplace_back(argv[i]);
+    }
+    if (printVars && args.size() <= 1) {
+        PrintUserVars(ReadUserVars(args.empty() ? std::string() : args[0]));
+        return 0;
+    }
+    if (args.empty() || args.size() > 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    const std::string& source = args[0];
+    std::error_code error;
+    bool isDirectory = std::filesystem::is_directory(source, error);
+    if (!isDirectory && !std::filesystem::is_regular_file(source, error)) {
+        std::fprintf(stderr, "Cannot read %s\n", source.c_str());
+        return 1;
+    }
+
+    // Without an ini the plugin defaults are used
+    UserVars userVars = ReadUserVars(args.size() > 1 ? args[1] : std::string());
+
+    Clock::time_point parseStart = Clock::now();
+    std::map<std::uint32_t, std::vector<SaveGame>> savesByChain;
+    size_t saveCount = 0;
+    size_t unreadable = 0;
+    for (ListedSave& listed : ListSaves(source, isDirectory)) {
+        SaveGame save(std::move(listed.saveName));
+
+        // Headers can only be read when the saves themselves are at hand
+        if (isDirectory && save.NeedsHeader(userVars.useGameTime)) {
+            std::optional<EssHeader> header = ReadEssHeader((std::filesystem::path(source) / (save.GetSaveName() + ".ess")).string());
+            save.ApplyHeader(header ? &*header : nullptr, listed.stat.writeTime, userVars.useGameTime);
+        }
+        if (save.GetParseErrors() != SaveNameOk) unreadable++;
+        save.SetSize(listed.stat.size);
+
+        savesByChain[save.GetChainId()].push_back(std::move(save));
+        saveCount++;
+    }
+    double parseMs = MillisecondsSince(parseStart);
+
+    Clock::time_point buildStart = Clock::now();
+    std::map<std::uint32_t, SaveChain> chains;
+    for (auto& batchPair : savesByChain) {
+        SaveChain& chain = chains.emplace(batchPair.first, SaveChain(userVars)).first->second;
+        chain.BuildFromBatch(std::move(batchPair.second));
+    }
+
+    std::uint64_t keptBytes = 0;
+    std::vector<SaveChain*> chainOrder;
+    for (auto& chainPair : chains) {
+        keptBytes += chainPair.second.GetTotalBytes();
+        chainOrder.push_back(&chainPair.second);
+    }
+    if (userVars.maxFolderMB >= 0) {
+        keptBytes = ApplyFolderBudget(chainOrder, keptBytes, static_cast<std::uint64_t>(userVars.maxFolderMB) * 1024 * 1024);
+    }
+    double buildMs = MillisecondsSince(buildStart);
+
+    size_t keepTotal = 0;
+    size_t deleteTotal = 0;
+    size_t archiveTotal = 0;
+    for (auto& chainPair : chains) {
+        SaveChain& chain = chainPair.second;
+        std::vector<DeletedSave> deletedSaves = chain.TakeDeletedSaves();
+
+        // With bArchiveOverflow, saves that leave the overflow block go to the archive instead
+        size_t archiveCount = 0;
+        if (userVars.archiveOverflow) {
+            archiveCount = std::count_if(deletedSaves.begin(), deletedSaves.end(), [&userVars](const DeletedSave& deletedSave) {
+                return deletedSave.block == userVars.tierCount - 1;
+            });
+        }
+
+        size_t blockSizes[maxTierCount] = {};
+        chain.ForEachSave([&blockSizes](const SaveView&, SaveBlock block) {
+            blockSizes[block]++;
+        });
+        std::printf("Chain %08X: keep %zu (", chainPair.first, chain.GetSaveCount());
+        for (int block = PrimaryBlock; block < userVars.tierCount; block++) {
+            std::printf("%s%zu %s", block ? ", " : "", blockSizes[block], BlockName(block, userVars.tierCount).c_str());
+        }
+        std::printf("), delete %zu", deletedSaves.size() - archiveCount);
+        if (userVars.archiveOverflow) std::printf(", archive %zu", archiveCount);
+        std::printf("\n");
+
+        if (!quiet) {
+            chain.ForEachSave([&userVars](const SaveView& save, SaveBlock block) {
+                std::printf("  keep    %-9s %s  %.*s\n", BlockName(block, userVars.tierCount).c_str(), FormatTime(save.time).c_str(),
+                    static_cast<int>(save.saveName.size()), save.saveName.data());
+            });
+            for (const DeletedSave& deletedSave : deletedSaves) {
+                bool archived = userVars.archiveOverflow && deletedSave.block == userVars.tierCount - 1;
+                std::printf("  %-7s %-9s                     %s\n", archived ? "archive" : "delete",
+                    BlockName(deletedSave.block, userVars.tierCount).c_str(), deletedSave.saveName.c_str());
+            }
+        }
+        keepTotal += chain.GetSaveCount();
+        deleteTotal += deletedSaves.size() - archiveCount;
+        archiveTotal += archiveCount;
+    }
+
+    std::printf("%zu saves in %zu chains: keep %zu, delete %zu", saveCount, chains.size(), keepTotal, deleteTotal);
+    if (userVars.archiveOverflow) std::printf(", archive %zu", archiveTotal);
+    if (isDirectory) std::printf(", %.1f MB kept", keptBytes / (1024.0 * 1024.0));
+    if (unreadable) std::printf(", %zu with unreadable names", unreadable);
+    std::printf("\nParsed in %.2f ms, planned in %.2f ms\n", parseMs, buildMs);
+    return 0;
+}
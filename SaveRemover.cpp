@@ -0,0 +1,179 @@
+#include "SaveRemover.h"
+
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
+
+#include "SaveIndex.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <shellapi.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+namespace {
+    // Paths are in the ANSI code page from the save folder listing on, as std::filesystem::path reads narrow strings
+    std::wstring ToWide(const std::string& path) {
+        return std::filesystem::path(path).wstring();
+    }
+
+    // A file that could not be removed but still exists is assumed to be in use
+    RemoveResult ResultForRemaining(const std::wstring& pathW) {
+        std::error_code error;
+        return std::filesystem::exists(pathW, error) ? RemoveResult::Retry : RemoveResult::Removed;
+    }
+}
+
+class RecycleBinRemover : public SaveRemover {
+private:
+    // pFrom is a list of null terminated paths ending with an extra null
+    static bool RecycleFiles(const std::wstring& pathList) {
+        SHFILEOPSTRUCTW fileOp = { 0 };
+        fileOp.wFunc = FO_DELETE;
+        fileOp.pFrom = pathList.c_str();
+        fileOp.fFlags = FOF_ALLOWUNDO | FOF_NOCONFIRMATION | FOF_SILENT | FOF_NOERRORUI;
+
+        int result = SHFileOperationW(&fileOp);
+        return (result == 0 && !fileOp.fAnyOperationsAborted);
+    }
+
+public:
+    void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+        results.assign(paths.size(), RemoveResult::Missing);
+
+        // The whole operation fails if any path is missing, so only pass existing files
+        std::vector<std::wstring> pathsW(paths.size());
+        std::wstring pathList;
+        for (size_t i = 0; i < paths.size(); i++) {
+            std::error_code error;
+            pathsW[i] = ToWide(paths[i]);
+            if (pathsW[i].empty() || !std::filesystem::exists(pathsW[i], error)) continue;
+
+            results[i] = RemoveResult::Removed;
+            pathList += pathsW[i];
+            pathList += L'\0';
+        }
+        if (pathList.empty()) return;
+        pathList += L'\0';
+
+        if (RecycleFiles(pathList)) return;
+
+        // Find out which files were left behind
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (results[i] == RemoveResult::Removed) results[i] = ResultForRemaining(pathsW[i]);
+        }
+    }
+};
+
+class DeleteFileRemover : public SaveRemover {
+public:
+    void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+        results.assign(paths.size(), RemoveResult::Removed);
+        for (size_t i = 0; i < paths.size(); i++) {
+            std::wstring pathW = ToWide(paths[i]);
+            if (DeleteFileW(pathW.c_str())) continue;
+
+            switch (GetLastError()) {
+            case ERROR_FILE_NOT_FOUND:
+            case ERROR_PATH_NOT_FOUND:
+                results[i] = RemoveResult::Missing;
+                break;
+            case ERROR_SHARING_VIOLATION:
+            case ERROR_LOCK_VIOLATION:
+                results[i] = RemoveResult::Retry;
+                break;
+            default:
+                results[i] = RemoveResult::Failed;
+                break;
+            }
+        }
+    }
+};
+
+std::unique_ptr<SaveRemover> CreateSaveRemover(bool recycle) {
+    if (recycle) return std::make_unique<RecycleBinRemover>();
+    return std::make_unique<DeleteFileRemover>();
+}
+
+#else
+
+class UnlinkRemover : public SaveRemover {
+public:
+    void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+        results.assign(paths.size(), RemoveResult::Removed);
+        for (size_t i = 0; i < paths.size(); i++) {
+            if (unlink(paths[i].c_str()) == 0) continue;
+
+            switch (errno) {
+            case ENOENT:
+                results[i] = RemoveResult::Missing;
+                break;
+            case EBUSY:
+            case ETXTBSY:
+            case EAGAIN:
+                results[i] = RemoveResult::Retry;
+                break;
+            default:
+                results[i] = RemoveResult::Failed;
+                break;
+            }
+        }
+    }
+};
+
+std::unique_ptr<SaveRemover> CreateSaveRemover(bool) {
+    return std::make_unique<UnlinkRemover>();
+}
+
+#endif
+
+class DryRunRemover : public SaveRemover {
+public:
+    void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+        results.assign(paths.size(), RemoveResult::Removed);
+        for (const std::string& path : paths) {
+            spdlog::info("Dry run, would remove {}", path);
+        }
+    }
+};
+
+std::unique_ptr<SaveRemover> CreateDryRunRemover() {
+    return std::make_unique<DryRunRemover>();
+}
+
+class StampingRemover : public SaveRemover {
+private:
+    std::string dir;
+    std::atomic<std::int64_t>& knownWriteTime;
+    std::function<std::uint64_t()> outsideChangeCount;
+    std::unique_ptr<SaveRemover> remover;
+
+public:
+    StampingRemover(const std::string& dir, std::atomic<std::int64_t>& knownWriteTime, std::function<std::uint64_t()> outsideChangeCount,
+        std::unique_ptr<SaveRemover> remover)
+        : dir(dir), knownWriteTime(knownWriteTime), outsideChangeCount(std::move(outsideChangeCount)), remover(std::move(remover)) {}
+
+    void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+        if (!outsideChangeCount) {
+            remover->Remove(paths, results);
+            return;
+        }
+
+        // The count is taken before the stamp, an outside change that lands between the two still moves it
+        std::uint64_t changes = outsideChangeCount();
+        std::int64_t before = GetDirWriteTime(dir);
+        remover->Remove(paths, results);
+        std::int64_t after = GetDirWriteTime(dir);
+        if (before != 0 && outsideChangeCount() == changes) knownWriteTime.compare_exchange_strong(before, after);
+    }
+};
+
+std::unique_ptr<SaveRemover> CreateStampingRemover(const std::string& dir, std::atomic<std::int64_t>& knownWriteTime,
+    std::function<std::uint64_t()> outsideChangeCount, std::unique_ptr<SaveRemover> remover) {
+    return std::make_unique<StampingRemover>(dir, knownWriteTime, std::move(outsideChangeCount), std::move(remover));
+}
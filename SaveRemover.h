@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Outcome of trying to remove a single file
+enum class RemoveResult {
+    Removed,
+    Missing,   // Already gone, e.g. a save without a .skse mirror
+    Retry,     // Still there, most likely in use by the game
+    Failed
+};
+
+// Removes files from disk, batching as many paths into one operation as the platform allows
+class SaveRemover {
+public:
+    virtual ~SaveRemover() = default;
+
+    // Fills results with the outcome for each path, in the same order
+    virtual void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) = 0;
+};
+
+// Recycling is only available on Windows, elsewhere files are always deleted
+std::unique_ptr<SaveRemover> CreateSaveRemover(bool recycle);
+
+// Logs every path it is given and leaves the files alone
+std::unique_ptr<SaveRemover> CreateDryRunRemover();
+
+// Passes each batch on to remover, then moves knownWriteTime on to the folder's new stamp
+// Only if the folder still had the known stamp when the batch started and outsideChangeCount did not move during it,
+// so a save the game wrote while the batch ran is not claimed. Without outsideChangeCount nothing is ever claimed
+std::unique_ptr<SaveRemover> CreateStampingRemover(const std::string& dir, std::atomic<std::int64_t>& knownWriteTime,
+    std::function<std::uint64_t()> outsideChangeCount, std::unique_ptr<SaveRemover> remover);
@@ -0,0 +1,246 @@
+// Lists the saves in SkyrimSaveManager archives, chunk stores and cold folders and restores them as .ess/.skse pairs
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ChunkStore.h"
+#include "ColdStorage.h"
+#include "SaveArchive.h"
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Files of one archived save, the .skse is missing for saves made without SKSE
+    struct ArchivedSave {
+        std::string archivePath;
+        std::vector<ArchiveEntry> files;
+        std::uint64_t rawBytes = 0;
+        std::uint64_t storedBytes = 0;
+    };
+
+    // Takes a single archive, an archive folder or a save folder
+    std::vector<std::string> FindArchives(const std::string& source) {
+        std::error_code error;
+        std::vector<std::string> archives;
+        if (std::filesystem::is_regular_file(source, error)) {
+            archives.push_back(source);
+            return archives;
+        }
+
+        std::filesystem::path dir(source);
+        if (std::filesystem::is_directory(GetArchiveDir(source), error)) dir = GetArchiveDir(source);
+        for (const auto& entry : std::filesystem::directory_iterator(dir, error)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".ssa") archives.push_back(entry.path().string());
+        }
+        return archives;
+    }
+
+    // Later entries win, a save archived again after a restore is the same save
+    std::map<std::string, ArchivedSave> ListSaves(const std::vector<std::string>& archives) {
+        std::map<std::string, ArchivedSave> saves;
+        for (const std::string& archivePath : archives) {
+            for (ArchiveEntry& entry : ListArchive(archivePath)) {
+                std::filesystem::path fileName(entry.fileName);
+                ArchivedSave& save = saves[fileName.stem().string()];
+                if (save.archivePath != archivePath) save = ArchivedSave{ archivePath, {} };
+                std::erase_if(save.files, [&entry](const ArchiveEntry& file) {
+                    return file.fileName == entry.fileName;
+                });
+                save.files.push_back(std::move(entry));
+            }
+        }
+        for (auto& savePair : saves) {
+            for (const ArchiveEntry& file : savePair.second.files) {
+                savePair.second.rawBytes += file.rawSize;
+                savePair.second.storedBytes += file.storedSize;
+            }
+        }
+        return saves;
+    }
+
+    void PrintUsage() {
+        std::printf("Usage: SaveRestore <archive | archive folder | save folder> [save name] [output folder]\n");
+        std::printf("       SaveRestore --store <save folder> [save name] [output folder]\n");
+        std::printf("       SaveRestore --cold <cold folder> [save name] [output folder]\n");
+        std::printf("  Without a save name, every archived, stored or moved save is listed\n");
+        std::printf("  The output folder defaults to the current folder, existing files are never overwritten\n");
+        std::printf("  --store  Restores from the chunk store of bDedupOldSaves, run it with the game closed\n");
+        std::printf("           A save restored into its own save folder is taken out of the store for good\n");
+        std::printf("  --cold   Restores from the sColdSaveFolder, each file is checked against the one that was moved\n");
+    }
+
+    int RunStore(int argc, char** argv) {
+        std::string saveDir = argv[0];
+        ChunkStore store;
+        if (!store.Open(GetChunkStoreDir(saveDir)) || store.GetFileCount() == 0) {
+            std::fprintf(stderr, "No chunk store found in %s\n", saveDir.c_str());
+            return 1;
+        }
+
+        if (argc == 1) {
+            std::map<std::string, std::uint64_t> saves;
+            store.ForEachSave([&saves](const std::string& saveName, std::uint64_t bytes) {
+                saves.emplace(saveName, bytes);
+            });
+            for (const auto& savePair : saves) {
+                std::printf("%-80s %8.2f MB\n", savePair.first.c_str(), savePair.second / (1024.0 * 1024.0));
+            }
+            std::printf("%zu saves, %.1f MB stored in a %.1f MB pack\n", saves.size(), store.GetLogicalBytes() / (1024.0 * 1024.0),
+                store.GetPackBytes() / (1024.0 * 1024.0));
+            return 0;
+        }
+
+        std::string saveName = std::filesystem::path(argv[1]).extension() == ".ess" ? std::filesystem::path(argv[1]).stem().string() : argv[1];
+        if (!store.HoldsSave(saveName)) {
+            std::fprintf(stderr, "%s is not in the chunk store\n", saveName.c_str());
+            return 1;
+        }
+
+        std::filesystem::path outputDir = argc > 2 ? argv[2] : ".";
+        std::error_code error;
+        for (const char* extension : { ".ess", ".skse" }) {
+            if (store.HoldsFile(saveName + extension) && std::filesystem::exists(outputDir / (saveName + extension), error)) {
+                std::fprintf(stderr, "%s already exists\n", (outputDir / (saveName + extension)).string().c_str());
+                return 1;
+            }
+        }
+
+        Clock::time_point start = Clock::now();
+        for (const char* extension : { ".ess", ".skse" }) {
+            if (!store.HoldsFile(saveName + extension)) continue;
+            std::string outputPath = (outputDir / (saveName + extension)).string();
+            if (!store.Rehydrate(saveName + extension, outputPath)) {
+                std::fprintf(stderr, "Could not restore %s\n", outputPath.c_str());
+                return 1;
+            }
+            std::printf("Restored %s\n", outputPath.c_str());
+        }
+
+        // Back in its own folder the save is an ordinary save again, and is not moved back into the store
+        if (std::filesystem::equivalent(outputDir, saveDir, error)) {
+            store.RemoveSave(saveName);
+            store.Pin(saveName);
+        }
+        std::printf("Restored in %.2f ms\n", std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        return 0;
+    }
+
+    int RunCold(int argc, char** argv) {
+        std::string coldDir = argv[0];
+        std::error_code error;
+        ColdStorage storage;
+        if (!std::filesystem::is_directory(coldDir, error) || !storage.Open(coldDir) || storage.GetFileCount() == 0) {
+            std::fprintf(stderr, "No moved saves found in %s\n", coldDir.c_str());
+            return 1;
+        }
+
+        if (argc == 1) {
+            std::map<std::string, std::uint64_t> saves;
+            storage.ForEachSave([&saves](const std::string& saveName, std::uint64_t bytes) {
+                saves.emplace(saveName, bytes);
+            });
+            std::uint64_t totalBytes = 0;
+            for (const auto& savePair : saves) {
+                std::printf("%-80s %8.2f MB\n", savePair.first.c_str(), savePair.second / (1024.0 * 1024.0));
+                totalBytes += savePair.second;
+            }
+            std::printf("%zu saves, %.1f MB\n", saves.size(), totalBytes / (1024.0 * 1024.0));
+            return 0;
+        }
+
+        std::string saveName = std::filesystem::path(argv[1]).extension() == ".ess" ? std::filesystem::path(argv[1]).stem().string() : argv[1];
+        if (!storage.HoldsSave(saveName)) {
+            std::fprintf(stderr, "%s is not in the cold folder\n", saveName.c_str());
+            return 1;
+        }
+
+        std::filesystem::path outputDir = argc > 2 ? argv[2] : ".";
+        for (const char* extension : { ".ess", ".skse" }) {
+            if (storage.HoldsFile(saveName + extension) && std::filesystem::exists(outputDir / (saveName + extension), error)) {
+                std::fprintf(stderr, "%s already exists\n", (outputDir / (saveName + extension)).string().c_str());
+                return 1;
+            }
+        }
+
+        Clock::time_point start = Clock::now();
+        for (const char* extension : { ".ess", ".skse" }) {
+            if (!storage.HoldsFile(saveName + extension)) continue;
+            std::string outputPath = (outputDir / (saveName + extension)).string();
+            if (!storage.Restore(saveName + extension, outputPath)) {
+                std::fprintf(stderr, "Could not restore %s\n", outputPath.c_str());
+                return 1;
+            }
+            std::printf("Restored %s\n", outputPath.c_str());
+        }
+        std::printf("Restored in %.2f ms\n", std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 3 && argc <= 5 && std::string(argv[1]) == "--store") {
+        return RunStore(argc - 2, argv + 2);
+    }
+    if (argc >= 3 && argc <= 5 && std::string(argv[1]) == "--cold") {
+        return RunCold(argc - 2, argv + 2);
+    }
+    if (argc < 2 || argc > 4) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<std::string> archives = FindArchives(argv[1]);
+    if (archives.empty()) {
+        std::fprintf(stderr, "No archives found in %s\n", argv[1]);
+        return 1;
+    }
+    std::map<std::string, ArchivedSave> saves = ListSaves(archives);
+
+    if (argc == 2) {
+        std::uint64_t rawTotal = 0;
+        std::uint64_t storedTotal = 0;
+        for (const auto& savePair : saves) {
+            const ArchivedSave& save = savePair.second;
+            std::printf("%-80s %8.2f MB -> %8.2f MB  %s\n", savePair.first.c_str(), save.rawBytes / (1024.0 * 1024.0),
+                save.storedBytes / (1024.0 * 1024.0), std::filesystem::path(save.archivePath).filename().string().c_str());
+            rawTotal += save.rawBytes;
+            storedTotal += save.storedBytes;
+        }
+        std::printf("%zu saves in %zu archives, %.1f MB stored as %.1f MB (%.1f%%)\n", saves.size(), archives.size(),
+            rawTotal / (1024.0 * 1024.0), storedTotal / (1024.0 * 1024.0), rawTotal ? 100.0 * storedTotal / rawTotal : 0.0);
+        return 0;
+    }
+
+    // The name may be given with or without an extension
+    std::string saveName = std::filesystem::path(argv[2]).extension() == ".ess" ? std::filesystem::path(argv[2]).stem().string() : argv[2];
+    auto found = saves.find(saveName);
+    if (found == saves.end()) {
+        std::fprintf(stderr, "%s is not in the archive\n", saveName.c_str());
+        return 1;
+    }
+
+    std::filesystem::path outputDir = argc > 3 ? argv[3] : ".";
+    std::error_code error;
+    for (const ArchiveEntry& file : found->second.files) {
+        if (std::filesystem::exists(outputDir / file.fileName, error)) {
+            std::fprintf(stderr, "%s already exists\n", (outputDir / file.fileName).string().c_str());
+            return 1;
+        }
+    }
+
+    Clock::time_point start = Clock::now();
+    for (const ArchiveEntry& file : found->second.files) {
+        std::string outputPath = (outputDir / file.fileName).string();
+        if (!ExtractFromArchive(found->second.archivePath, file, outputPath)) {
+            std::fprintf(stderr, "Could not restore %s\n", file.fileName.c_str());
+            return 1;
+        }
+        std::printf("Restored %s\n", outputPath.c_str());
+    }
+    std::printf("Restored in %.2f ms\n", std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "SaveTrigger.h"
+
+#include <algorithm>
+
+void SaveTrigger::Notify() {
+    {
+        std::lock_guard lock(mutex);
+        lastNotify = Clock::now();
+        if (!pending) {
+            pending = true;
+            firstNotify = lastNotify;
+        }
+    }
+    wakeup.notify_all();
+}
+
+void SaveTrigger::NotifyOutsideChange() {
+    outsideChanges++;
+    Notify();
+}
+
+void SaveTrigger::Stop() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+}
+
+TriggerReason SaveTrigger::Wait(Clock::duration pollInterval, Clock::duration debounceTime, Clock::duration maxDelay) {
+    std::unique_lock lock(mutex);
+
+    // Wait for the first notification, or fall back to a timed poll
+    if (!wakeup.wait_until(lock, Clock::now() + pollInterval, [this] { return pending || stopping; })) {
+        return TriggerReason::Poll;
+    }
+
+    // Let the burst settle, each new notification pushes the deadline back
+    while (!stopping) {
+        Clock::time_point settleTime = std::min(lastNotify + debounceTime, firstNotify + maxDelay);
+        if (Clock::now() >= settleTime) break;
+        wakeup.wait_until(lock, settleTime);
+    }
+    if (stopping) return TriggerReason::Stop;
+
+    pending = false;
+    return TriggerReason::Event;
+}
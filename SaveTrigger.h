@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Why the save manager woke up
+enum class TriggerReason {
+    Event,  // A save event or folder change was seen and has settled
+    Poll,   // Nothing happened for a full poll interval (safety net)
+    Stop
+};
+
+// Collects save notifications from any thread and wakes the manager once they settle
+// The game writes the .ess and then the .skse, so a single save produces a burst of events
+class SaveTrigger {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+
+    bool pending = false;
+    bool stopping = false;
+    Clock::time_point firstNotify;
+    Clock::time_point lastNotify;
+
+    std::atomic<std::uint64_t> outsideChanges = 0;
+
+public:
+    // Records that something happened to the save folder
+    void Notify();
+
+    // Records a change to the save folder the manager did not make, such as the game saving or deleting a save
+    // The folder watcher cannot tell whose change it saw, so it only calls Notify
+    void NotifyOutsideChange();
+
+    // Counts every NotifyOutsideChange, a removal that sees it move must not claim the folder's new stamp
+    std::uint64_t GetOutsideChangeCount() const {
+        return outsideChanges.load();
+    }
+
+    // Makes every current and future Wait return TriggerReason::Stop
+    void Stop();
+
+    // Blocks until notifications have been quiet for debounceTime (but no longer than maxDelay
+    // after the first one), or until pollInterval passes without any notification
+    TriggerReason Wait(Clock::duration pollInterval, Clock::duration debounceTime, Clock::duration maxDelay);
+};
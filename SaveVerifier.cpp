@@ -0,0 +1,260 @@
+#include "SaveVerifier.h"
+
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include <zlib.h>
+
+#include "Crc32c.h"
+#include "EssHeader.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "WorkerPool.h"
+
+namespace {
+    constexpr std::uint16_t compressionZlib = 1;
+    constexpr std::uint16_t compressionLz4 = 2;
+
+    // Offsets in the file location table of an uncompressed save, each points somewhere inside the file
+    constexpr size_t fileLocationOffsets = 6;
+
+    SaveVerifyResult Bad(const char* problem) {
+        return { false, 0, problem };
+    }
+
+    std::uint32_t ReadU32(const std::byte* data) {
+        std::uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    // Walks the sequences of an lz4 block, each must fit the block and only copy from what is already written
+    bool CheckLz4Block(const unsigned char* data, size_t size, std::uint64_t expectedSize) {
+        const unsigned char* end = data + size;
+        std::uint64_t written = 0;
+        while (data < end) {
+            unsigned token = *data++;
+
+            std::uint64_t literals = token >> 4;
+            if (literals == 15) {
+                unsigned char extra;
+                do {
+                    if (data == end) return false;
+                    extra = *data++;
+                    literals += extra;
+                } while (extra == 255);
+            }
+            if (static_cast<std::uint64_t>(end - data) < literals) return false;
+            data += literals;
+            written += literals;
+
+            // The last sequence is only literals
+            if (data == end) break;
+
+            if (end - data < 2) return false;
+            unsigned offset = data[0] | (data[1] << 8);
+            data += 2;
+            if (offset == 0 || offset > written) return false;
+
+            std::uint64_t matchLength = token & 15;
+            if (matchLength == 15) {
+                unsigned char extra;
+                do {
+                    if (data == end) return false;
+                    extra = *data++;
+                    matchLength += extra;
+                } while (extra == 255);
+            }
+            written += matchLength + 4;
+            if (written > expectedSize) return false;
+        }
+        return written == expectedSize;
+    }
+
+    bool CheckZlibBody(const unsigned char* data, size_t size, std::uint64_t expectedSize) {
+        z_stream stream = {};
+        if (inflateInit(&stream) != Z_OK) return false;
+
+        std::vector<unsigned char> scratch(256 * 1024);
+        stream.next_in = const_cast<unsigned char*>(data);
+        stream.avail_in = static_cast<uInt>(size);
+        int status = Z_OK;
+        while (status == Z_OK) {
+            stream.next_out = scratch.data();
+            stream.avail_out = static_cast<uInt>(scratch.size());
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (stream.total_out > expectedSize) status = Z_DATA_ERROR;
+        }
+        bool ok = status == Z_STREAM_END && stream.total_out == expectedSize;
+        inflateEnd(&stream);
+        return ok;
+    }
+
+    bool GetFileState(const std::string& path, std::uint64_t& size, std::int64_t& writeTime) {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error) return false;
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error) return false;
+        writeTime = static_cast<std::int64_t>(time.time_since_epoch().count());
+        return true;
+    }
+
+    // Everything VerifySaveData checks apart from the CRC, which the worker takes on its own first
+    SaveVerifyResult CheckSaveStructure(std::span<const std::byte> data) {
+        std::optional<EssHeader> header = ParseEssHeader(data);
+        if (!header) return Bad("unreadable header");
+
+        // Special Edition screenshots are RGBA, older saves RGB
+        std::uint64_t shotBytes = static_cast<std::uint64_t>(header->shotWidth) * header->shotHeight * (header->version >= 12 ? 4 : 3);
+        if (shotBytes > data.size() - header->headerEnd) return Bad("screenshot runs past the end of the file");
+        size_t body = header->headerEnd + static_cast<size_t>(shotBytes);
+
+        if (header->compressionType == 0) {
+            // Form version, then the plugin list and the file location table
+            if (data.size() - body < 5) return Bad("missing plugin list");
+            std::uint32_t pluginInfoSize = ReadU32(data.data() + body + 1);
+            size_t table = body + 5;
+            if (pluginInfoSize > data.size() - table) return Bad("plugin list runs past the end of the file");
+            table += pluginInfoSize;
+            if (data.size() - table < fileLocationOffsets * 4) return Bad("missing file location table");
+            for (size_t i = 0; i < fileLocationOffsets; i++) {
+                std::uint32_t offset = ReadU32(data.data() + table + i * 4);
+                if (offset > data.size()) return Bad("file location table points past the end of the file");
+            }
+        }
+        else if (header->compressionType == compressionZlib || header->compressionType == compressionLz4) {
+            if (data.size() - body < 8) return Bad("missing compressed body");
+            std::uint32_t uncompressedSize = ReadU32(data.data() + body);
+            std::uint32_t compressedSize = ReadU32(data.data() + body + 4);
+            body += 8;
+            if (compressedSize > data.size() - body) return Bad("compressed body runs past the end of the file");
+
+            const unsigned char* compressed = reinterpret_cast<const unsigned char*>(data.data() + body);
+            bool ok = header->compressionType == compressionLz4 ? CheckLz4Block(compressed, compressedSize, uncompressedSize)
+                                                                : CheckZlibBody(compressed, compressedSize, uncompressedSize);
+            if (!ok) return Bad("compressed body is damaged");
+        }
+        else {
+            return Bad("unknown compression type");
+        }
+
+        return { true, 0, nullptr };
+    }
+}
+
+SaveVerifyResult VerifySaveData(std::span<const std::byte> data) {
+    SaveVerifyResult result = CheckSaveStructure(data);
+    result.crc = Crc32c(data.data(), data.size());
+    return result;
+}
+
+SaveVerifyResult VerifySaveFile(const std::string& path) {
+    MappedFile file;
+    if (!file.Open(path)) return Bad("missing or empty file");
+    return VerifySaveData(file.GetBytes());
+}
+
+SaveVerifier::SaveVerifier(std::function<void()> onVerified) : onVerified(std::move(onVerified)) {
+    worker = std::thread(&SaveVerifier::RunWorker, this);
+}
+
+SaveVerifier::~SaveVerifier() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    worker.join();
+}
+
+void SaveVerifier::RunWorker() {
+    LowerCurrentThreadPriority();
+
+    std::unique_lock lock(mutex);
+    for (;;) {
+        wakeup.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (stopping) return;
+
+        std::string path = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        // Stamped before reading, a file that changes while it is checked no longer matches and is checked again
+        // A file that is gone or still open in the game stays pending, the next Check queues it again
+        std::uint64_t size = 0;
+        std::int64_t writeTime = 0;
+        MappedFile file;
+        if (!GetFileState(path, size, writeTime) || (size && !file.Open(path))) {
+            lock.lock();
+            queued.erase(path);
+            continue;
+        }
+
+        std::optional<SaveVerifyResult> result;
+        if (size == 0) {
+            result = Bad("empty file");
+        }
+        else {
+            std::span<const std::byte> data = file.GetBytes();
+            std::uint32_t crc = Crc32c(data.data(), data.size());
+            lock.lock();
+            auto found = cache.find(path);
+            if (found != cache.end() && found->second.result.crc == crc) result = found->second.result;
+            lock.unlock();
+            if (!result) {
+                result = CheckSaveStructure(data);
+                result->crc = crc;
+            }
+        }
+        file.Close();
+        GetMetrics().Add(MetricCounter::SavesVerified);
+
+        lock.lock();
+        queued.erase(path);
+        cache[path] = { size, writeTime, true, *result };
+        lock.unlock();
+        if (onVerified) onVerified();
+        lock.lock();
+    }
+}
+
+SaveCheck SaveVerifier::Check(const std::string& path, SaveVerifyResult* result) {
+    std::uint64_t size = 0;
+    std::int64_t writeTime = 0;
+    bool exists = GetFileState(path, size, writeTime);
+
+    std::lock_guard lock(mutex);
+    auto found = cache.find(path);
+    if (exists && found != cache.end() && found->second.stamped && found->second.size == size && found->second.writeTime == writeTime) {
+        if (result) *result = found->second.result;
+        return found->second.result.good ? SaveCheck::Good : SaveCheck::Bad;
+    }
+
+    // A missing file is left pending, the next scan takes it out of its chain
+    if (exists && queued.insert(path).second) {
+        queue.push_back(path);
+        wakeup.notify_one();
+    }
+    return SaveCheck::Pending;
+}
+
+void SaveVerifier::Forget(const std::string& path) {
+    std::lock_guard lock(mutex);
+    cache.erase(path);
+}
+
+void SaveVerifier::Remember(const std::string& path, std::uint32_t crc) {
+    std::lock_guard lock(mutex);
+    cache.try_emplace(path, CachedResult{ 0, 0, false, { true, crc, nullptr } });
+}
+
+bool SaveVerifier::GetGoodCrc(const std::string& path, std::uint32_t& crc) {
+    std::lock_guard lock(mutex);
+    auto found = cache.find(path);
+    if (found == cache.end() || !found->second.result.good) return false;
+    crc = found->second.result.crc;
+    return true;
+}
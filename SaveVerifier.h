@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+// Outcome of checking one .ess file
+struct SaveVerifyResult {
+    bool good = false;
+    std::uint32_t crc = 0;          // CRC32C of the whole file, recognises it again after its size or write time changed
+    const char* problem = nullptr;  // What made a bad save bad
+};
+
+// Checks the header, the screenshot and the body of a save, and takes the CRC32C of the whole file
+// Compressed bodies are walked without being kept: zlib bodies are inflated into a scratch buffer,
+// lz4 bodies have their block structure checked against the uncompressed size
+SaveVerifyResult VerifySaveData(std::span<const std::byte> data);
+
+// Maps the file and verifies it, a missing or empty file is bad
+SaveVerifyResult VerifySaveFile(const std::string& path);
+
+enum class SaveCheck {
+    Pending,    // Not checked yet in its current state, queued for the worker or still open in the game
+    Good,
+    Bad,
+};
+
+// Verifies saves on a background thread, each file is checked once for as long as its size and write time stay the same
+// A file whose stamp changed is hashed first, the same content keeps its result without being walked again
+class SaveVerifier {
+private:
+    struct CachedResult {
+        std::uint64_t size;
+        std::int64_t writeTime;
+        bool stamped;  // False for results remembered from the index, only their CRC can match
+        SaveVerifyResult result;
+    };
+
+    std::function<void()> onVerified;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<std::string> queue;
+    std::unordered_set<std::string> queued;
+    std::unordered_map<std::string, CachedResult> cache;  // By .ess path
+    bool stopping = false;
+
+    std::thread worker;
+
+    void RunWorker();
+
+public:
+    // onVerified is called from the worker each time a file has been checked
+    explicit SaveVerifier(std::function<void()> onVerified);
+
+    // Abandons whatever is still queued
+    ~SaveVerifier();
+
+    SaveVerifier(const SaveVerifier&) = delete;
+    SaveVerifier& operator=(const SaveVerifier&) = delete;
+
+    // The result for the file as it is now, a file without one is queued and reported as pending
+    // Costs a stat of the file, result is filled in for good and bad saves
+    SaveCheck Check(const std::string& path, SaveVerifyResult* result = nullptr);
+
+    // Drops the cached result of a file that is being deleted
+    void Forget(const std::string& path);
+
+    // Takes a good result from an earlier session, the file is hashed again but not walked if it still has this CRC
+    void Remember(const std::string& path, std::uint32_t crc);
+
+    // The CRC of the file's last good result, whether or not the file has changed since
+    bool GetGoodCrc(const std::string& path, std::uint32_t& crc);
+};
@@ -0,0 +1,233 @@
+// Checks the deletion queue's hold back, retry, budget and shutdown paths against a scripted remover
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DeletionQueue.h"
+#include "IoBudget.h"
+#include "SaveRemover.h"
+#include "TestCheck.h"
+
+namespace {
+    using namespace std::chrono_literals;
+    using Clock = std::chrono::steady_clock;
+
+    void WriteFile(const std::filesystem::path& path) {
+        std::ofstream(path, std::ios::binary) << "save";
+    }
+
+    std::vector<std::string> WriteFiles(const std::filesystem::path& dir, const std::string& prefix, int count) {
+        std::vector<std::string> paths;
+        for (int i = 0; i < count; i++) {
+            std::filesystem::path path = dir / (prefix + std::to_string(i) + ".ess");
+            WriteFile(path);
+            paths.push_back(path.string());
+        }
+        return paths;
+    }
+
+    // Deletes the files it is given, unless a path has scripted results left, those are handed out first
+    // Shared with the test so it can still be inspected once the queue owns the remover
+    struct RemoverLog {
+        std::mutex mutex;
+        std::map<std::string, std::vector<RemoveResult>> scripted;
+        std::map<std::string, int> calls;
+        Clock::duration batchDelay = Clock::duration::zero();
+
+        int GetCalls(const std::string& path) {
+            std::lock_guard lock(mutex);
+            return calls[path];
+        }
+    };
+
+    class ScriptedRemover : public SaveRemover {
+        std::shared_ptr<RemoverLog> log;
+
+    public:
+        explicit ScriptedRemover(std::shared_ptr<RemoverLog> log) : log(std::move(log)) {}
+
+        void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+            std::this_thread::sleep_for(log->batchDelay);
+            std::lock_guard lock(log->mutex);
+            results.clear();
+            for (const std::string& path : paths) {
+                log->calls[path]++;
+                std::vector<RemoveResult>& script = log->scripted[path];
+                if (!script.empty()) {
+                    results.push_back(script.front());
+                    script.erase(script.begin());
+                    continue;
+                }
+                std::error_code error;
+                results.push_back(std::filesystem::remove(path, error) ? RemoveResult::Removed : RemoveResult::Missing);
+            }
+        }
+    };
+
+    void TestRemoves(const std::filesystem::path& dir) {
+        auto log = std::make_shared<RemoverLog>();
+        DeletionQueue queue(std::make_unique<ScriptedRemover>(log), 2, 4);
+        std::vector<std::string> paths = WriteFiles(dir, "Remove", 10);
+        paths.push_back((dir / "Missing.ess").string());
+        queue.Enqueue(paths);
+        queue.WaitIdle();
+
+        CHECK(queue.GetRemovedCount() == 10);
+        CHECK(queue.GetFailedCount() == 0);
+        for (int i = 0; i < 10; i++) CHECK(!std::filesystem::exists(paths[i]));
+    }
+
+    void TestHoldBack(const std::filesystem::path& dir) {
+        auto log = std::make_shared<RemoverLog>();
+        DeletionQueue queue(std::make_unique<ScriptedRemover>(log));
+        queue.SetMinFileAge(300ms);
+        std::vector<std::string> paths = WriteFiles(dir, "New", 2);
+        auto start = Clock::now();
+        queue.Enqueue(paths);
+
+        // A file the game may still be writing is not handed to the remover at all
+        std::this_thread::sleep_for(100ms);
+        CHECK(std::filesystem::exists(paths[0]));
+        CHECK(log->GetCalls(paths[0]) == 0);
+
+        queue.WaitIdle();
+        CHECK(Clock::now() - start >= 200ms);
+        CHECK(!std::filesystem::exists(paths[0]));
+        CHECK(log->GetCalls(paths[0]) == 1);
+        CHECK(queue.GetRemovedCount() == 2);
+    }
+
+    void TestRetry(const std::filesystem::path& dir) {
+        auto log = std::make_shared<RemoverLog>();
+        std::vector<std::string> paths = WriteFiles(dir, "Retry", 2);
+        log->scripted[paths[0]] = { RemoveResult::Retry };
+        log->scripted[paths[1]] = { RemoveResult::Failed };
+        DeletionQueue queue(std::make_unique<ScriptedRemover>(log));
+        auto start = Clock::now();
+        queue.Enqueue(paths);
+        queue.WaitIdle();
+
+        // A file in use is tried again after retryDelay, a failed one is given up on straight away
+        CHECK(Clock::now() - start >= DeletionQueue::retryDelay - 100ms);
+        CHECK(log->GetCalls(paths[0]) == 2);
+        CHECK(!std::filesystem::exists(paths[0]));
+        CHECK(log->GetCalls(paths[1]) == 1);
+        CHECK(std::filesystem::exists(paths[1]));
+        CHECK(queue.GetRemovedCount() == 1);
+        CHECK(queue.GetFailedCount() == 1);
+    }
+
+    void TestDefer(const std::filesystem::path& dir) {
+        auto log = std::make_shared<RemoverLog>();
+        std::atomic<bool> gameBusy = true;
+        std::vector<std::string> paths = WriteFiles(dir, "Defer", 3);
+        {
+            DeletionQueue queue(std::make_unique<ScriptedRemover>(log));
+            queue.SetDeferCheck([&gameBusy] { return gameBusy.load(); });
+            queue.Enqueue({ paths[0] });
+            std::this_thread::sleep_for(100ms);
+            CHECK(std::filesystem::exists(paths[0]));
+
+            gameBusy = false;
+            queue.WaitIdle();
+            CHECK(!std::filesystem::exists(paths[0]));
+
+            // The game no longer needs the disk once the queue is destroyed, what is left goes right away
+            gameBusy = true;
+            queue.Enqueue({ paths[1], paths[2] });
+        }
+        CHECK(!std::filesystem::exists(paths[1]));
+        CHECK(!std::filesystem::exists(paths[2]));
+    }
+
+    void TestBudget(const std::filesystem::path& dir) {
+        // Starts with a second of budget, the other half of the files wait for it to refill
+        auto log = std::make_shared<RemoverLog>();
+        DeletionQueue queue(std::make_unique<ScriptedRemover>(log));
+        queue.SetBudget(5, 0);
+        std::vector<std::string> paths = WriteFiles(dir, "Budget", 10);
+        auto start = Clock::now();
+        queue.Enqueue(paths);
+        queue.WaitIdle();
+        CHECK(Clock::now() - start >= 800ms);
+        CHECK(queue.GetRemovedCount() == 10);
+    }
+
+    void TestBudgetRefund(const std::filesystem::path& dir) {
+        // The only op of the budget is reserved for a file that is then held back
+        // Given back, the file goes as soon as it is old enough instead of waiting for the bucket to refill
+        auto log = std::make_shared<RemoverLog>();
+        DeletionQueue queue(std::make_unique<ScriptedRemover>(log));
+        queue.SetBudget(0.5, 0);
+        queue.SetMinFileAge(200ms);
+        std::vector<std::string> paths = WriteFiles(dir, "Refund", 1);
+        auto start = Clock::now();
+        queue.Enqueue(paths);
+        queue.WaitIdle();
+        CHECK(Clock::now() - start < 1s);
+        CHECK(queue.GetRemovedCount() == 1);
+    }
+
+    void TestIoBudget() {
+        auto now = std::chrono::steady_clock::now();
+        IoBudget budget(10, 0);
+        CHECK(budget.AvailableOps(1, now) == 10);
+        budget.Spend(10, 0, now);
+        CHECK(budget.ReadyAt(now) > now);
+
+        // Refunds fill the bucket back up, but never past a second of budget
+        budget.Spend(-10, 0, now);
+        CHECK(budget.ReadyAt(now) == now);
+        budget.Spend(-100, 0, now);
+        CHECK(budget.AvailableOps(1, now) == 10);
+        budget.Spend(11, 0, now);
+        CHECK(budget.ReadyAt(now) > now);
+    }
+
+    void TestStopBy(const std::filesystem::path& dir) {
+        auto log = std::make_shared<RemoverLog>();
+        log->batchDelay = 50ms;
+        DeletionQueue queue(std::make_unique<ScriptedRemover>(log), 1, 1);
+        std::vector<std::string> paths = WriteFiles(dir, "Stop", 20);
+        queue.Enqueue(paths);
+
+        // Batches already with the remover finish, whatever is still queued at the deadline is dropped
+        auto start = Clock::now();
+        size_t dropped = queue.StopBy(start + 120ms);
+        CHECK(Clock::now() - start < 500ms);
+        CHECK(dropped > 0);
+        CHECK(queue.GetRemovedCount() > 0);
+        CHECK(queue.GetRemovedCount() + dropped == paths.size());
+        CHECK(std::filesystem::exists(paths.back()));
+
+        // Stopping again keeps the first deadline and count
+        CHECK(queue.StopBy(Clock::time_point::max()) == dropped);
+    }
+}
+
+int main() {
+    std::error_code error;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(error) / "DeletionQueueTest";
+    std::filesystem::remove_all(dir, error);
+    std::filesystem::create_directories(dir, error);
+
+    TestRemoves(dir);
+    TestHoldBack(dir);
+    TestRetry(dir);
+    TestDefer(dir);
+    TestBudget(dir);
+    TestBudgetRefund(dir);
+    TestIoBudget();
+    TestStopBy(dir);
+
+    std::filesystem::remove_all(dir, error);
+    return TestResult();
+}
@@ -0,0 +1,149 @@
+// Reads the fixture headers in Tests/Fixtures and checks the save fields taken from them
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "EssHeader.h"
+#include "SaveChain.h"
+#include "SaveGame.h"
+#include "SaveNameParser.h"
+#include "TestCheck.h"
+#include "UserVars.h"
+
+namespace {
+    std::string fixtureDir;
+
+    std::optional<EssHeader> ReadFixture(const char* fileName) {
+        return ReadEssHeader((std::filesystem::path(fixtureDir) / fileName).string());
+    }
+
+    // 2024-01-01 12:30:45 UTC, the FILETIME every fixture was written with
+    constexpr std::int64_t fixtureTime = DaysFromCivil(2024, 1, 1) * 86400 + 12 * 3600 + 30 * 60 + 45;
+
+    void TestSpecialEdition() {
+        std::optional<EssHeader> header = ReadFixture("SpecialEdition.ess");
+        CHECK(header);
+        if (!header) return;
+        CHECK(header->version == 12);
+        CHECK(header->saveNumber == 57);
+        CHECK(header->playerName == "Dovahkiin");
+        CHECK(header->playerLevel == 12);
+        CHECK(header->playerLocation == "Whiterun");
+        CHECK(header->gameDate == "3.14.25");
+        CHECK(header->playerRace == "NordRace");
+        CHECK(header->playerSex == 0);
+        CHECK(header->shotWidth == 320 && header->shotHeight == 192);
+        CHECK(header->compressionType == 2);
+        CHECK(header->GetSaveTime() == fixtureTime);
+        CHECK(header->GetGameTime() == ((3 * 24 + 14) * 60 + 25) * 60);
+    }
+
+    // Versions before 12 have no compression type
+    void TestLegendaryEdition() {
+        std::optional<EssHeader> header = ReadFixture("LegendaryEdition.ess");
+        CHECK(header);
+        if (!header) return;
+        CHECK(header->version == 9);
+        CHECK(header->saveNumber == 8);
+        CHECK(header->playerName == "Lydia");
+        CHECK(header->playerSex == 1);
+        CHECK(header->compressionType == 0);
+        CHECK(header->GetGameTime() == (2 * 60 + 5) * 60);
+    }
+
+    void TestBadHeaders() {
+        std::optional<EssHeader> header = ReadFixture("UnreadableGameDate.ess");
+        CHECK(header);
+        if (header) CHECK(!header->GetGameTime());
+
+        CHECK(!ReadFixture("Truncated.ess"));
+        CHECK(!ReadFixture("NotASave.ess"));
+        CHECK(!ReadFixture("Missing.ess"));
+    }
+
+    // The header fills in what the name is missing
+    void TestApplyHeader() {
+        std::optional<EssHeader> header = ReadFixture("SpecialEdition.ess");
+        if (!header) return;
+
+        SaveGame noTimestamp("Save57_0000AAA1_0_00_Whiterun");
+        CHECK(noTimestamp.GetParseErrors() == SaveNameBadTimestamp);
+        noTimestamp.ApplyHeader(&*header, 0, false);
+        CHECK(noTimestamp.GetTime() == fixtureTime);
+
+        SaveGame noNumber("SaveXX_0000AAA1_0_00_Whiterun_000000_20240101123045_1_1");
+        noNumber.ApplyHeader(&*header, 0, false);
+        CHECK(noNumber.GetNumber() == 57);
+        CHECK(noNumber.GetTime() == fixtureTime);
+
+        SaveGame gameTime("Save57_0000AAA1_0_00_Whiterun_000000_20240101123045_1_1");
+        gameTime.ApplyHeader(&*header, 0, true);
+        CHECK(!gameTime.IsMissingGameTime());
+        CHECK(gameTime.GetTime() == ((3 * 24 + 14) * 60 + 25) * 60);
+
+        // Without a header the write time stands in, put on the same base as the names
+        SaveGame writeTime("Save57_0000AAA1_0_00_Whiterun");
+        writeTime.ApplyHeader(nullptr, fixtureTime, false);
+        CHECK(writeTime.GetTime() == fixtureTime);
+    }
+
+    // A save without a game time must not keep its real time, which would sort it as the newest save
+    void TestMissingGameTime() {
+        std::optional<EssHeader> header = ReadFixture("UnreadableGameDate.ess");
+        if (!header) return;
+        SaveGame save("Save58_0000AAA1_0_00_Whiterun_000000_20240101123045_1_1");
+        save.ApplyHeader(&*header, 0, true);
+        CHECK(save.IsMissingGameTime());
+        SaveGame unread("Save59_0000AAA1_0_00_Whiterun_000000_20240101123045_1_1");
+        unread.ApplyHeader(nullptr, 0, true);
+        CHECK(unread.IsMissingGameTime());
+
+        UserVars userVars = ReadUserVars("");
+        userVars.useGameTime = true;
+        auto makeSaves = [](std::vector<std::uint32_t> missing) {
+            std::vector<SaveGame> saves;
+            for (std::uint32_t number = 1; number <= 6; number++) {
+                std::string name = "Save" + std::to_string(number) + "_0000AAA1_0_00_Whiterun_000000_20240101123045_1_1";
+                saves.emplace_back(name, number, 0xAAA1, static_cast<time_t>(number * 1000));
+                if (std::find(missing.begin(), missing.end(), number) != missing.end()) saves.back().SetMissingGameTime();
+            }
+            return saves;
+        };
+        auto order = [](const SaveChain& chain) {
+            std::vector<std::uint32_t> numbers;
+            chain.ForEachSave([&numbers](const SaveView& view, SaveBlock) { numbers.push_back(view.number); });
+            return numbers;
+        };
+        const std::vector<std::uint32_t> byNumber = { 6, 5, 4, 3, 2, 1 };
+
+        // Built at once and added one at a time, the flagged saves sit between the saves numbered around them
+        for (const std::vector<std::uint32_t>& missing : std::vector<std::vector<std::uint32_t>>{ { 6 }, { 3 }, { 1, 2 }, { 1, 2, 3, 4, 5, 6 } }) {
+            SaveChain built(userVars);
+            built.BuildFromBatch(makeSaves(missing));
+            CHECK(order(built) == byNumber);
+
+            SaveChain added(userVars);
+            for (SaveGame& save : makeSaves(missing)) added.AddSave(std::move(save));
+            CHECK(order(added) == byNumber);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: EssHeaderTest <fixture folder>\n");
+        return 1;
+    }
+    fixtureDir = argv[1];
+    UseUtcTimeZone();
+
+    TestSpecialEdition();
+    TestLegendaryEdition();
+    TestBadHeaders();
+    TestApplyHeader();
+    TestMissingGameTime();
+    return TestResult();
+}
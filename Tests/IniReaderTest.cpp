@@ -0,0 +1,143 @@
+// Checks the ini reader against the SaveManager.ini that ships with the plugin, and that edits are picked up
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "IniReader.h"
+#include "TestCheck.h"
+#include "UserVars.h"
+
+namespace {
+    void WriteIni(const std::filesystem::path& path, const std::string& text) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+    }
+
+    // The shipped file holds the defaults the mod page documents, some differ from the fallbacks in ReadUserVars
+    void TestShippedIni(const std::string& path, const std::filesystem::path& dir) {
+        CHECK(IniReader::GetWriteTime(path) != 0);
+        UserVars vars = ReadUserVars(path);
+        CHECK(vars.pollTime == 5.0f);
+        CHECK(vars.watchSaveFolder);
+        CHECK(vars.debounceTime == 10.0f);
+        CHECK(vars.recycle);
+        CHECK(!vars.dryRun);
+        CHECK(!vars.archiveOverflow);
+        CHECK(!vars.dedupOldSaves);
+        CHECK(vars.coldSaveFolder.empty());
+        CHECK(vars.coldFromBlock == 3);
+        CHECK(vars.maxDeletesPerSecond == 10.0f);
+        CHECK(vars.maxDeleteMBPerSecond == 100.0f);
+        CHECK(vars.minSaveAge == 10.0f);
+        CHECK(vars.verifySaves);
+        CHECK(!vars.useGameTime);
+        CHECK(!vars.enableMetrics);
+        CHECK(vars.maxFolderMB == -1);
+
+        // An empty sTierLayout leaves the four blocks given by their counts and spacings
+        CHECK(vars.tierCount == defaultTierCount);
+        CHECK(vars.tiers[0] == RetentionTier({ 16, 0.0f }));
+        CHECK(vars.tiers[1] == RetentionTier({ 32, 0.5f }));
+        CHECK(vars.tiers[2] == RetentionTier({ 128, 1.0f }));
+        CHECK(vars.tiers[3] == RetentionTier({ -1, 4.0f }));
+
+        // The layout the file's comment calls the same as these settings gives the same blocks
+        WriteIni(dir / "Layout.ini", "[SaveManager]\nsTierLayout = 16, 32:0.5, 128:1, -1:4\n");
+        UserVars layoutVars = ReadUserVars((dir / "Layout.ini").string());
+        CHECK(layoutVars.tierCount == vars.tierCount);
+        CHECK(layoutVars.tiers == vars.tiers);
+
+        // Values keep what follows them on the line, numbers are read up to a trailing comment
+        IniReader reader(path, "SaveManager");
+        CHECK(reader.ReadStr("sTierLayout", "missing").empty());
+        CHECK(reader.ReadStr("fPollTime", "") == "5.0 ; minutes");
+        CHECK(reader.ReadStr("NotAKey", "missing") == "missing");
+    }
+
+    void TestParsing(const std::filesystem::path& dir) {
+        std::filesystem::path path = dir / "Parsing.ini";
+        WriteIni(path,
+            "\xEF\xBB\xBF" "Orphan = 1\n"
+            "[Other]\n"
+            "iValue = 7\n"
+            "[ saveManager ]\r\n"
+            "; comment = 1\n"
+            "# comment = 2\n"
+            "  IVALUE   =  42  \r\n"
+            "iValue = 43\n"
+            "sQuoted = \"  padded  \"\n"
+            "sSingle = 'x'\n"
+            "sMismatched = \"x'\n"
+            "sEmpty =\n"
+            "bYes = TRUE\n"
+            "bNo = yes\n"
+            "fBad = fast\n"
+            "no equals sign\n");
+
+        IniReader reader(path.string(), "SaveManager");
+        CHECK(reader.ReadInt("iValue", 0) == 42);
+        CHECK(reader.ReadStr("sQuoted", "") == "  padded  ");
+        CHECK(reader.ReadStr("sSingle", "") == "x");
+        CHECK(reader.ReadStr("sMismatched", "") == "\"x'");
+        CHECK(reader.ReadStr("sEmpty", "missing").empty());
+        CHECK(reader.ReadBool("bYes", "false"));
+        CHECK(!reader.ReadBool("bNo", "true"));
+        CHECK(reader.ReadBool("bMissing", "true"));
+        CHECK(reader.ReadFloat("fBad", 2.5f) == 2.5f);
+        CHECK(reader.ReadInt("Orphan", -1) == -1);
+        CHECK(reader.ReadInt("# comment", -1) == -1);
+
+        CHECK(IniReader(path.string(), "Other").ReadInt("iValue", 0) == 7);
+        CHECK(IniReader(path.string(), "Missing").ReadInt("iValue", -1) == -1);
+        CHECK(IniReader((dir / "Missing.ini").string(), "SaveManager").ReadInt("iValue", -1) == -1);
+    }
+
+    void TestEdits(const std::filesystem::path& dir) {
+        std::filesystem::path path = dir / "Edits.ini";
+        WriteIni(path, "[SaveManager]\niValue = 1\n");
+        IniReader before(path.string(), "SaveManager");
+        CHECK(before.ReadInt("iValue", 0) == 1);
+
+        // An edit of the same length is still noticed, its write time moved on
+        auto writeTime = std::filesystem::last_write_time(path);
+        WriteIni(path, "[SaveManager]\niValue = 2\n");
+        std::filesystem::last_write_time(path, writeTime + std::chrono::seconds(2));
+        IniReader after(path.string(), "SaveManager");
+        CHECK(after.ReadInt("iValue", 0) == 2);
+
+        // A reader keeps the values it was made with
+        CHECK(before.ReadInt("iValue", 0) == 1);
+
+        // An edit that keeps the write time is noticed too, as long as the length changed
+        writeTime = std::filesystem::last_write_time(path);
+        WriteIni(path, "[SaveManager]\niValue = 300\n");
+        std::filesystem::last_write_time(path, writeTime);
+        CHECK(IniReader(path.string(), "SaveManager").ReadInt("iValue", 0) == 300);
+
+        // A file that goes away reads as empty
+        std::filesystem::remove(path);
+        CHECK(IniReader(path.string(), "SaveManager").ReadInt("iValue", -1) == -1);
+        CHECK(IniReader::GetWriteTime(path.string()) == 0);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: IniReaderTest <SaveManager.ini>\n");
+        return 1;
+    }
+
+    std::error_code error;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(error) / "IniReaderTest";
+    std::filesystem::remove_all(dir, error);
+    std::filesystem::create_directories(dir, error);
+
+    TestShippedIni(argv[1], dir);
+    TestParsing(dir);
+    TestEdits(dir);
+
+    std::filesystem::remove_all(dir, error);
+    return TestResult();
+}
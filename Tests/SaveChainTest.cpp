@@ -0,0 +1,172 @@
+// Checks that a chain built from a batch keeps and deletes the same saves as one built a save at a time
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "SaveChain.h"
+#include "TestCheck.h"
+#include "UserVars.h"
+
+namespace {
+    struct ChainResult {
+        std::vector<std::pair<std::string, SaveBlock>> kept;
+        std::vector<std::string> deleted;
+
+        bool operator==(const ChainResult&) const = default;
+    };
+
+    struct TestSave {
+        std::string name;
+        std::uint32_t number;
+        time_t time;
+    };
+
+    ChainResult Collect(SaveChain& chain, std::vector<std::string> deleted) {
+        ChainResult result;
+        chain.ForEachSave([&result](const SaveView& save, SaveBlock block) {
+            result.kept.emplace_back(std::string(save.saveName), block);
+        });
+        for (DeletedSave& deletedSave : chain.TakeDeletedSaves()) deleted.push_back(std::move(deletedSave.saveName));
+        std::sort(deleted.begin(), deleted.end());
+        result.deleted = std::move(deleted);
+        return result;
+    }
+
+    SaveGame MakeSave(const TestSave& save) {
+        SaveGame game(save.name, save.number, 0xAAA1, save.time);
+        game.SetSize(1024);
+        return game;
+    }
+
+    // A random tier layout, with small blocks so that saves cascade through all of them
+    UserVars MakeUserVars(std::mt19937& random) {
+        UserVars userVars = ReadUserVars("");
+        userVars.tierCount = std::uniform_int_distribution<int>(2, maxTierCount)(random);
+        for (int i = 0; i < userVars.tierCount; i++) {
+            int count = std::uniform_int_distribution<int>(1, 12)(random);
+            float spacing = i == 0 ? 0.0f : std::uniform_int_distribution<int>(0, 8)(random) * 0.25f;
+            userVars.tiers[i] = { count, spacing };
+        }
+        if (random() % 3 == 0) userVars.tiers[userVars.tierCount - 1].count = -1;
+        return userVars;
+    }
+
+    // Saves made in number order, minutes to hours apart, sometimes in the same second
+    std::vector<TestSave> MakeSaves(std::mt19937& random) {
+        std::vector<TestSave> saves;
+        size_t count = std::uniform_int_distribution<size_t>(0, 300)(random);
+        time_t time = 1704067200;
+        for (std::uint32_t number = 1; number <= count; number++) {
+            int gap = std::uniform_int_distribution<int>(0, 9)(random);
+            time += gap == 0 ? 0 : std::uniform_int_distribution<int>(60, 4 * 3600)(random);
+            saves.push_back({ "Save" + std::to_string(number) + "_0000AAA1", number, time });
+        }
+        return saves;
+    }
+
+    void TestBatchMatchesIncremental() {
+        int mismatches = 0;
+        for (std::uint32_t seed = 0; seed < 200; seed++) {
+            std::mt19937 random(seed);
+            UserVars userVars = MakeUserVars(random);
+            std::vector<TestSave> saves = MakeSaves(random);
+
+            // The game makes saves in time order, so that is the order AddSave sees them in
+            SaveChain added(userVars);
+            std::vector<std::string> addedDeletes;
+            for (const TestSave& save : saves) {
+                added.AddSave(MakeSave(save));
+                for (DeletedSave& deletedSave : added.TakeDeletedSaves()) addedDeletes.push_back(std::move(deletedSave.saveName));
+            }
+            ChainResult incremental = Collect(added, std::move(addedDeletes));
+
+            // The batch is handed over in any order
+            std::shuffle(saves.begin(), saves.end(), random);
+            std::vector<SaveGame> batch;
+            for (const TestSave& save : saves) batch.push_back(MakeSave(save));
+            SaveChain built(userVars);
+            built.BuildFromBatch(std::move(batch));
+            ChainResult bulk = Collect(built, {});
+
+            CHECK(built.CheckBlockIntegrity(true));
+            if (!(bulk == incremental)) {
+                std::fprintf(stderr, "Seed %u: batch keeps %zu saves, one at a time keeps %zu\n", seed, bulk.kept.size(), incremental.kept.size());
+                mismatches++;
+            }
+        }
+        CHECK(mismatches == 0);
+    }
+
+    // The same batch in another order builds the same chain
+    void TestBatchOrder() {
+        for (std::uint32_t seed = 0; seed < 50; seed++) {
+            std::mt19937 random(seed);
+            UserVars userVars = MakeUserVars(random);
+            std::vector<TestSave> saves = MakeSaves(random);
+
+            ChainResult first;
+            for (int pass = 0; pass < 2; pass++) {
+                std::shuffle(saves.begin(), saves.end(), random);
+                std::vector<SaveGame> batch;
+                for (const TestSave& save : saves) batch.push_back(MakeSave(save));
+                SaveChain chain(userVars);
+                chain.BuildFromBatch(std::move(batch));
+                ChainResult result = Collect(chain, {});
+                if (pass == 0) first = std::move(result);
+                else CHECK(result == first);
+            }
+        }
+    }
+
+    // Saves removed outside the manager leave every block full up to the last one that holds saves
+    void TestRemoveSave() {
+        for (std::uint32_t seed = 0; seed < 50; seed++) {
+            std::mt19937 random(seed);
+            UserVars userVars = MakeUserVars(random);
+            std::vector<TestSave> saves = MakeSaves(random);
+            std::vector<SaveGame> batch;
+            for (const TestSave& save : saves) batch.push_back(MakeSave(save));
+            SaveChain chain(userVars);
+            chain.BuildFromBatch(std::move(batch));
+            chain.TakeDeletedSaves();
+
+            // A name that does not match changes nothing
+            size_t count = chain.GetSaveCount();
+            std::uint64_t bytes = chain.GetTotalBytes();
+            ChainResult before = Collect(chain, {});
+            if (count) {
+                std::uint32_t number = 0;
+                chain.ForEachSave([&number](const SaveView& save, SaveBlock) { number = save.number; });
+                CHECK(!chain.RemoveSave(number, "NotTheSave"));
+            }
+            CHECK(!chain.RemoveSave(0, "Save0_0000AAA1"));
+            CHECK(chain.GetSaveCount() == count && chain.GetTotalBytes() == bytes);
+            CHECK(Collect(chain, {}) == before);
+
+            while (chain.GetSaveCount() > 0) {
+                std::vector<std::pair<std::string, std::uint32_t>> held;
+                chain.ForEachSave([&held](const SaveView& save, SaveBlock) { held.emplace_back(std::string(save.saveName), save.number); });
+                auto& removed = held[random() % held.size()];
+                CHECK(chain.RemoveSave(removed.second, removed.first));
+                CHECK(chain.CheckBlockIntegrity(true));
+
+                std::vector<size_t> blockSizes(userVars.tierCount);
+                chain.ForEachSave([&blockSizes](const SaveView&, SaveBlock block) { blockSizes[block]++; });
+                for (int block = 0; block + 1 < userVars.tierCount; block++) {
+                    if (blockSizes[block + 1] > 0) CHECK(blockSizes[block] == static_cast<size_t>(userVars.tiers[block].count));
+                }
+            }
+            CHECK(chain.GetTotalBytes() == 0);
+        }
+    }
+}
+
+int main() {
+    TestBatchMatchesIncremental();
+    TestBatchOrder();
+    TestRemoveSave();
+    return TestResult();
+}
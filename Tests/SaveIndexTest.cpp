@@ -0,0 +1,185 @@
+// Checks that a damaged or foreign save index is never used, and that a stale one only saves rereading unchanged saves
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "SaveIndex.h"
+#include "SaveManager.h"
+#include "TestCheck.h"
+#include "UserVars.h"
+
+namespace {
+    constexpr std::uint64_t sourceHash = 0x1234;
+
+    std::vector<char> ReadBytes(const std::filesystem::path& path) {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    void WriteBytes(const std::filesystem::path& path, const std::vector<char>& bytes) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+    }
+
+    std::string SaveName(int number) {
+        char name[96];
+        std::snprintf(name, sizeof(name), "Save%d_0A1B2C3D_0_4A6F686E_Whiterun_000123_202401011%02d000_5_1", number, number);
+        return name;
+    }
+
+    void TestRoundTrip(const std::filesystem::path& dir) {
+        std::string path = (dir / "RoundTrip.idx").string();
+        std::vector<IndexedSave> saves = {
+            { "Save1_A", 1, 7, 100, 1000 },
+            { "Save2_A", 2, 7, 200, 2000, true, 0xDEADBEEF },
+            { "Save3_B", 3, 9, 300, 3000 },
+        };
+        CHECK(SaveIndex::Write(path, sourceHash, 42, saves));
+
+        SaveIndex index;
+        CHECK(index.Open(path, sourceHash));
+        CHECK(index.GetDirWriteTime() == 42);
+        CHECK(index.GetRecords().size() == 3);
+        for (const IndexedSave& save : saves) {
+            const SaveIndexRecord* record = index.Find(save.name);
+            CHECK(record && index.GetName(*record) == save.name);
+            if (!record) continue;
+            CHECK(record->number == save.number && record->chainId == save.chainId);
+            CHECK(record->time == save.time && record->size == save.size);
+            CHECK((record->verified != 0) == save.verified && record->crc == save.crc);
+        }
+        CHECK(index.Find("Save4_A") == nullptr);
+        CHECK(index.Find("") == nullptr);
+
+        // The temporary file is renamed over the old index
+        CHECK(!std::filesystem::exists(path + ".tmp"));
+    }
+
+    void TestCorruption(const std::filesystem::path& dir) {
+        std::filesystem::path path = dir / "Corrupt.idx";
+        std::vector<IndexedSave> saves = { { "Save1_A", 1, 7, 100, 1000 }, { "Save2_A", 2, 7, 200, 2000 } };
+        CHECK(SaveIndex::Write(path.string(), sourceHash, 42, saves));
+        const std::vector<char> good = ReadBytes(path);
+        CHECK(good.size() == sizeof(SaveIndexHeader) + 2 * sizeof(SaveIndexRecord) + 14);
+
+        SaveIndex index;
+        CHECK(!index.Open((dir / "Missing.idx").string(), sourceHash));
+        CHECK(!index.Open(path.string(), sourceHash + 1));
+
+        auto opensWith = [&](auto change) {
+            std::vector<char> bytes = good;
+            change(bytes);
+            WriteBytes(path, bytes);
+            return index.Open(path.string(), sourceHash);
+        };
+        CHECK(opensWith([](std::vector<char>&) {}));
+        CHECK(!opensWith([](std::vector<char>& bytes) { bytes[0] = 'X'; }));
+        CHECK(!opensWith([](std::vector<char>& bytes) { bytes[offsetof(SaveIndexHeader, version)]++; }));
+        CHECK(!opensWith([](std::vector<char>& bytes) { bytes[offsetof(SaveIndexHeader, checksum)] ^= 1; }));
+        CHECK(!opensWith([](std::vector<char>& bytes) { bytes[sizeof(SaveIndexHeader) + offsetof(SaveIndexRecord, size)] ^= 1; }));
+        CHECK(!opensWith([](std::vector<char>& bytes) { bytes.back() ^= 1; }));
+        CHECK(!opensWith([](std::vector<char>& bytes) { bytes.pop_back(); }));
+        CHECK(!opensWith([](std::vector<char>& bytes) { bytes.push_back(0); }));
+        CHECK(!opensWith([](std::vector<char>& bytes) { bytes.resize(sizeof(SaveIndexHeader) - 1); }));
+        CHECK(!opensWith([](std::vector<char>& bytes) { bytes.clear(); }));
+        CHECK(!opensWith([](std::vector<char>& bytes) {
+            std::uint64_t count = UINT64_MAX / sizeof(SaveIndexRecord) + 1;
+            std::memcpy(bytes.data() + offsetof(SaveIndexHeader, recordCount), &count, sizeof(count));
+        }));
+
+        // A failed open leaves nothing behind from the one before it
+        CHECK(index.GetRecords().empty());
+    }
+
+    // Index records as the manager left them, keyed by save name
+    std::vector<std::pair<std::string, std::uint32_t>> ReadManagerIndex(const std::string& indexPath, const std::string& saveDir) {
+        std::vector<std::pair<std::string, std::uint32_t>> saves;
+        SaveIndex index;
+        if (!index.Open(indexPath, GetIndexSourceHash(saveDir, false))) return saves;
+        for (const SaveIndexRecord& record : index.GetRecords()) {
+            saves.emplace_back(std::string(index.GetName(record)), record.number);
+        }
+        std::sort(saves.begin(), saves.end());
+        return saves;
+    }
+
+    void TestManagerFallback(const std::filesystem::path& dir) {
+        std::filesystem::path saveDir = dir / "Saves";
+        std::filesystem::create_directories(saveDir);
+        for (int i = 1; i <= 3; i++) WriteBytes(saveDir / (SaveName(i) + ".ess"), std::vector<char>(100 * i, 'x'));
+        std::string indexPath = (dir / "Manager.idx").string();
+        std::uint64_t hash = GetIndexSourceHash(saveDir.string(), false);
+
+        UserVars vars = ReadUserVars((dir / "Missing.ini").string());
+        vars.verifySaves = false;
+        vars.minSaveAge = 0;
+        auto startManager = [&] {
+            SaveManager manager(vars, saveDir.string(), indexPath);
+            manager.Shutdown(std::chrono::seconds(5));
+            return ReadManagerIndex(indexPath, saveDir.string());
+        };
+        using Saves = std::vector<std::pair<std::string, std::uint32_t>>;
+        const Saves onDisk = { { SaveName(1), 1 }, { SaveName(2), 2 }, { SaveName(3), 3 } };
+
+        // No index yet, the folder is scanned and an index written
+        CHECK(startManager() == onDisk);
+
+        // A garbled index is ignored and replaced
+        WriteBytes(indexPath, std::vector<char>(200, 'g'));
+        CHECK(startManager() == onDisk);
+
+        // An index whose stamp still matches the folder is trusted as is, the folder is not listed
+        std::int64_t stamp = GetDirWriteTime(saveDir.string());
+        std::string ghost = SaveName(9);
+        std::vector<IndexedSave> saves = {
+            { onDisk[0].first, 1, 0x0A1B2C3D, 1704103200, 100 },
+            { onDisk[1].first, 2, 0x0A1B2C3D, 1704103800, 200 },
+            { onDisk[2].first, 3, 0x0A1B2C3D, 1704104400, 300 },
+            { ghost, 9, 0x0A1B2C3D, 1704107400, 900 },
+        };
+        CHECK(SaveIndex::Write(indexPath, hash, stamp, saves));
+        Saves withGhost = onDisk;
+        withGhost.emplace_back(ghost, 9);
+        CHECK(startManager() == withGhost);
+
+        // A stale stamp lists the folder again, saves the index got wrong are dropped or read again
+        // Save 1 kept its size so its record is still used, save 2 changed size so it is read from disk
+        saves[0].number = 71;
+        saves[1].number = 72;
+        saves[1].size = 250;
+        CHECK(SaveIndex::Write(indexPath, hash, stamp - 1, saves));
+        CHECK(startManager() == Saves({ { SaveName(1), 71 }, { SaveName(2), 2 }, { SaveName(3), 3 } }));
+
+        // A stamp of 0 is never current, it is what an index is written with while saves are held back
+        saves[0].number = 1;
+        CHECK(SaveIndex::Write(indexPath, hash, 0, saves));
+        CHECK(startManager() == onDisk);
+
+        // An index written for another folder is not used for this one
+        CHECK(SaveIndex::Write(indexPath, GetIndexSourceHash((dir / "Other").string(), false), stamp, saves));
+        CHECK(startManager() == onDisk);
+    }
+}
+
+int main() {
+    UseUtcTimeZone();
+
+    std::error_code error;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(error) / "SaveIndexTest";
+    std::filesystem::remove_all(dir, error);
+    std::filesystem::create_directories(dir, error);
+
+    TestRoundTrip(dir);
+    TestCorruption(dir);
+    TestManagerFallback(dir);
+
+    std::filesystem::remove_all(dir, error);
+    return TestResult();
+}
@@ -0,0 +1,127 @@
+// Checks that save names are read field by field, whatever the character and location names hold
+
+#include <cstdint>
+#include <string_view>
+
+#include "SaveNameParser.h"
+#include "TestCheck.h"
+
+namespace {
+    static_assert(DaysFromCivil(1970, 1, 1) == 0);
+    static_assert(DaysFromCivil(2000, 3, 1) == 11017);
+    static_assert(DaysFromCivil(1969, 12, 31) == -1);
+
+    constexpr std::int64_t newYear2024 = DaysFromCivil(2024, 1, 1) * 86400;
+
+    void TestWellFormed() {
+        ParsedSaveName parsed = ParseSaveName("Save12_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240101123045_5_1");
+        CHECK(parsed.Ok());
+        CHECK(parsed.number == 12);
+        CHECK(parsed.chainId == 0x0A1B2C3D);
+        CHECK(parsed.time == newYear2024 + 12 * 3600 + 30 * 60 + 45);
+
+        // The name may end right after the timestamp
+        parsed = ParseSaveName("Save7_FFFFFFFF_20240229000000");
+        CHECK(parsed.Ok());
+        CHECK(parsed.chainId == 0xFFFFFFFF);
+        CHECK(parsed.time == DaysFromCivil(2024, 2, 29) * 86400);
+    }
+
+    void TestUnderscoresInNames() {
+        // Character and location names with underscores push the timestamp past the 7th field
+        ParsedSaveName parsed = ParseSaveName("Save3_0A1B2C3D_0_Jon_Snow_Whiterun_000123_20240101000010_5_1");
+        CHECK(parsed.Ok());
+        CHECK(parsed.number == 3);
+        CHECK(parsed.time == newYear2024 + 10);
+
+        parsed = ParseSaveName("Save4_0A1B2C3D_0_A__B_Dragon_s_Reach__Keep_000123_20240101000020_5_1");
+        CHECK(parsed.Ok());
+        CHECK(parsed.time == newYear2024 + 20);
+
+        // A name made of 14 digits looks like a timestamp, the last one in the name is the real one
+        parsed = ParseSaveName("Save5_0A1B2C3D_0_20231231000000_Whiterun_000123_20240101000030_5_1");
+        CHECK(parsed.Ok());
+        CHECK(parsed.time == newYear2024 + 30);
+
+        // A character name can even start with a digit or look like hex
+        parsed = ParseSaveName("Save6_0A1B2C3D_0_1_DEADBEEF_Whiterun_000123_20240101000040_5_1");
+        CHECK(parsed.Ok());
+        CHECK(parsed.chainId == 0x0A1B2C3D);
+        CHECK(parsed.time == newYear2024 + 40);
+    }
+
+    void TestMalformedTimestamps() {
+        const std::string_view badNames[] = {
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_2024010112304_5_1",   // 13 digits
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_202401011230450_5_1", // 15 digits
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_2024010112304X_5_1",  // Not a digit
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_2024-1011230450_5_1",
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_20241301123045_5_1",  // Month 13
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240001123045_5_1",  // Month 0
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240100123045_5_1",  // Day 0
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240132123045_5_1",  // Day 32
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240101243045_5_1",  // Hour 24
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240101126045_5_1",  // Minute 60
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240101123061_5_1",  // Second 61
+            "Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123",                     // No timestamp at all
+        };
+        for (std::string_view name : badNames) {
+            // The other fields are still read
+            ParsedSaveName parsed = ParseSaveName(name);
+            CHECK(parsed.errors == SaveNameBadTimestamp);
+            CHECK(parsed.time == 0);
+            CHECK(parsed.number == 1);
+            CHECK(parsed.chainId == 0x0A1B2C3D);
+        }
+
+        // A leap second is let through
+        CHECK(ParseSaveName("Save1_0A1B2C3D_0_4A6F686E_Whiterun_000123_20231231235960_5_1").Ok());
+
+        // A malformed last timestamp does not fall back to an earlier digit field
+        ParsedSaveName parsed = ParseSaveName("Save1_0A1B2C3D_0_20231231000000_Whiterun_000123_20241301123045_5_1");
+        CHECK(parsed.errors == SaveNameBadTimestamp);
+    }
+
+    void TestMalformedFields() {
+        ParsedSaveName parsed = ParseSaveName("SaveX_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240101123045_5_1");
+        CHECK(parsed.errors == SaveNameBadNumber);
+        CHECK(parsed.chainId == 0x0A1B2C3D);
+
+        parsed = ParseSaveName("Save99999999999_0A1B2C3D_0_4A6F686E_Whiterun_000123_20240101123045_5_1");
+        CHECK(parsed.errors == SaveNameBadNumber);
+
+        parsed = ParseSaveName("Save2_ZZZZ_0_4A6F686E_Whiterun_000123_20240101123045_5_1");
+        CHECK(parsed.errors == SaveNameBadChainId);
+        CHECK(parsed.number == 2);
+
+        // Only the first 8 digits of a longer id are read
+        parsed = ParseSaveName("Save2_0A1B2C3D99_0_4A6F686E_Whiterun_000123_20240101123045_5_1");
+        CHECK(parsed.Ok());
+        CHECK(parsed.chainId == 0x0A1B2C3D);
+
+        const std::uint8_t allBad = SaveNameBadNumber | SaveNameBadChainId | SaveNameBadTimestamp;
+        CHECK(ParseSaveName("").errors == allBad);
+        CHECK(ParseSaveName("Save").errors == allBad);
+        CHECK(ParseSaveName("Quicksave0").errors == allBad);
+        CHECK(ParseSaveName("save1_0A1B2C3D_20240101123045").errors == allBad);
+        CHECK(ParseSaveName("Save_").errors == allBad);
+        CHECK(ParseSaveName("Save3").errors == (SaveNameBadChainId | SaveNameBadTimestamp));
+    }
+
+    void TestUtcToNameTime() {
+        // On UTC the wall-clock base of save names is the true time
+        CHECK(UtcToNameTime(0) == 0);
+        CHECK(UtcToNameTime(newYear2024 + 45) == newYear2024 + 45);
+    }
+}
+
+int main() {
+    UseUtcTimeZone();
+
+    TestWellFormed();
+    TestUnderscoresInNames();
+    TestMalformedTimestamps();
+    TestMalformedFields();
+    TestUtcToNameTime();
+    return TestResult();
+}
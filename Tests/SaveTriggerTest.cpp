@@ -0,0 +1,170 @@
+// Checks the trigger's debounce and coalescing, and that removals only claim the folder stamp when nobody else wrote to it
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SaveIndex.h"
+#include "SaveRemover.h"
+#include "SaveTrigger.h"
+#include "TestCheck.h"
+
+namespace {
+    using namespace std::chrono_literals;
+    using Clock = std::chrono::steady_clock;
+
+    void WriteFile(const std::filesystem::path& path) {
+        std::ofstream(path, std::ios::binary) << "save";
+    }
+
+    // Deletes the files it is given, and can run a foreign write in the middle of the batch
+    class TestRemover : public SaveRemover {
+        std::function<void()> duringBatch;
+
+    public:
+        explicit TestRemover(std::function<void()> duringBatch = nullptr) : duringBatch(std::move(duringBatch)) {}
+
+        void Remove(const std::vector<std::string>& paths, std::vector<RemoveResult>& results) override {
+            results.clear();
+            for (size_t i = 0; i < paths.size(); i++) {
+                std::error_code error;
+                results.push_back(std::filesystem::remove(paths[i], error) ? RemoveResult::Removed : RemoveResult::Missing);
+                if (i == 0 && duringBatch) duringBatch();
+            }
+        }
+    };
+
+    void TestPoll() {
+        SaveTrigger trigger;
+        CHECK(trigger.Wait(20ms, 10ms, 100ms) == TriggerReason::Poll);
+    }
+
+    void TestCoalescing() {
+        SaveTrigger trigger;
+        for (int i = 0; i < 5; i++) trigger.Notify();
+        CHECK(trigger.Wait(1s, 10ms, 1s) == TriggerReason::Event);
+
+        // The whole burst was one event, nothing is left pending
+        CHECK(trigger.Wait(20ms, 10ms, 1s) == TriggerReason::Poll);
+    }
+
+    void TestDebounce() {
+        SaveTrigger trigger;
+        auto start = Clock::now();
+        std::jthread notifier([&trigger] {
+            for (int i = 0; i < 5; i++) {
+                trigger.Notify();
+                std::this_thread::sleep_for(20ms);
+            }
+        });
+        CHECK(trigger.Wait(5s, 60ms, 5s) == TriggerReason::Event);
+
+        // Each notify pushed the deadline back, the wait ends only once they stopped
+        CHECK(Clock::now() - start >= 140ms);
+    }
+
+    void TestMaxDelay() {
+        SaveTrigger trigger;
+        std::atomic<bool> done = false;
+        auto start = Clock::now();
+        std::jthread notifier([&trigger, &done] {
+            while (!done) {
+                trigger.Notify();
+                std::this_thread::sleep_for(5ms);
+            }
+        });
+
+        // A folder that never settles still gets an update once maxDelay has passed
+        CHECK(trigger.Wait(5s, 50ms, 150ms) == TriggerReason::Event);
+        CHECK(Clock::now() - start < 2s);
+        done = true;
+    }
+
+    void TestStop() {
+        SaveTrigger trigger;
+        trigger.Notify();
+        std::jthread stopper([&trigger] {
+            std::this_thread::sleep_for(20ms);
+            trigger.Stop();
+        });
+        CHECK(trigger.Wait(5s, 5s, 5s) == TriggerReason::Stop);
+        CHECK(trigger.Wait(5s, 5s, 5s) == TriggerReason::Stop);
+    }
+
+    void TestOutsideChangeCount() {
+        SaveTrigger trigger;
+        trigger.Notify();
+        CHECK(trigger.GetOutsideChangeCount() == 0);
+        trigger.NotifyOutsideChange();
+        trigger.NotifyOutsideChange();
+        CHECK(trigger.GetOutsideChangeCount() == 2);
+        CHECK(trigger.Wait(1s, 10ms, 1s) == TriggerReason::Event);
+    }
+
+    void TestStamping(const std::filesystem::path& dir) {
+        SaveTrigger trigger;
+        auto changeCount = [&trigger] { return trigger.GetOutsideChangeCount(); };
+        std::vector<RemoveResult> results;
+
+        // The manager's own removal moves the known stamp on with the folder
+        WriteFile(dir / "Save1_A.ess");
+        WriteFile(dir / "Save2_A.ess");
+        std::atomic<std::int64_t> knownWriteTime = GetDirWriteTime(dir.string());
+        std::this_thread::sleep_for(20ms);
+        auto own = CreateStampingRemover(dir.string(), knownWriteTime, changeCount, std::make_unique<TestRemover>());
+        own->Remove({ (dir / "Save1_A.ess").string() }, results);
+        CHECK(knownWriteTime == GetDirWriteTime(dir.string()));
+
+        // The game saves while a batch runs, the folder's new stamp is not the manager's to claim
+        std::int64_t before = GetDirWriteTime(dir.string());
+        knownWriteTime = before;
+        std::this_thread::sleep_for(20ms);
+        auto interleaved = CreateStampingRemover(dir.string(), knownWriteTime, changeCount, std::make_unique<TestRemover>([&] {
+            trigger.NotifyOutsideChange();
+            WriteFile(dir / "Save3_A.ess");
+        }));
+        interleaved->Remove({ (dir / "Save2_A.ess").string(), (dir / "Missing_A.ess").string() }, results);
+        CHECK(results.size() == 2);
+        CHECK(std::filesystem::exists(dir / "Save3_A.ess"));
+        CHECK(knownWriteTime == before);
+        CHECK(knownWriteTime != GetDirWriteTime(dir.string()));
+
+        // Without a count nothing is claimed either
+        WriteFile(dir / "Save4_A.ess");
+        before = GetDirWriteTime(dir.string());
+        knownWriteTime = before;
+        std::this_thread::sleep_for(20ms);
+        auto uncounted = CreateStampingRemover(dir.string(), knownWriteTime, nullptr, std::make_unique<TestRemover>());
+        uncounted->Remove({ (dir / "Save4_A.ess").string() }, results);
+        CHECK(!std::filesystem::exists(dir / "Save4_A.ess"));
+        CHECK(knownWriteTime == before);
+
+        // A folder that already moved on before the batch keeps its old known stamp
+        WriteFile(dir / "Save5_A.ess");
+        knownWriteTime = before;
+        own->Remove({ (dir / "Save5_A.ess").string() }, results);
+        CHECK(knownWriteTime == before);
+    }
+}
+
+int main() {
+    TestPoll();
+    TestCoalescing();
+    TestDebounce();
+    TestMaxDelay();
+    TestStop();
+    TestOutsideChangeCount();
+
+    std::error_code error;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(error) / "SaveTriggerTest";
+    std::filesystem::remove_all(dir, error);
+    std::filesystem::create_directories(dir, error);
+    TestStamping(dir);
+    std::filesystem::remove_all(dir, error);
+
+    return TestResult();
+}
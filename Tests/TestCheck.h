@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+// Checks for the test executables, a failed check is printed and the test exits non-zero at the end
+inline int testFailures = 0;
+
+#define CHECK(condition)                                                                      \
+    do {                                                                                      \
+        if (!(condition)) {                                                                   \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            testFailures++;                                                                   \
+        }                                                                                     \
+    } while (0)
+
+// Save name times are compared against fixed UTC values, so the tests run as if the machine were on UTC
+inline void UseUtcTimeZone() {
+#ifdef _WIN32
+    _putenv_s("TZ", "UTC");
+    _tzset();
+#else
+    setenv("TZ", "UTC", 1);
+    tzset();
+#endif
+}
+
+inline int TestResult() {
+    if (testFailures) std::fprintf(stderr, "%d checks failed\n", testFailures);
+    return testFailures ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+#include "UserVars.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <spdlog/spdlog.h>
+
+#include "IniReader.h"
+
+namespace {
+    // Reads a layout like "16, 32:0.5, 128:1, -1:4", returns false if it is not one
+    bool ParseTierLayout(const std::string& layout, UserVars& userVars) {
+        std::array<RetentionTier, maxTierCount> tiers = {};
+        int tierCount = 0;
+        const char* cur = layout.c_str();
+        while (*cur) {
+            char* end = nullptr;
+            long count = std::strtol(cur, &end, 10);
+            if (end == cur || tierCount == maxTierCount) return false;
+            cur = end;
+
+            float spacing = 0;
+            while (*cur == ' ' || *cur == '\t') cur++;
+            if (*cur == ':') {
+                spacing = std::strtof(cur + 1, &end);
+                if (end == cur + 1) return false;
+                cur = end;
+            }
+            tiers[tierCount++] = { static_cast<int>(count), spacing };
+
+            while (*cur == ' ' || *cur == '\t') cur++;
+            if (*cur == ',') cur++;
+            else if (*cur) return false;
+        }
+        if (tierCount == 0) return false;
+
+        userVars.tiers = tiers;
+        userVars.tierCount = tierCount;
+        return true;
+    }
+}
+
+UserVars ReadUserVars(const std::string& iniPath) {
+    IniReader reader(iniPath, "SaveManager");
+    UserVars userVars;
+
+    // Load ini vars
+    userVars.pollTime = reader.ReadFloat("fPollTime", 1.0);
+    userVars.watchSaveFolder = reader.ReadBool("bWatchSaveFolder", "true");
+    userVars.debounceTime = reader.ReadFloat("fDebounceTime", 10.0);
+    userVars.recycle = reader.ReadBool("bRecycle", "false");
+    userVars.dryRun = reader.ReadBool("bDryRun", "false");
+    userVars.archiveOverflow = reader.ReadBool("bArchiveOverflow", "false");
+    userVars.dedupOldSaves = reader.ReadBool("bDedupOldSaves", "false");
+    userVars.coldSaveFolder = reader.ReadStr("sColdSaveFolder", "");
+    userVars.coldFromBlock = reader.ReadInt("iColdFromBlock", 3);
+    userVars.maxDeletesPerSecond = reader.ReadFloat("fMaxDeletesPerSecond", 10.0);
+    userVars.maxDeleteMBPerSecond = reader.ReadFloat("fMaxDeleteMBPerSecond", 100.0);
+    userVars.minSaveAge = reader.ReadFloat("fMinSaveAge", 10.0);
+    userVars.verifySaves = reader.ReadBool("bVerifySaves", "true");
+    userVars.useGameTime = reader.ReadBool("bUseGameTime", "false");
+    userVars.enableMetrics = reader.ReadBool("bEnableMetrics", "false");
+    userVars.primaryBlockCount = reader.ReadInt("iPrimaryBlockCount", 16);
+    userVars.secondaryBlockCount = reader.ReadInt("iSecondaryBlockCount", 32);
+    userVars.desiredSecondarySpacing = reader.ReadFloat("fDesiredSecondarySpacing", 0.5);
+    userVars.tertiaryBlockCount = reader.ReadInt("iTertiaryBlockCount", 64);
+    userVars.desiredTertiarySpacing = reader.ReadFloat("fDesiredTertiarySpacing", 1.0);
+    userVars.maxOverflow = reader.ReadInt("iMaxOverflow", -1);
+    userVars.desiredOverflowSpacing = reader.ReadFloat("fDesiredOverflowSpacing", 4.0);
+    userVars.maxFolderMB = reader.ReadInt("iMaxFolderMB", -1);
+    std::string tierLayout = reader.ReadStr("sTierLayout", "");
+
+    // Clamp user input
+    if (userVars.primaryBlockCount < 1) userVars.primaryBlockCount = 1;
+    if (userVars.secondaryBlockCount < 0) userVars.secondaryBlockCount = 0;
+    if (userVars.tertiaryBlockCount < 0) userVars.tertiaryBlockCount = 0;
+    if (userVars.debounceTime < 0) userVars.debounceTime = 0;
+    if (userVars.maxDeletesPerSecond < 0) userVars.maxDeletesPerSecond = 0;
+    if (userVars.maxDeleteMBPerSecond < 0) userVars.maxDeleteMBPerSecond = 0;
+    if (userVars.minSaveAge < 0) userVars.minSaveAge = 0;
+
+    // The block counts and spacings are the default layout
+    userVars.tiers = {};
+    userVars.tiers[0] = { userVars.primaryBlockCount, 0 };
+    userVars.tiers[1] = { userVars.secondaryBlockCount, userVars.desiredSecondarySpacing };
+    userVars.tiers[2] = { userVars.tertiaryBlockCount, userVars.desiredTertiarySpacing };
+    userVars.tiers[3] = { userVars.maxOverflow, userVars.desiredOverflowSpacing };
+    userVars.tierCount = defaultTierCount;
+    if (!tierLayout.empty() && !ParseTierLayout(tierLayout, userVars)) {
+        spdlog::warn("sTierLayout = {} is not a list of up to {} blocks like 16, 32:0.5, 128:1, -1:4, using the block counts instead",
+            tierLayout, maxTierCount);
+    }
+
+    // Only the last block can be unlimited, and the primary block always keeps the newest save
+    for (int i = 0; i < userVars.tierCount; i++) {
+        RetentionTier& tier = userVars.tiers[i];
+        if (tier.count < 0 && i != userVars.tierCount - 1) tier.count = 0;
+        if (tier.count < -1) tier.count = -1;
+        if (tier.spacing < 0 || i == 0) tier.spacing = 0;
+    }
+    if (userVars.tiers[0].count == 0) userVars.tiers[0].count = 1;
+
+    // Blocks are counted from 1 here, the primary block always stays in the save folder
+    userVars.coldFromBlock = std::clamp(userVars.coldFromBlock, 2, userVars.tierCount);
+
+    return userVars;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <string>
+
+// One block of saves in the retention layout, saves move on to the next block once it is full
+struct RetentionTier {
+    int count;      // Saves the block holds, -1 for no limit
+    float spacing;  // Hours wanted between the saves of the block, the primary block is never thinned
+
+    bool operator==(const RetentionTier&) const = default;
+};
+
+// Blocks are kept inline so a chain never looks its layout up through the heap
+inline constexpr int maxTierCount = 8;
+
+// Primary, secondary, tertiary and overflow, unless sTierLayout gives another layout
+inline constexpr int defaultTierCount = 4;
+
+// Documentation on user variables can be found in SaveManager.ini
+struct UserVars {
+    float pollTime;
+    bool watchSaveFolder;
+    float debounceTime;
+    bool recycle;
+    bool dryRun;
+    bool archiveOverflow;
+    bool dedupOldSaves;
+    std::string coldSaveFolder;
+    int coldFromBlock;
+    float maxDeletesPerSecond;
+    float maxDeleteMBPerSecond;
+    float minSaveAge;
+    bool verifySaves;
+    bool useGameTime;
+    bool enableMetrics;
+    int primaryBlockCount;
+    int secondaryBlockCount;
+    float desiredSecondarySpacing;
+    int tertiaryBlockCount;
+    float desiredTertiarySpacing;
+    int maxOverflow;
+    float desiredOverflowSpacing;
+    int maxFolderMB;
+
+    // Blocks from the newest saves to the oldest, built from sTierLayout or from the block counts and spacings above
+    // The first block is the primary block, saves are deleted once they leave the last one
+    std::array<RetentionTier, maxTierCount> tiers;
+    int tierCount;
+};
+
+// Loads the [SaveManager] section of the ini, clamped to usable values
+UserVars ReadUserVars(const std::string& iniPath);
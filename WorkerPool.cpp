@@ -0,0 +1,132 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <exception>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+void LowerCurrentThreadPriority() {
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+    // Linux applies nice values per thread
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+}
+
+size_t GetDefaultWorkerCount() {
+    size_t cores = std::thread::hardware_concurrency();
+    return std::clamp<size_t>(cores / 2, 1, 4);
+}
+
+WorkerPool::WorkerPool(size_t threadCount) {
+    for (size_t i = 0; i <= threadCount; i++) {
+        queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+        threads.emplace_back(&WorkerPool::RunWorker, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+bool WorkerPool::RunOne(size_t self) {
+    std::function<void()> task;
+
+    // Own work is taken newest first, stolen work oldest first
+    {
+        TaskQueue& own = *queues[self];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+        }
+    }
+    for (size_t offset = 1; !task && offset < queues.size(); offset++) {
+        TaskQueue& victim = *queues[(self + offset) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+    if (!task) return false;
+
+    queuedCount--;
+    task();
+    return true;
+}
+
+void WorkerPool::RunWorker(size_t self) {
+    LowerCurrentThreadPriority();
+    while (true) {
+        if (RunOne(self)) continue;
+
+        std::unique_lock lock(mutex);
+        wakeup.wait(lock, [this] { return stopping || queuedCount > 0; });
+        if (stopping && queuedCount == 0) return;
+    }
+}
+
+void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t)>& function) {
+    if (count == 0) return;
+    if (count == 1 || threads.empty()) {
+        for (size_t i = 0; i < count; i++) function(i);
+        return;
+    }
+
+    // Shared by the tasks of this call only, so calls from different threads do not wait on each other
+    struct Batch {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining;
+        std::exception_ptr error;
+    } batch;
+    batch.remaining = count;
+
+    // Dealt out round robin, stealing evens out jobs of different sizes
+    for (size_t i = 0; i < count; i++) {
+        TaskQueue& queue = *queues[i % queues.size()];
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back([&batch, &function, i] {
+            std::exception_ptr error;
+            try {
+                function(i);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard lock(batch.mutex);
+            if (error && !batch.error) batch.error = error;
+            if (--batch.remaining == 0) batch.done.notify_all();
+        });
+        queuedCount++;
+    }
+    {
+        std::lock_guard lock(mutex);
+    }
+    wakeup.notify_all();
+
+    // Help out until nothing is left to take, then wait for the jobs still running elsewhere
+    size_t self = queues.size() - 1;
+    while (RunOne(self)) {}
+
+    std::unique_lock lock(batch.mutex);
+    batch.done.wait(lock, [&batch] { return batch.remaining == 0; });
+    if (batch.error) std::rethrow_exception(batch.error);
+}
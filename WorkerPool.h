@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Drops the calling thread below normal priority so background work does not compete with the game's frames
+void LowerCurrentThreadPriority();
+
+// Small work-stealing pool for independent jobs such as building one save chain each
+// Every thread owns a queue, idle threads steal from the other end of busier ones
+class WorkerPool {
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // The last queue belongs to whichever thread is waiting in ParallelFor
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::atomic<size_t> queuedCount = 0;
+    bool stopping = false;
+
+    // Runs one task from the thread's own queue, or steals one, returns false if there was none
+    bool RunOne(size_t self);
+    void RunWorker(size_t self);
+
+public:
+    // threadCount does not include the caller, which also works while it waits
+    explicit WorkerPool(size_t threadCount);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t GetThreadCount() const {
+        return threads.size();
+    }
+
+    // Calls function(i) for every i in [0, count) and returns once all calls are done
+    // The first exception thrown by a call is rethrown here
+    void ParallelFor(size_t count, const std::function<void(size_t)>& function);
+};
+
+// Leaves a core for the game and caps the pool, save chains are rarely numerous enough for more
+size_t GetDefaultWorkerCount();